@@ -0,0 +1,101 @@
+#!/bin/sh
+# Compares generated functions with field tables (--tables) when many types are serialized:
+# generates <types> structs, serializes values of all of them round-robin and reports
+# the time and the size of the generated code of both modes.
+#
+# usage: bench/many_types.sh <path to serc> [types] [rounds]
+set -e
+
+SERC=$(realpath "$1")
+TYPES=${2:-2000}
+ROUNDS=${3:-200}
+CC=${CC:-cc}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# every type has a different mix of fields, so the code of each serializer differs
+{
+  echo "#ifndef TYPES_H"
+  echo "#define TYPES_H"
+  i=0
+  while [ $i -lt "$TYPES" ]; do
+    echo "typedef struct T$i {"
+    echo "  int id;"
+    echo "  double value;"
+    [ $((i % 2)) -eq 0 ] && echo "  float weights[4];"
+    [ $((i % 3)) -eq 0 ] && echo "  long long int stamp;"
+    [ $((i % 5)) -eq 0 ] && echo "  short flags[2][3];"
+    echo "  char tag;"
+    echo "} T$i;"
+    i=$((i + 1))
+  done
+  echo "#endif"
+} > "$WORK/types.h"
+
+{
+  echo "#include <stdio.h>"
+  echo "#include <stdlib.h>"
+  echo "#include <time.h>"
+  echo "#include \"types.h\""
+  echo "#include \"json.h\""
+  i=0
+  while [ $i -lt "$TYPES" ]; do
+    echo "static T$i v$i = { .id = $i, .value = $i.5, .tag = 'a' };"
+    i=$((i + 1))
+  done
+  echo "static const SerializeFunc funcs[] = {"
+  i=0
+  while [ $i -lt "$TYPES" ]; do
+    echo "  serializer_T${i}_to_json,"
+    i=$((i + 1))
+  done
+  echo "};"
+  echo "static const void *values[] = {"
+  i=0
+  while [ $i -lt "$TYPES" ]; do
+    echo "  &v$i,"
+    i=$((i + 1))
+  done
+  echo "};"
+  cat <<'MAIN'
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 1;
+  size_t types = sizeof(funcs) / sizeof(funcs[0]);
+  size_t bytes = 0;
+  Serializer ser;
+
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int r = 0; r < rounds; ++r) {
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    for (size_t i = 0; i < types; ++i) {
+      if (!funcs[i](&ser, values[i])) return 1;
+    }
+    serializer_end_serialization(&ser, SER_KIND_JSON);
+    bytes += ser.count;
+    serializer_free(&ser);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+  printf("%8.1f ms, %6.1f MB/s", ms, bytes / ms / 1e3);
+  return 0;
+}
+MAIN
+} > "$WORK/main.c"
+
+for mode in functions tables; do
+  dir="$WORK/$mode"
+  mkdir -p "$dir"
+  cp "$ROOT/src/serialization/primitives.h" "$ROOT/src/serialization/primitives.c" "$dir/"
+  flag=""
+  [ "$mode" = tables ] && flag="--tables"
+  "$SERC" --no-cache $flag -o "$dir/" "$WORK/types.h" >/dev/null
+  $CC -std=gnu11 -O2 -I"$WORK" -I"$dir" -c "$dir/json.c" -o "$dir/json.o"
+  $CC -std=gnu11 -O2 -I"$WORK" -I"$dir" "$WORK/main.c" "$dir/json.o" "$dir/primitives.c" -pthread -o "$dir/bench"
+
+  text=$(size "$dir/json.o" | awk 'NR == 2 { print $1 }')
+  printf "%-10s %d types x %d rounds: %s, json.o text %d bytes\n" \
+    "$mode" "$TYPES" "$ROUNDS" "$("$dir/bench" "$ROUNDS")" "$text"
+done
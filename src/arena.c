@@ -0,0 +1,120 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+static atomic_size_t g_arena_current;
+static atomic_size_t g_arena_peak;
+
+static void arena_usage_add(usize size) {
+  usize current = atomic_fetch_add(&g_arena_current, size) + size;
+  usize peak = atomic_load(&g_arena_peak);
+  while (peak < current && !atomic_compare_exchange_weak(&g_arena_peak, &peak, current));
+}
+
+static void arena_usage_sub(usize size) {
+  atomic_fetch_sub(&g_arena_current, size);
+}
+
+static usize arena_align(usize size) {
+  return (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+}
+
+static void arena_chunk_free(ArenaChunk *p_chunk) {
+  arena_usage_sub(sizeof(ArenaChunk) + p_chunk->capacity);
+  free(p_chunk);
+}
+
+void arena_init(Arena *p_arena, usize chunk_size) {
+  assert(NULL != p_arena);
+
+  *p_arena = (Arena){
+    .chunk_size = arena_align(0 == chunk_size ? ARENA_DEFAULT_CHUNK_SIZE : chunk_size),
+  };
+}
+
+void* arena_alloc(Arena *p_arena, usize size) {
+  assert(NULL != p_arena);
+
+  size = arena_align(0 == size ? 1 : size);
+
+  ArenaChunk *p_chunk = p_arena->head;
+  if (NULL == p_chunk || p_chunk->capacity - p_chunk->count < size) {
+    usize capacity = p_arena->chunk_size;
+    if (capacity < size) capacity = size;
+
+    p_chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + capacity);
+    if (NULL == p_chunk) {
+      return NULL;
+    }
+    arena_usage_add(sizeof(ArenaChunk) + capacity);
+
+    *p_chunk = (ArenaChunk){ .next = p_arena->head, .count = 0, .capacity = capacity };
+    p_arena->head = p_chunk;
+
+    if (p_arena->chunk_size < ARENA_MAX_CHUNK_SIZE) {
+      p_arena->chunk_size *= 2;
+    }
+  }
+
+  void *ptr = (u8*)p_chunk->data + p_chunk->count;
+  p_chunk->count += size;
+
+  p_arena->used += size;
+  if (p_arena->used > p_arena->peak) p_arena->peak = p_arena->used;
+
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+char* arena_strndup(Arena *p_arena, const char *str, usize length) {
+  assert(NULL != str || 0 == length);
+
+  char *copy = (char*)arena_alloc(p_arena, length + 1);
+  if (NULL != copy && 0 != length) {
+    memcpy(copy, str, length);
+  }
+
+  return copy;
+}
+
+void arena_reset(Arena *p_arena) {
+  assert(NULL != p_arena);
+
+  if (NULL == p_arena->head) {
+    return;
+  }
+
+  ArenaChunk *p_chunk = p_arena->head->next;
+  while (NULL != p_chunk) {
+    ArenaChunk *p_next = p_chunk->next;
+    arena_chunk_free(p_chunk);
+    p_chunk = p_next;
+  }
+
+  p_arena->head->next = NULL;
+  p_arena->head->count = 0;
+  p_arena->used = 0;
+}
+
+void arena_free(Arena *p_arena) {
+  assert(NULL != p_arena);
+
+  ArenaChunk *p_chunk = p_arena->head;
+  while (NULL != p_chunk) {
+    ArenaChunk *p_next = p_chunk->next;
+    arena_chunk_free(p_chunk);
+    p_chunk = p_next;
+  }
+
+  p_arena->head = NULL;
+  p_arena->used = 0;
+}
+
+ArenaUsage arena_usage(void) {
+  return (ArenaUsage){
+    .current = atomic_load(&g_arena_current),
+    .peak = atomic_load(&g_arena_peak),
+  };
+}
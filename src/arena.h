@@ -0,0 +1,66 @@
+#ifndef __SERC_ARENA_H__
+#define __SERC_ARENA_H__
+
+#include "common.h"
+
+/// Minimal capacity of the first chunk of an arena
+#define ARENA_DEFAULT_CHUNK_SIZE (4 * 1024)
+
+/// Chunks stop doubling at this capacity, bigger allocations get a chunk of their own
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  usize count;
+  usize capacity;
+  max_align_t data[];
+} ArenaChunk;
+
+/// Bump allocator that grows by chunks on demand.
+/// Memory is released all at once with arena_reset or arena_free.
+/// An arena is not thread safe, but different arenas can be used from different threads
+typedef struct {
+  /// chunk allocations are made from, older chunks follow it
+  ArenaChunk *head;
+
+  /// capacity of the next chunk
+  usize chunk_size;
+
+  /// bytes allocated from the arena since the last reset and their maximum
+  usize used;
+  usize peak;
+} Arena;
+
+/// Initializes an empty arena, no memory is reserved until the first allocation
+///
+/// @param p_arena: arena to initialize
+/// @param chunk_size: capacity of the first chunk, ARENA_DEFAULT_CHUNK_SIZE if 0
+/// @return void
+void arena_init(Arena *p_arena, usize chunk_size);
+
+/// Allocates size zeroed bytes aligned for any type
+///
+/// @return void*, NULL if out of memory
+void* arena_alloc(Arena *p_arena, usize size);
+
+/// Copies length bytes of str into the arena and NUL terminates them
+///
+/// @return char*, NULL if out of memory
+char* arena_strndup(Arena *p_arena, const char *str, usize length);
+
+/// Releases all allocations, the newest chunk is kept for reuse
+void arena_reset(Arena *p_arena);
+
+/// Releases all memory of the arena
+void arena_free(Arena *p_arena);
+
+/// Memory held by all arenas of the process
+typedef struct {
+  usize current;
+  usize peak;
+} ArenaUsage;
+
+/// Returns bytes of chunks currently held by all arenas and the maximum of it
+ArenaUsage arena_usage(void);
+
+#endif // !__SERC_ARENA_H__
@@ -0,0 +1,629 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "symbol.h"
+#include "./lib/ds/allocator.h"
+#include "./lib/ds/logger.h"
+
+// Cache file layout, integers are in the native byte order:
+//   u32 magic, u32 version, u64 options hash, u32 entries count
+//   entries: u32 path length (with NUL), path, u64 content hash, u64 blob size, u64 blob hash, blob
+//
+// Blob layout:
+//   u32 string table size, string table
+//   u32 structs count, structs: name, u32 fields count, fields: name, type info
+//   u32 typedefs count, typedefs: name, type info
+//
+// Names in the blob are u32 offsets into its string table. Each distinct string is stored
+// there once as u32 length, bytes and NUL, so readers can use it as a C string too.
+// Offset 0 is the empty string
+//
+// Schema file layout: u32 magic, u32 version, blob
+
+#define SCHEMA_CACHE_MAGIC 0x43524553u // "SERC"
+#define SCHEMA_FILE_MAGIC  0x53524553u // "SERS"
+
+typedef struct {
+  u8 *data;
+  usize count;
+  usize capacity;
+  bool ok;
+} BlobWriter;
+
+typedef struct {
+  const u8 *p_current;
+  const u8 *p_end;
+  bool ok;
+} BlobReader;
+
+typedef struct {
+  BlobWriter strings;
+  BlobWriter body;
+
+  /// string -> offset in strings, stored in Symbol.p_data
+  SymbolTable offsets;
+  Arena arena;
+} SchemaWriter;
+
+typedef struct {
+  BlobReader body;
+  const u8 *strings;
+  usize strings_size;
+} SchemaReader;
+
+// ----------------- | WRITER |
+
+static void writer_bytes(BlobWriter *p_writer, const void *data, usize size) {
+  if (!p_writer->ok) return;
+
+  if (p_writer->count + size > p_writer->capacity) {
+    usize capacity = 0 == p_writer->capacity ? 256 : p_writer->capacity;
+    while (capacity < p_writer->count + size) capacity *= 2;
+
+    u8 *tmp = (u8*)realloc(p_writer->data, capacity);
+    if (NULL == tmp) {
+      p_writer->ok = false;
+      return;
+    }
+    p_writer->data = tmp;
+    p_writer->capacity = capacity;
+  }
+
+  if (0 != size) memcpy(p_writer->data + p_writer->count, data, size);
+  p_writer->count += size;
+}
+
+static void writer_u8(BlobWriter *p_writer, u8 value) {
+  writer_bytes(p_writer, &value, sizeof(value));
+}
+
+static void writer_u32(BlobWriter *p_writer, u32 value) {
+  writer_bytes(p_writer, &value, sizeof(value));
+}
+
+static void writer_u64(BlobWriter *p_writer, u64 value) {
+  writer_bytes(p_writer, &value, sizeof(value));
+}
+
+static void writer_string_ref(SchemaWriter *p_writer, StringView sv) {
+  if (0 == sv.length) {
+    writer_u32(&p_writer->body, 0);
+    return;
+  }
+
+  Symbol *p_symbol = symbol_intern(&p_writer->offsets, &p_writer->arena, sv);
+  if (NULL == p_symbol->p_data) {
+    p_symbol->p_data = (void*)(uintptr_t)p_writer->strings.count;
+    writer_u32(&p_writer->strings, (u32)sv.length);
+    writer_bytes(&p_writer->strings, sv.p_begin, sv.length);
+    writer_u8(&p_writer->strings, '\0');
+  }
+
+  writer_u32(&p_writer->body, (u32)(uintptr_t)p_symbol->p_data);
+}
+
+static void writer_type_info(SchemaWriter *p_schema_writer, const TypeInfo *p_ti) {
+  BlobWriter *p_writer = &p_schema_writer->body;
+
+  writer_u8(p_writer, (u8)p_ti->base_type);
+  writer_u8(p_writer, (u8)p_ti->longness);
+  writer_u8(p_writer, p_ti->is_const);
+  writer_u8(p_writer, p_ti->is_unsigned);
+  writer_u8(p_writer, (u8)p_ti->pointer_info.indirections_count);
+  for (unsigned int i = 0; i < MAX_INDERECTION_LEVEL; ++i) {
+    writer_u8(p_writer, p_ti->pointer_info.is_const[i]);
+  }
+  writer_u8(p_writer, (u8)p_ti->array_info.dims_count);
+  for (unsigned int i = 0; i < p_ti->array_info.dims_count; ++i) {
+    writer_u32(p_writer, p_ti->array_info.dims[i]);
+  }
+  writer_string_ref(p_schema_writer, p_ti->struct_name);
+
+  writer_u8(p_writer, (u8)p_ti->ann_info.kind);
+  switch (p_ti->ann_info.kind) {
+    case ANN_ARRAY:
+      writer_string_ref(p_schema_writer, p_ti->ann_info.as.annotation_array.array_size_field_name);
+      break;
+    case ANN_BYTES:
+      writer_string_ref(p_schema_writer, p_ti->ann_info.as.annotation_bytes.size_field_name);
+      writer_u8(p_writer, (u8)p_ti->ann_info.as.annotation_bytes.encoding);
+      break;
+    case ANN_CUSTOM_CALLBACK:
+      writer_string_ref(p_schema_writer, p_ti->ann_info.as.annotation_custom_callback.cb_ser_name);
+      writer_string_ref(p_schema_writer, p_ti->ann_info.as.annotation_custom_callback.cb_deser_name);
+      break;
+    default: break;
+  }
+
+  writer_u8(p_writer, (u8)p_ti->ann_info.views_count);
+  for (unsigned int i = 0; i < p_ti->ann_info.views_count; ++i) {
+    writer_string_ref(p_schema_writer, p_ti->ann_info.views[i]);
+  }
+}
+
+// ----------------- | READER |
+
+static const u8* reader_bytes(BlobReader *p_reader, usize size) {
+  if (!p_reader->ok || (usize)(p_reader->p_end - p_reader->p_current) < size) {
+    p_reader->ok = false;
+    return NULL;
+  }
+
+  const u8 *bytes = p_reader->p_current;
+  p_reader->p_current += size;
+  return bytes;
+}
+
+static u8 reader_u8(BlobReader *p_reader) {
+  const u8 *bytes = reader_bytes(p_reader, sizeof(u8));
+  return NULL == bytes ? 0 : *bytes;
+}
+
+static u32 reader_u32(BlobReader *p_reader) {
+  u32 value = 0;
+  const u8 *bytes = reader_bytes(p_reader, sizeof(value));
+  if (NULL != bytes) memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static u64 reader_u64(BlobReader *p_reader) {
+  u64 value = 0;
+  const u8 *bytes = reader_bytes(p_reader, sizeof(value));
+  if (NULL != bytes) memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static StringView reader_string_ref(SchemaReader *p_reader) {
+  u32 offset = reader_u32(&p_reader->body);
+
+  u32 length = 0;
+  if (p_reader->strings_size < sizeof(length) || offset > p_reader->strings_size - sizeof(length)) {
+    p_reader->body.ok = false;
+    return (StringView){0};
+  }
+  memcpy(&length, p_reader->strings + offset, sizeof(length));
+
+  usize begin = offset + sizeof(length);
+  if (length >= p_reader->strings_size - begin || '\0' != p_reader->strings[begin + length]) {
+    p_reader->body.ok = false;
+    return (StringView){0};
+  }
+
+  if (0 == length) {
+    return (StringView){0};
+  }
+
+  return (StringView){ .p_begin = (const char*)p_reader->strings + begin, .length = length };
+}
+
+static void reader_type_info(SchemaReader *p_schema_reader, TypeInfo *p_ti) {
+  BlobReader *p_reader = &p_schema_reader->body;
+
+  *p_ti = (TypeInfo){0};
+
+  u8 base_type = reader_u8(p_reader);
+  p_ti->longness = reader_u8(p_reader);
+  p_ti->is_const = 0 != reader_u8(p_reader);
+  p_ti->is_unsigned = 0 != reader_u8(p_reader);
+  u8 indirections_count = reader_u8(p_reader);
+  for (unsigned int i = 0; i < MAX_INDERECTION_LEVEL; ++i) {
+    p_ti->pointer_info.is_const[i] = 0 != reader_u8(p_reader);
+  }
+  u8 dims_count = reader_u8(p_reader);
+  if (dims_count > MAX_ARRAY_DIMENSIONS) {
+    p_reader->ok = false;
+    return;
+  }
+  for (unsigned int i = 0; i < dims_count; ++i) {
+    p_ti->array_info.dims[i] = reader_u32(p_reader);
+    if (0 == p_ti->array_info.dims[i]) p_reader->ok = false;
+  }
+  p_ti->array_info.dims_count = dims_count;
+  p_ti->struct_name = reader_string_ref(p_schema_reader);
+
+  u8 kind = reader_u8(p_reader);
+  if (base_type > TYPE_STRUCT || indirections_count > MAX_INDERECTION_LEVEL || kind > ANN_BYTES) {
+    p_reader->ok = false;
+    return;
+  }
+
+  p_ti->base_type = (BaseType)base_type;
+  p_ti->pointer_info.indirections_count = indirections_count;
+  p_ti->ann_info.kind = (AnnotationKind)kind;
+
+  switch (p_ti->ann_info.kind) {
+    case ANN_ARRAY:
+      p_ti->ann_info.as.annotation_array.array_size_field_name = reader_string_ref(p_schema_reader);
+      break;
+    case ANN_BYTES: {
+      p_ti->ann_info.as.annotation_bytes.size_field_name = reader_string_ref(p_schema_reader);
+      u8 encoding = reader_u8(p_reader);
+      if (encoding > BYTES_HEX) {
+        p_reader->ok = false;
+        return;
+      }
+      p_ti->ann_info.as.annotation_bytes.encoding = (BytesEncoding)encoding;
+      break;
+    }
+    case ANN_CUSTOM_CALLBACK:
+      p_ti->ann_info.as.annotation_custom_callback.cb_ser_name = reader_string_ref(p_schema_reader);
+      p_ti->ann_info.as.annotation_custom_callback.cb_deser_name = reader_string_ref(p_schema_reader);
+      break;
+    default: break;
+  }
+
+  u8 views_count = reader_u8(p_reader);
+  if (views_count > MAX_FIELD_VIEWS) {
+    p_reader->ok = false;
+    return;
+  }
+  for (unsigned int i = 0; i < views_count; ++i) {
+    p_ti->ann_info.views[i] = reader_string_ref(p_schema_reader);
+  }
+  p_ti->ann_info.views_count = views_count;
+}
+
+// ----------------- | SCHEMA |
+
+bool schema_serialize(const Schema *p_schema, SchemaBlob *p_out) {
+  assert(NULL != p_schema);
+  assert(NULL != p_out);
+
+  SchemaWriter writer = { .strings.ok = true, .body.ok = true };
+  symbol_table_init(&writer.offsets);
+  arena_init(&writer.arena, 0);
+
+  writer_u32(&writer.strings, 0); // the empty string
+  writer_u8(&writer.strings, '\0');
+
+  writer_u32(&writer.body, (u32)vec_count(p_schema->structs));
+  for (size_t i = 0; i < vec_count(p_schema->structs); ++i) {
+    const StructInfo *p_si = vec_at(p_schema->structs, i);
+    writer_string_ref(&writer, p_si->name);
+    writer_u8(&writer.body, p_si->is_incremental);
+
+    writer_u32(&writer.body, (u32)vec_count(p_si->fields));
+    for (size_t j = 0; j < vec_count(p_si->fields); ++j) {
+      const VarInfo *p_field = vec_at(p_si->fields, j);
+      writer_string_ref(&writer, p_field->name);
+      writer_type_info(&writer, &p_field->type_info);
+    }
+  }
+
+  writer_u32(&writer.body, (u32)vec_count(p_schema->typedefs));
+  for (size_t i = 0; i < vec_count(p_schema->typedefs); ++i) {
+    writer_string_ref(&writer, p_schema->typedefs[i].name);
+    writer_type_info(&writer, p_schema->typedefs[i].p_type_info);
+  }
+
+  symbol_table_free(&writer.offsets);
+  arena_free(&writer.arena);
+
+  BlobWriter blob = { .ok = writer.strings.ok && writer.body.ok };
+  writer_u32(&blob, (u32)writer.strings.count);
+  writer_bytes(&blob, writer.strings.data, writer.strings.count);
+  writer_bytes(&blob, writer.body.data, writer.body.count);
+
+  free(writer.strings.data);
+  free(writer.body.data);
+
+  if (!blob.ok) {
+    free(blob.data);
+    return false;
+  }
+
+  *p_out = (SchemaBlob){ .data = blob.data, .size = blob.count };
+  return true;
+}
+
+void schema_blob_free(SchemaBlob *p_blob) {
+  assert(NULL != p_blob);
+  free((void*)p_blob->data);
+  *p_blob = (SchemaBlob){0};
+}
+
+bool schema_deserialize(const SchemaBlob *p_blob, Schema *p_out) {
+  assert(NULL != p_blob);
+  assert(NULL != p_out);
+
+  SchemaReader reader = {
+    .body = { .p_current = p_blob->data, .p_end = p_blob->data + p_blob->size, .ok = true }
+  };
+
+  reader.strings_size = reader_u32(&reader.body);
+  reader.strings = reader_bytes(&reader.body, reader.strings_size);
+
+  u32 structs_count = reader_u32(&reader.body);
+  for (u32 i = 0; reader.body.ok && i < structs_count; ++i) {
+    StructInfo si;
+    struct_info_init(si);
+    si.name = reader_string_ref(&reader);
+    si.is_incremental = 0 != reader_u8(&reader.body);
+
+    u32 fields_count = reader_u32(&reader.body);
+    for (u32 j = 0; reader.body.ok && j < fields_count; ++j) {
+      VarInfo field = {0};
+      field.name = reader_string_ref(&reader);
+      reader_type_info(&reader, &field.type_info);
+      vec_push(si.fields, field);
+    }
+
+    vec_push(p_out->structs, si);
+  }
+
+  u32 typedefs_count = reader_u32(&reader.body);
+  for (u32 i = 0; reader.body.ok && i < typedefs_count; ++i) {
+    StringView name = reader_string_ref(&reader);
+    TypeInfo type_info;
+    reader_type_info(&reader, &type_info);
+
+    if (reader.body.ok && !schema_add_typedef(p_out, name, &type_info)) {
+      reader.body.ok = false;
+    }
+  }
+
+  return reader.body.ok && reader.body.p_current == reader.body.p_end;
+}
+
+// ----------------- | CACHE FILE |
+
+static bool schema_cache_key_cmp(const char *lhs, const char *rhs) {
+  return 0 == strcmp(lhs, rhs);
+}
+
+static void schema_cache_free_cb(char *key, SchemaCacheEntry *value) {
+  // keys point into the cache file, values into SchemaCache.entries
+  (void)key;
+  (void)value;
+}
+
+void schema_cache_init(SchemaCache *p_cache) {
+  assert(NULL != p_cache);
+
+  *p_cache = (SchemaCache){0};
+  table_init(&p_cache->entries_table, hash_cstr_default,
+             (KeyCmpFunc)schema_cache_key_cmp, (FreeKeyValFunc)schema_cache_free_cb);
+}
+
+/// Reads entries of the loaded cache file
+///
+/// @return bool, false if the file is corrupted or outdated
+static bool schema_cache_read_entries(SchemaCache *p_cache, u64 options_hash) {
+  BlobReader reader = {
+    .p_current = (const u8*)p_cache->file.data,
+    .p_end = (const u8*)p_cache->file.data + p_cache->file.length,
+    .ok = true
+  };
+
+  if (SCHEMA_CACHE_MAGIC != reader_u32(&reader)
+    || SCHEMA_CACHE_VERSION != reader_u32(&reader)
+    || options_hash != reader_u64(&reader)) {
+    return false;
+  }
+
+  u32 entries_count = reader_u32(&reader);
+  if (!reader.ok || entries_count > p_cache->file.length) {
+    return false;
+  }
+
+  p_cache->entries = a_callocate(entries_count, sizeof(SchemaCacheEntry));
+  p_cache->entries_count = entries_count;
+
+  for (u32 i = 0; reader.ok && i < entries_count; ++i) {
+    SchemaCacheEntry *p_entry = p_cache->entries + i;
+
+    u32 path_length = reader_u32(&reader);
+    const char *path = (const char*)reader_bytes(&reader, path_length);
+    if (NULL == path || 0 == path_length || '\0' != path[path_length - 1]) {
+      return false;
+    }
+
+    p_entry->path = path;
+    p_entry->content_hash = reader_u64(&reader);
+    p_entry->blob.size = reader_u64(&reader);
+    u64 blob_hash = reader_u64(&reader);
+    p_entry->blob.data = reader_bytes(&reader, p_entry->blob.size);
+
+    // a damaged blob may still deserialize, just into a wrong schema
+    if (reader.ok && blob_hash != hash_bytes(p_entry->blob.data, p_entry->blob.size, 0)) {
+      return false;
+    }
+
+    if (reader.ok) {
+      table_set(&p_cache->entries_table, (char*)path, p_entry);
+    }
+  }
+
+  return reader.ok && reader.p_current == reader.p_end;
+}
+
+bool schema_cache_load(SchemaCache *p_cache, const char *path, u64 options_hash) {
+  assert(NULL != p_cache);
+  assert(NULL != path);
+
+  if (!source_file_open(path, &p_cache->file)) {
+    if (ENOENT != errno) {
+      logf_error("CACHE", "could not read %s: %s\n", path, strerror(errno));
+    }
+    return false;
+  }
+  p_cache->is_file_open = true;
+  p_cache->is_loaded = true;
+
+  if (!schema_cache_read_entries(p_cache, options_hash)) {
+    logf_trace("CACHE", "%s is outdated, ignoring it\n", path);
+    schema_cache_free(p_cache);
+    schema_cache_init(p_cache);
+    return false;
+  }
+
+  return true;
+}
+
+const SchemaBlob* schema_cache_find(const SchemaCache *p_cache, const char *path, u64 content_hash) {
+  assert(NULL != p_cache);
+  assert(NULL != path);
+
+  if (!p_cache->is_loaded) {
+    return NULL;
+  }
+
+  SchemaCacheEntry *p_entry = NULL;
+  if (!table_get((Table*)&p_cache->entries_table, (char*)path, (void**)&p_entry)
+    || content_hash != p_entry->content_hash) {
+    return NULL;
+  }
+
+  return &p_entry->blob;
+}
+
+bool schema_cache_retain(SchemaCache *p_cache, const SchemaCacheEntry *entries, size_t entries_count) {
+  assert(NULL != p_cache);
+  assert(NULL != entries || 0 == entries_count);
+
+  usize size = 0;
+  for (size_t i = 0; i < entries_count; ++i) {
+    size += strlen(entries[i].path) + 1 + entries[i].blob.size;
+  }
+
+  SchemaCache retained;
+  schema_cache_init(&retained);
+  retained.p_memory = (u8*)malloc(0 == size ? 1 : size);
+  if (NULL == retained.p_memory) {
+    schema_cache_free(&retained);
+    return false;
+  }
+
+  retained.entries = a_callocate(entries_count, sizeof(SchemaCacheEntry));
+  retained.entries_count = entries_count;
+  retained.is_loaded = true;
+
+  u8 *p_current = retained.p_memory;
+  for (size_t i = 0; i < entries_count; ++i) {
+    SchemaCacheEntry *p_entry = retained.entries + i;
+    *p_entry = entries[i];
+
+    usize path_length = strlen(entries[i].path) + 1;
+    memcpy(p_current, entries[i].path, path_length);
+    p_entry->path = (const char*)p_current;
+    p_current += path_length;
+
+    if (0 != entries[i].blob.size) memcpy(p_current, entries[i].blob.data, entries[i].blob.size);
+    p_entry->blob.data = p_current;
+    p_current += entries[i].blob.size;
+
+    table_set(&retained.entries_table, (char*)p_entry->path, p_entry);
+  }
+
+  schema_cache_free(p_cache);
+  *p_cache = retained;
+  return true;
+}
+
+void schema_cache_free(SchemaCache *p_cache) {
+  assert(NULL != p_cache);
+
+  table_free(&p_cache->entries_table);
+  if (NULL != p_cache->entries) a_free(p_cache->entries);
+  if (p_cache->is_file_open) source_file_close(&p_cache->file);
+  free(p_cache->p_memory);
+
+  *p_cache = (SchemaCache){0};
+}
+
+bool schema_cache_write(const char *path, u64 options_hash,
+                        const SchemaCacheEntry *entries, size_t entries_count) {
+  assert(NULL != path);
+  assert(NULL != entries || 0 == entries_count);
+
+  BlobWriter writer = { .ok = true };
+
+  writer_u32(&writer, SCHEMA_CACHE_MAGIC);
+  writer_u32(&writer, SCHEMA_CACHE_VERSION);
+  writer_u64(&writer, options_hash);
+  writer_u32(&writer, (u32)entries_count);
+
+  for (size_t i = 0; i < entries_count; ++i) {
+    usize path_length = strlen(entries[i].path) + 1;
+    writer_u32(&writer, (u32)path_length);
+    writer_bytes(&writer, entries[i].path, path_length);
+    writer_u64(&writer, entries[i].content_hash);
+    writer_u64(&writer, entries[i].blob.size);
+    writer_u64(&writer, hash_bytes(entries[i].blob.data, entries[i].blob.size, 0));
+    writer_bytes(&writer, entries[i].blob.data, entries[i].blob.size);
+  }
+
+  bool ok = writer.ok;
+  if (!ok) {
+    log_error("CACHE", "out of memory");
+  } else if (!(ok = file_write_if_changed(path, writer.data, writer.count, NULL))) {
+    logf_error("CACHE", "could not write %s: %s\n", path, strerror(errno));
+  }
+
+  free(writer.data);
+  return ok;
+}
+
+// ----------------- | SCHEMA FILE |
+
+bool schema_file_write(const char *path, const Schema *p_schema) {
+  assert(NULL != path);
+  assert(NULL != p_schema);
+
+  SchemaBlob blob;
+  if (!schema_serialize(p_schema, &blob)) {
+    log_error("CACHE", "out of memory");
+    return false;
+  }
+
+  BlobWriter writer = { .ok = true };
+  writer_u32(&writer, SCHEMA_FILE_MAGIC);
+  writer_u32(&writer, SCHEMA_CACHE_VERSION);
+  writer_bytes(&writer, blob.data, blob.size);
+  schema_blob_free(&blob);
+
+  bool ok = writer.ok;
+  if (!ok) {
+    log_error("CACHE", "out of memory");
+  } else if (!(ok = file_write_if_changed(path, writer.data, writer.count, NULL))) {
+    logf_error("CACHE", "could not write %s: %s\n", path, strerror(errno));
+  }
+
+  free(writer.data);
+  return ok;
+}
+
+bool schema_file_load(const char *path, SourceFile *p_file, Schema *p_out) {
+  assert(NULL != path);
+  assert(NULL != p_file);
+  assert(NULL != p_out);
+
+  if (!source_file_open(path, p_file)) {
+    logf_error("CACHE", "could not read %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  BlobReader reader = {
+    .p_current = (const u8*)p_file->data,
+    .p_end = (const u8*)p_file->data + p_file->length,
+    .ok = true
+  };
+
+  if (SCHEMA_FILE_MAGIC != reader_u32(&reader) || SCHEMA_CACHE_VERSION != reader_u32(&reader)) {
+    logf_error("CACHE", "%s is not a schema file of this version\n", path);
+    source_file_close(p_file);
+    return false;
+  }
+
+  SchemaBlob blob = { .data = reader.p_current, .size = (usize)(reader.p_end - reader.p_current) };
+  if (!schema_deserialize(&blob, p_out)) {
+    logf_error("CACHE", "%s is corrupted\n", path);
+    source_file_close(p_file);
+    return false;
+  }
+
+  return true;
+}
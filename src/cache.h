@@ -0,0 +1,116 @@
+#ifndef __SERC_CACHE_H__
+#define __SERC_CACHE_H__
+
+#include "common.h"
+#include "parser.h"
+#include "source.h"
+#include "./lib/ds/table.h"
+
+/// Bump when the format of the cache or the schema produced by the parser changes
+#define SCHEMA_CACHE_VERSION 9
+
+/// Name of the cache file inside the output directory
+#define SCHEMA_CACHE_FILE_NAME ".serc-cache"
+
+/// Schema of one source file in binary form
+typedef struct {
+  const u8 *data;
+  usize size;
+} SchemaBlob;
+
+/// Cached schema of the source file at path with content hashed to content_hash
+typedef struct {
+  const char *path;
+  u64 content_hash;
+  SchemaBlob blob;
+} SchemaCacheEntry;
+
+/// Schemas of source files saved by the previous run
+typedef struct {
+  /// blobs and StringViews of deserialized schemas point into the file,
+  /// so the cache stays loaded while they are in use
+  SourceFile file;
+  bool is_file_open;
+  bool is_loaded;
+
+  /// paths and blobs of entries retained in memory, malloc'ed
+  u8 *p_memory;
+
+  SchemaCacheEntry *entries;
+  size_t entries_count;
+
+  /// path (char*, points into file) -> SchemaCacheEntry*
+  Table entries_table;
+} SchemaCache;
+
+/// Initializes an empty cache
+void schema_cache_init(SchemaCache *p_cache);
+
+/// Loads the cache file at path. Missing, corrupted or outdated caches
+/// (written by other version or with other options) leave p_cache empty
+///
+/// @param p_cache: initialized cache
+/// @param path: path to the cache file
+/// @param options_hash: hash of the generator options of this run
+/// @return bool, true if the cache is loaded
+bool schema_cache_load(SchemaCache *p_cache, const char *path, u64 options_hash);
+
+/// Looks up the schema of the source file.
+/// Safe to call from several threads at once
+///
+/// @param p_cache: loaded cache
+/// @param path: path to the source file
+/// @param content_hash: hash_bytes of the current content of the source file
+/// @return const SchemaBlob*, NULL if the file is not cached or has changed since
+const SchemaBlob* schema_cache_find(const SchemaCache *p_cache, const char *path, u64 content_hash);
+
+/// Replaces the content of the cache with copies of entries, so it can be used
+/// after the files and blobs entries point into are gone (e.g. by the next run of watch mode).
+/// Entries may point into the cache itself
+///
+/// @param p_cache: initialized cache
+/// @param entries: entries to keep
+/// @param entries_count: number of entries
+/// @return bool, false if out of memory, the cache is left as it was
+bool schema_cache_retain(SchemaCache *p_cache, const SchemaCacheEntry *entries, size_t entries_count);
+
+/// Unloads the cache
+void schema_cache_free(SchemaCache *p_cache);
+
+/// Writes entries to the cache file at path, the file is replaced atomically
+/// and only if its content changes
+///
+/// @return bool, false on failure
+bool schema_cache_write(const char *path, u64 options_hash,
+                        const SchemaCacheEntry *entries, size_t entries_count);
+
+/// Serializes p_schema into malloc'ed blob, free it with schema_blob_free
+///
+/// @return bool, false if out of memory
+bool schema_serialize(const Schema *p_schema, SchemaBlob *p_out);
+
+/// Frees blob produced by schema_serialize
+void schema_blob_free(SchemaBlob *p_blob);
+
+/// Deserializes p_blob into initialized p_out, StringViews of the schema point into the blob.
+/// Allocates from the arena, so callers running in parallel hold the arena lock
+///
+/// @return bool, false if the blob is corrupted
+bool schema_deserialize(const SchemaBlob *p_blob, Schema *p_out);
+
+/// Writes p_schema to a standalone schema file, so other tools can use it without parsing C.
+/// The file is replaced atomically and only if its content changes
+///
+/// @return bool, false on failure
+bool schema_file_write(const char *path, const Schema *p_schema);
+
+/// Maps the schema file at path and deserializes it into initialized p_out.
+/// StringViews of the schema point into p_file, close it after freeing p_out
+///
+/// @param path: path to the schema file
+/// @param p_file: file the schema is loaded from, opened on success
+/// @param p_out: initialized schema
+/// @return bool, false if the file could not be read or is corrupted
+bool schema_file_load(const char *path, SourceFile *p_file, Schema *p_out);
+
+#endif // !__SERC_CACHE_H__
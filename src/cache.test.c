@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "layout.h"
+#include "./lib/ds/allocator.h"
+#include "./lib/ds/logger.h"
+
+LogSeverity g_log_severity = LOG_ALL;
+
+static int failures = 0;
+
+#define CHECK(cond)\
+  do {\
+    if (!(cond)) {\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+      ++failures;\
+    }\
+  } while (0)
+
+static const char source[] =
+  "typedef const int ID;\n"
+  "typedef struct Point {\n"
+  "  double x;\n"
+  "  double y;\n"
+  "} Point;\n"
+  "typedef struct Shape {\n"
+  "  // `@incremental`\n"
+  "  ID id; // `@view brief`\n"
+  "  unsigned long long int stamp;\n"
+  "  Point corners[2][3];\n"
+  "  Point *points; // `@array @size points_count @view brief @view full`\n"
+  "  int points_count; // `@omit`\n"
+  "  const unsigned char *payload; // `@bytes @size payload_size @hex`\n"
+  "  short payload_size;\n"
+  "  char digest[20]; // `@bytes`\n"
+  "  void *p_user; // `@callback @s user_to_json @d user_from_json`\n"
+  "  const char * const **names;\n"
+  "} Shape;\n";
+
+/// Compares StringViews, empty ones point to nothing
+static bool sv_equals(StringView lhs, StringView rhs) {
+  return lhs.length == rhs.length && (0 == lhs.length || 0 == memcmp(lhs.p_begin, rhs.p_begin, lhs.length));
+}
+
+static bool type_info_equals(const TypeInfo *lhs, const TypeInfo *rhs) {
+  const AnnotationInfo *l = &lhs->ann_info;
+  const AnnotationInfo *r = &rhs->ann_info;
+
+  bool ok = lhs->base_type == rhs->base_type
+    && lhs->longness == rhs->longness
+    && lhs->is_const == rhs->is_const
+    && lhs->is_unsigned == rhs->is_unsigned
+    && sv_equals(lhs->struct_name, rhs->struct_name)
+    && lhs->pointer_info.indirections_count == rhs->pointer_info.indirections_count
+    && 0 == memcmp(lhs->pointer_info.is_const, rhs->pointer_info.is_const, sizeof(lhs->pointer_info.is_const))
+    && lhs->array_info.dims_count == rhs->array_info.dims_count
+    && 0 == memcmp(lhs->array_info.dims, rhs->array_info.dims, lhs->array_info.dims_count * sizeof(u32))
+    && l->kind == r->kind
+    && l->views_count == r->views_count;
+
+  for (unsigned int i = 0; ok && i < l->views_count; ++i) {
+    ok = sv_equals(l->views[i], r->views[i]);
+  }
+
+  switch (ok ? l->kind : ANN_EMPTY) {
+    case ANN_ARRAY:
+      return sv_equals(l->as.annotation_array.array_size_field_name, r->as.annotation_array.array_size_field_name);
+    case ANN_CUSTOM_CALLBACK:
+      return sv_equals(l->as.annotation_custom_callback.cb_ser_name, r->as.annotation_custom_callback.cb_ser_name)
+        && sv_equals(l->as.annotation_custom_callback.cb_deser_name, r->as.annotation_custom_callback.cb_deser_name);
+    case ANN_BYTES:
+      return l->as.annotation_bytes.encoding == r->as.annotation_bytes.encoding
+        && sv_equals(l->as.annotation_bytes.size_field_name, r->as.annotation_bytes.size_field_name);
+    default:
+      return ok;
+  }
+}
+
+static void check_schemas_equal(const Schema *p_expected, const Schema *p_loaded) {
+  CHECK(vec_count(p_expected->structs) == vec_count(p_loaded->structs));
+  for (size_t i = 0; i < vec_count(p_expected->structs) && i < vec_count(p_loaded->structs); ++i) {
+    const StructInfo *p_e = p_expected->structs + i;
+    const StructInfo *p_l = p_loaded->structs + i;
+    CHECK(sv_equals(p_e->name, p_l->name));
+    CHECK(p_e->is_incremental == p_l->is_incremental);
+    CHECK(vec_count(p_e->fields) == vec_count(p_l->fields));
+    for (size_t j = 0; j < vec_count(p_e->fields) && j < vec_count(p_l->fields); ++j) {
+      CHECK(sv_equals(p_e->fields[j].name, p_l->fields[j].name));
+      CHECK(type_info_equals(&p_e->fields[j].type_info, &p_l->fields[j].type_info));
+    }
+  }
+
+  CHECK(vec_count(p_expected->typedefs) == vec_count(p_loaded->typedefs));
+  for (size_t i = 0; i < vec_count(p_expected->typedefs) && i < vec_count(p_loaded->typedefs); ++i) {
+    CHECK(sv_equals(p_expected->typedefs[i].name, p_loaded->typedefs[i].name));
+    CHECK(type_info_equals(p_expected->typedefs[i].p_type_info, p_loaded->typedefs[i].p_type_info));
+  }
+}
+
+static void test_schema_file_round_trip(void) {
+  Schema parsed;
+  schema_init(&parsed);
+  CHECK(parse_schema(source, sizeof(source) - 1, false, &parsed));
+
+  Schema schema;
+  schema_init(&schema);
+  CHECK(schema_merge(&schema, &parsed));
+  CHECK(schema_compute_layout(&schema));
+
+  // the parser itself is checked here, so a broken parse does not pass as a round trip
+  CHECK(2 == vec_count(schema.structs) && 3 == vec_count(schema.typedefs));
+  if (2 == vec_count(schema.structs)) {
+    const VarInfo *fields = schema.structs[1].fields;
+    CHECK(schema.structs[1].is_incremental);
+    CHECK(2 == fields[2].type_info.array_info.dims_count && 3 == fields[2].type_info.array_info.dims[1]);
+    CHECK(ANN_ARRAY == fields[3].type_info.ann_info.kind && 2 == fields[3].type_info.ann_info.views_count);
+    CHECK(ANN_BYTES == fields[5].type_info.ann_info.kind);
+    CHECK(BYTES_HEX == fields[5].type_info.ann_info.as.annotation_bytes.encoding);
+    CHECK(ANN_CUSTOM_CALLBACK == fields[8].type_info.ann_info.kind);
+    CHECK(3 == fields[9].type_info.pointer_info.indirections_count);
+  }
+
+  char path[] = "/tmp/serc-schema-XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(-1 != fd);
+  close(fd);
+
+  CHECK(schema_file_write(path, &schema));
+
+  SourceFile file;
+  Schema loaded;
+  schema_init(&loaded);
+  bool is_loaded = schema_file_load(path, &file, &loaded);
+  CHECK(is_loaded);
+  if (is_loaded) {
+    check_schemas_equal(&schema, &loaded);
+  }
+  schema_free(&loaded);
+  if (is_loaded) {
+    source_file_close(&file);
+  }
+
+  // other files are rejected
+  CHECK(file_write_if_changed(path, source, sizeof(source) - 1, NULL));
+  schema_init(&loaded);
+  CHECK(!schema_file_load(path, &file, &loaded));
+  schema_free(&loaded);
+
+  unlink(path);
+  schema_free(&schema);
+}
+
+int main() {
+  allocator_init(16 * 1024 * 1024);
+
+  test_schema_file_round_trip();
+
+  allocator_finalize();
+  return 0 == failures ? 0 : 1;
+}
@@ -1,37 +1,164 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "code_gen.h"
+#include "hash.h"
+#include "source.h"
+#include "symbol.h"
 #include "./lib/ds/logger.h"
 #include "./lib/ds/string_builder.h"
 
-bool initialize_out_files_json(FILE *out_h, FILE *out_c, const char *path) {
+/// Generated code of one output file or a part of it
+typedef struct {
+  char *data;
+  usize count;
+  usize capacity;
+
+  /// false once out of memory
+  bool ok;
+} CodeBuffer;
+
+/// Output of one struct, structs are generated in parallel and concatenated,
+/// declarations in schema order and definitions in dependency order
+typedef struct {
+  CodeBuffer h;
+  CodeBuffer c;
+  bool ok;
+} StructOutput;
+
+typedef struct {
+  const StructInfo *structs;
+  usize structs_count;
+
+  /// struct name -> Symbol.struct_index
+  SymbolTable names;
+  Arena arena;
+
+  /// indices of structs in the order their definitions are emitted,
+  /// every struct comes after the structs it contains and calls serializers of
+  /// (unless they refer to each other through pointers)
+  usize *order;
+  usize order_count;
+
+  /// position of every struct in order
+  usize *positions;
+
+  /// state of every struct in the depth-first walk
+  u8 *states;
+} StructOrder;
+
+typedef struct {
+  const StructInfo *structs;
+  const StructOrder *p_order;
+  const CodeGenOptions *p_options;
+  StructOutput *outputs;
+} CodeGenContext;
+
+// ----------------- | CODE BUFFER |
+
+static void code_write(CodeBuffer *p_buf, const char *data, usize size) {
+  if (!p_buf->ok) return;
+
+  if (p_buf->count + size > p_buf->capacity) {
+    usize capacity = 0 == p_buf->capacity ? 1024 : p_buf->capacity;
+    while (capacity < p_buf->count + size) capacity *= 2;
+
+    char *tmp = (char*)realloc(p_buf->data, capacity);
+    if (NULL == tmp) {
+      p_buf->ok = false;
+      return;
+    }
+    p_buf->data = tmp;
+    p_buf->capacity = capacity;
+  }
+
+  if (0 != size) memcpy(p_buf->data + p_buf->count, data, size);
+  p_buf->count += size;
+}
+
+/// Appends string literal without measuring it at runtime
+#define code_lit(p_buf, lit) code_write((p_buf), "" lit, sizeof(lit) - 1)
+
+static void code_cstr(CodeBuffer *p_buf, const char *cstr) {
+  code_write(p_buf, cstr, strlen(cstr));
+}
+
+static void code_sv(CodeBuffer *p_buf, StringView sv) {
+  code_write(p_buf, sv.p_begin, sv.length);
+}
+
+static void code_usize(CodeBuffer *p_buf, usize value) {
+  char digits[24];
+  usize count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+    value /= 10;
+  } while (0 != value);
+
+  code_write(p_buf, digits + sizeof(digits) - count, count);
+}
+
+static void code_buffer_free(CodeBuffer *p_buf) {
+  free(p_buf->data);
+  *p_buf = (CodeBuffer){0};
+}
+
+/// Appends code of p_src indented one level deeper, without trailing empty lines
+static void code_indented(CodeBuffer *p_buf, const CodeBuffer *p_src) {
+  if (!p_src->ok) {
+    p_buf->ok = false;
+    return;
+  }
+
+  usize count = p_src->count;
+  while (count > 0 && '\n' == p_src->data[count - 1]) --count;
+
+  for (usize i = 0; i < count;) {
+    const char *p_line_end = (const char*)memchr(p_src->data + i, '\n', count - i);
+    usize line_length = NULL == p_line_end ? count - i : (usize)(p_line_end - (p_src->data + i));
+    if (line_length > 0) {
+      code_lit(p_buf, "\t");
+      code_write(p_buf, p_src->data + i, line_length);
+    }
+    code_lit(p_buf, "\n");
+    i += line_length + 1;
+  }
+}
+
+// ----------------- | JSON |
+
+static void initialize_out_files_json(CodeBuffer *out_h, CodeBuffer *out_c) {
   assert(NULL != out_h);
   assert(NULL != out_c);
 
-  fputs("#ifndef __SERC_JSON_H__\n", out_h);
-  fputs("#define __SERC_JSON_H__\n", out_h);
-  fputs("#include <stdbool.h>\n", out_h);
-  fputs("#include <assert.h>\n", out_c);
+  code_lit(out_h, "#ifndef __SERC_JSON_H__\n");
+  code_lit(out_h, "#define __SERC_JSON_H__\n");
+  code_lit(out_h, "#include <stdbool.h>\n");
+  code_lit(out_c, "#include <assert.h>\n");
+  code_lit(out_c, "#include <stddef.h>\n");
 
-  if (NULL == path) path = ".";
+  // siblings in the output directory, quoted includes are looked up next to the including file first
+  code_lit(out_h, "#include \"primitives.h\"\n\n");
+  code_lit(out_c, "#include \"" JSON_HEADER_FILE_NAME "\"\n\n");
 
-  fprintf(out_h, "#include \"%s/primitives.h\"\n\n", path);
-  fprintf(out_c, "#include \"%s/json.h\"\n\n", path);
+  code_lit(out_c, "#define SER_VALIDATE(call) do { if (!(call)) { return false; } } while (0)\n\n");
 
-  fputs("#define SER_VALIDATE(call) do { if (!(call)) { return false; } } while (0)\n\n", out_c);
-
-  return true;
+  // layout is computed for LP64 SysV, other targets skip the checks
+  code_lit(out_c, "#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__LP64__) && !defined(__APPLE__)\n");
+  code_lit(out_c, "#define SER_LAYOUT_ASSERT(cond) _Static_assert(cond, #cond)\n");
+  code_lit(out_c, "#else\n");
+  code_lit(out_c, "#define SER_LAYOUT_ASSERT(cond) _Static_assert(1, \"\")\n");
+  code_lit(out_c, "#endif\n\n");
 }
 
-bool finalize_out_files_json(FILE *out_h, FILE *out_c) {
+static void finalize_out_files_json(CodeBuffer *out_h, CodeBuffer *out_c) {
   assert(NULL != out_h);
   assert(NULL != out_c);
 
-  fputs("#endif // !__SERC_JSON_H__\n", out_h);
-  return true;
+  code_lit(out_h, "#endif // !__SERC_JSON_H__\n");
 }
 
 static bool is_primitive_base_type(BaseType type) {
@@ -39,152 +166,390 @@ static bool is_primitive_base_type(BaseType type) {
     || TYPE_FLOAT == type || TYPE_DOUBLE == type; //|| TYPE_VOID == type;
 }
 
+static void code_base_type(CodeBuffer *out, BaseType type) {
+  switch (type) {
+    case TYPE_CHAR: code_lit(out, "char"); break;
+    case TYPE_SHORT: code_lit(out, "short"); break;
+    case TYPE_INT: code_lit(out, "int"); break;
+    case TYPE_FLOAT: code_lit(out, "float"); break;
+    case TYPE_DOUBLE: code_lit(out, "double"); break;
+    case TYPE_VOID: code_lit(out, "void"); break;
+    default: assert(false && "Not reachable"); break;
+  }
+}
 
-static StringBuilder type_info_get_ser_func_primitive_type(const TypeInfo *p_ti) {
+/// Emits name of the primitive type as used in names of serializer functions (e.g. u_long_int)
+static void code_ser_func_primitive_type(CodeBuffer *out, const TypeInfo *p_ti) {
   assert(NULL != p_ti);
   assert(TYPE_UNINITIALIZED != p_ti->base_type);
-
-  StringBuilder sb; string_builder_init(sb);
+  assert(TYPE_VOID != p_ti->base_type);
 
   if (p_ti->is_unsigned) {
-    string_builder_append_cstr(&sb, "u_");
+    code_lit(out, "u_");
   }
 
   for (unsigned int i = 0; i < p_ti->longness; ++i) {
-    string_builder_append_cstr(&sb, "long_");
+    code_lit(out, "long_");
   }
 
-  switch (p_ti->base_type) {
-    case TYPE_CHAR: string_builder_append_cstr(&sb, "char"); break;
-    case TYPE_SHORT: string_builder_append_cstr(&sb, "short"); break;
-    case TYPE_INT: string_builder_append_cstr(&sb, "int"); break;
-    case TYPE_FLOAT: string_builder_append_cstr(&sb, "float"); break;
-    case TYPE_DOUBLE: string_builder_append_cstr(&sb, "double"); break;
-    default: 
-      assert(false && "Not reachable"); 
-      break;
-  }
-
-  return sb;
+  code_base_type(out, p_ti->base_type);
 }
 
-static StringBuilder type_info_get_type_str(const TypeInfo *p_ti) {
+/// Emits the type of a member declaration
+static void code_type_str(CodeBuffer *out, const TypeInfo *p_ti) {
   assert(NULL != p_ti);
   assert(TYPE_UNINITIALIZED != p_ti->base_type);
 
-  StringBuilder sb; string_builder_init(sb);
-
   if (p_ti->is_const) {
-    string_builder_append_cstr(&sb, "const ");
+    code_lit(out, "const ");
   }
 
   if (TYPE_STRUCT == p_ti->base_type) {
-    string_builder_append_string_view(&sb, &p_ti->struct_name);
+    // by tag, so pointers to structs that are not generated need no declaration
+    code_lit(out, "struct ");
+    code_sv(out, p_ti->struct_name);
   } else {
     if (p_ti->is_unsigned) {
-      string_builder_append_cstr(&sb, "unsigned ");
+      code_lit(out, "unsigned ");
     }
 
     for (unsigned int i = 0; i < p_ti->longness; ++i) {
-      string_builder_append_cstr(&sb, "long ");
+      code_lit(out, "long ");
     }
 
-    switch (p_ti->base_type) {
-      case TYPE_CHAR: string_builder_append_cstr(&sb, "char"); break;
-      case TYPE_SHORT: string_builder_append_cstr(&sb, "short"); break;
-      case TYPE_INT: string_builder_append_cstr(&sb, "int"); break;
-      case TYPE_FLOAT: string_builder_append_cstr(&sb, "float"); break;
-      case TYPE_DOUBLE: string_builder_append_cstr(&sb, "double"); break;
-      case TYPE_VOID: string_builder_append_cstr(&sb, "void"); break;
-      default: assert(false && "Not reachable"); break;
-    }
+    code_base_type(out, p_ti->base_type);
   }
 
-  string_builder_append_rune(&sb, ' ');
+  code_lit(out, " ");
 
   for (unsigned int i = 0; i < p_ti->pointer_info.indirections_count; ++i) {
-    string_builder_append_cstr(&sb, " *");
+    code_lit(out, " *");
     if (p_ti->pointer_info.is_const[i]) {
-      string_builder_append_cstr(&sb, " const ");
+      code_lit(out, " const ");
     }
   }
+}
 
-  return sb;
+/// Emits name of the function serializing one element of the field type:
+/// serializer_<primitive>_to_json or static serializer_<struct>_to_json_inline
+static void code_ser_func_name(CodeBuffer *out, const VarInfo *field) {
+  code_lit(out, "serializer_");
+  if (is_primitive_base_type(field->type_info.base_type)) {
+    code_ser_func_primitive_type(out, &field->type_info);
+    code_lit(out, "_to_json");
+  } else {
+    code_sv(out, field->type_info.struct_name);
+    code_lit(out, "_to_json_inline");
+  }
 }
 
-static bool generate_json_for_field(const VarInfo *field, FILE *out_c) {
-  assert(NULL != field);
-  assert(NULL != out_c);
+static void code_indent(CodeBuffer *out, usize depth) {
+  for (usize i = 0; i < depth; ++i) {
+    code_lit(out, "\t");
+  }
+}
 
-  if (ANN_OMIT == field->type_info.ann_info.kind) {
-    return true;
+/// Returns prefix that turns an expression of the type with number_of_ptrs indirections
+/// into the argument of its serializer: primitives are passed by value, structs by pointer
+static const char* field_prefix_cstr(bool is_primitive, unsigned int number_of_ptrs) {
+  static const char stars[] = "****";
+  assert(number_of_ptrs <= MAX_INDERECTION_LEVEL);
+
+  if (is_primitive) {
+    return stars + MAX_INDERECTION_LEVEL - number_of_ptrs;
+  }
+  return 0 == number_of_ptrs ? "&" : stars + MAX_INDERECTION_LEVEL - number_of_ptrs + 1;
+}
+
+/// Checks if elements of the type with number_of_ptrs indirections
+/// are serialized by a serializer_<type>_array_to_json kernel
+static bool has_array_kernel(const TypeInfo *p_ti, unsigned int number_of_ptrs) {
+  return 0 == number_of_ptrs && is_primitive_base_type(p_ti->base_type)
+    && !(TYPE_CHAR == p_ti->base_type && p_ti->is_unsigned);
+}
+
+/// Emits the beginning of the array kernel call, the caller adds the elements and their count
+static void code_array_kernel_call(CodeBuffer *out_c, const VarInfo *field) {
+  code_lit(out_c, "SER_VALIDATE(serializer_");
+  code_ser_func_primitive_type(out_c, &field->type_info);
+  code_lit(out_c, "_array_to_json(p_ser, ");
+}
+
+/// Emits the value of the field, tmp->x, its element tmp->x[i0][i1] inside loops_count loops
+/// of the fixed-size array, and tmp->x[i] of @array if is_element
+static void code_field_value(CodeBuffer *out, const VarInfo *field, unsigned int loops_count, bool is_element) {
+  code_lit(out, "tmp->");
+  code_sv(out, field->name);
+  for (unsigned int d = 0; d < loops_count; ++d) {
+    code_lit(out, "[i");
+    code_usize(out, d);
+    code_lit(out, "]");
+  }
+  if (is_element) {
+    code_lit(out, "[i]");
   }
+}
 
+/// Graph mode: object graphs end in NULL pointers, so a value with a NULL pointer among
+/// its number_of_ptrs indirections is written as null. Emits the check and the null branch,
+/// the caller emits the serialization one level deeper and closes it with code_null_check_end
+static void code_null_check_begin(CodeBuffer *out, usize depth, const VarInfo *field, unsigned int loops_count,
+                                  bool is_element, unsigned int number_of_ptrs) {
+  static const char stars[] = "****";
+  assert(number_of_ptrs <= MAX_INDERECTION_LEVEL);
+
+  code_indent(out, depth);
+  code_lit(out, "if (");
+  for (unsigned int i = 0; i < number_of_ptrs; ++i) {
+    code_cstr(out, 0 == i ? "NULL == " : " || NULL == ");
+    code_cstr(out, stars + MAX_INDERECTION_LEVEL - i);
+    code_field_value(out, field, loops_count, is_element);
+  }
+  code_lit(out, ") {\n");
+  code_indent(out, depth + 1);
+  code_lit(out, "SER_VALIDATE(serializer_null_to_json(p_ser));\n");
+  code_indent(out, depth);
+  code_lit(out, "} else {\n");
+}
+
+static void code_null_check_end(CodeBuffer *out, usize depth) {
+  code_indent(out, depth);
+  code_lit(out, "}\n");
+}
+
+/// Emits one nested JSON array per dimension of the fixed-size array field,
+/// elements are serialized in place (tmp->x[i0][i1]), rows of primitives by an array kernel.
+/// Rows of chars (char name[N]) are strings up to the first '\0'
+static void generate_json_for_fixed_array(const VarInfo *field, const char *field_prefix_str, bool is_graph,
+                                          CodeBuffer *out_c) {
+  const ArrayInfo *p_array = &field->type_info.array_info;
+  unsigned int number_of_ptrs = field->type_info.pointer_info.indirections_count;
+  bool is_string = TYPE_CHAR == field->type_info.base_type && 0 == number_of_ptrs;
+  bool is_kernel = has_array_kernel(&field->type_info, number_of_ptrs);
+  unsigned int loops_count = is_kernel || is_string ? p_array->dims_count - 1 : p_array->dims_count;
+  bool is_null_checked = is_graph && number_of_ptrs > 0;
+
+  for (unsigned int d = 0; d < loops_count; ++d) {
+    code_indent(out_c, d + 1);
+    code_lit(out_c, "SER_VALIDATE(serializer_json_start_array(p_ser));\n");
+    code_indent(out_c, d + 1);
+    code_lit(out_c, "for (size_t i");
+    code_usize(out_c, d);
+    code_lit(out_c, " = 0; i");
+    code_usize(out_c, d);
+    code_lit(out_c, " < ");
+    code_usize(out_c, p_array->dims[d]);
+    code_lit(out_c, "; ++i");
+    code_usize(out_c, d);
+    code_lit(out_c, ") {\n");
+  }
+
+  if (is_null_checked) {
+    code_null_check_begin(out_c, loops_count + 1, field, loops_count, false, number_of_ptrs);
+  }
+
+  code_indent(out_c, loops_count + 1 + is_null_checked);
+  if (is_string) {
+    code_lit(out_c, "SER_VALIDATE(serializer_fixed_cstr_to_json(p_ser, ");
+    if (field->type_info.is_unsigned) {
+      code_lit(out_c, "(const char*)");
+    }
+  } else if (is_kernel) {
+    code_array_kernel_call(out_c, field);
+  } else {
+    code_lit(out_c, "SER_VALIDATE(");
+    code_ser_func_name(out_c, field);
+    code_lit(out_c, "(p_ser, ");
+    code_cstr(out_c, field_prefix_str);
+  }
+  code_field_value(out_c, field, loops_count, false);
+  if (is_kernel || is_string) {
+    code_lit(out_c, ", ");
+    code_usize(out_c, p_array->dims[loops_count]);
+  }
+  code_lit(out_c, "));\n");
+
+  if (is_null_checked) {
+    code_null_check_end(out_c, loops_count + 1);
+  }
+
+  for (unsigned int d = loops_count; d > 0; --d) {
+    code_indent(out_c, d + 1);
+    code_lit(out_c, "SER_VALIDATE(serializer_json_append_separator(p_ser));\n");
+    code_indent(out_c, d);
+    code_lit(out_c, "}\n");
+    code_indent(out_c, d);
+    code_lit(out_c, "SER_VALIDATE(serializer_json_end_array(p_ser));\n");
+  }
+}
+
+/// Checks that the field (not omitted) can be serialized, reports why it cannot
+static bool field_is_serializable(const VarInfo *field) {
   if (field->type_info.base_type == TYPE_VOID && field->type_info.ann_info.kind != ANN_CUSTOM_CALLBACK) {
-    logf_error("CODE_GEN", "Field %.*s has base type void and no custom callback was provided.\n", field->name);
+    logf_error("CODE_GEN", "Field " string_view_farg " has base type void and no custom callback was provided.\n",
+               string_view_expand(field->name));
     log_error("CODE_GEN", "NOTE: to provide custom callback write annotation after the field `@callback @s <ser func name> @d <deser func name`");
     return false;
   }
 
-  bool is_primitive = is_primitive_base_type(field->type_info.base_type);
-  const char *field_prefix_str = "";
-  unsigned int number_of_ptrs = field->type_info.pointer_info.indirections_count;
+  if (field->type_info.array_info.dims_count > 0 && ANN_ARRAY == field->type_info.ann_info.kind) {
+    logf_error("CODE_GEN", "Field " string_view_farg " is a fixed-size array and cannot be annotated with @array.\n",
+               string_view_expand(field->name));
+    return false;
+  }
+  if (ANN_ARRAY == field->type_info.ann_info.kind && 0 == field->type_info.pointer_info.indirections_count) {
+    logf_error("CODE_GEN", "Field " string_view_farg " is annotated with @array but is not a pointer.\n",
+               string_view_expand(field->name));
+    return false;
+  }
 
-  if (is_primitive) {
-    switch (number_of_ptrs) {
-      case 1: field_prefix_str = "*"; break;
-      case 2: field_prefix_str = "**"; break;
-      case 3: field_prefix_str = "***"; break;
-      case 4: field_prefix_str = "****"; break;
-      default: break;
+  if (ANN_BYTES == field->type_info.ann_info.kind) {
+    const TypeInfo *p_ti = &field->type_info;
+    bool is_pointer = 1 == p_ti->pointer_info.indirections_count && 0 == p_ti->array_info.dims_count;
+    bool is_fixed_array = 0 == p_ti->pointer_info.indirections_count && 1 == p_ti->array_info.dims_count;
+    bool has_size = 0 != p_ti->ann_info.as.annotation_bytes.size_field_name.length;
+
+    if (TYPE_CHAR != p_ti->base_type || !(is_pointer || is_fixed_array)) {
+      logf_error("CODE_GEN", "Field " string_view_farg " is annotated with @bytes but is neither a pointer to char"
+                 " nor a one-dimensional array of char.\n", string_view_expand(field->name));
+      return false;
     }
-  } else {
-    if (number_of_ptrs > 0) {
-      switch (number_of_ptrs) {
-        case 2: field_prefix_str = "*"; break;
-        case 3: field_prefix_str = "**"; break;
-        case 4: field_prefix_str = "***"; break;
-        default: break;
-      }
-    } else {
-      field_prefix_str = "&";
+    if (is_pointer && !has_size) {
+      logf_error("CODE_GEN", "Field " string_view_farg " is annotated with @bytes but has no @size.\n",
+                 string_view_expand(field->name));
+      return false;
+    }
+    if (is_fixed_array && has_size) {
+      logf_error("CODE_GEN", "Field " string_view_farg " is a fixed-size array and cannot be annotated with @size.\n",
+                 string_view_expand(field->name));
+      return false;
     }
   }
 
-  StringBuilder type;
-  if (is_primitive) {
-    type = type_info_get_ser_func_primitive_type(&field->type_info);
-  } else {
-    string_builder_init(type);
-    string_builder_append_string_view(&type, &field->type_info.struct_name);
+  return true;
+}
+
+/// Emits the name of the runtime function writing @bytes field as one string
+static void code_bytes_func_name(CodeBuffer *out, const TypeInfo *p_ti) {
+  switch (p_ti->ann_info.as.annotation_bytes.encoding) {
+    case BYTES_BASE64: code_lit(out, "serializer_bytes_base64_to_json"); break;
+    case BYTES_HEX: code_lit(out, "serializer_bytes_hex_to_json"); break;
+    default: assert(false && "not reachable"); break;
+  }
+}
+
+static bool generate_json_for_field(const VarInfo *field, bool is_graph, CodeBuffer *out_c) {
+  assert(NULL != field);
+  assert(NULL != out_c);
+
+  if (ANN_OMIT == field->type_info.ann_info.kind) {
+    return true;
   }
 
-  fprintf(out_c, "\tSER_VALIDATE(serializer_json_start_field(p_ser, \"%.*s\"));\n", 
-          string_view_expand(field->name));
+  if (!field_is_serializable(field)) {
+    return false;
+  }
+
+  bool is_primitive = is_primitive_base_type(field->type_info.base_type);
+  unsigned int number_of_ptrs = field->type_info.pointer_info.indirections_count;
+  const char *field_prefix_str = field_prefix_cstr(is_primitive, number_of_ptrs);
+
+  bool is_fixed_array = field->type_info.array_info.dims_count > 0;
+  if (is_fixed_array && ANN_CUSTOM_CALLBACK == field->type_info.ann_info.kind) {
+    field_prefix_str = ""; // the callback gets pointer to the first element
+  }
+
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_field(p_ser, \"");
+  code_sv(out_c, field->name);
+  code_lit(out_c, "\"));\n");
 
   switch (field->type_info.ann_info.kind) {
     case ANN_ARRAY: {
-      fprintf(out_c, "\tSER_VALIDATE(serializer_json_start_array(p_ser));\n");
-      fprintf(out_c, "\tfor (size_t i = 0; i < tmp->%.*s; ++i) {\n", 
-              string_view_expand(field->type_info.ann_info.as.annotation_array.array_size_field_name));
+      // elements of T *x are x[i]
+      StringView size_field_name = field->type_info.ann_info.as.annotation_array.array_size_field_name;
+      if (has_array_kernel(&field->type_info, number_of_ptrs - 1)) {
+        code_lit(out_c, "\t");
+        code_array_kernel_call(out_c, field);
+        code_lit(out_c, "tmp->");
+        code_sv(out_c, field->name);
+        code_lit(out_c, ", tmp->");
+        code_sv(out_c, size_field_name);
+        code_lit(out_c, "));\n");
+        break;
+      }
 
-      fprintf(out_c, "\t\tSER_VALIDATE(serializer_%s_to_json(p_ser, %stmp->%.*s + i));\n", 
-              string_builder_get_cstr(&type), field_prefix_str, string_view_expand(field->name));
+      code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_array(p_ser));\n");
+      // the size is read as size_t, like serializer_table_to_json does
+      code_lit(out_c, "\tfor (size_t i = 0; i < (size_t)tmp->");
+      code_sv(out_c, size_field_name);
+      code_lit(out_c, "; ++i) {\n");
 
-      fprintf(out_c, "\t}\n");
-      fprintf(out_c, "\tSER_VALIDATE(serializer_json_end_array(p_ser));\n");
+      bool is_null_checked = is_graph && number_of_ptrs > 1;
+      if (is_null_checked) {
+        code_null_check_begin(out_c, 2, field, 0, true, number_of_ptrs - 1);
+      }
+      code_indent(out_c, 2 + is_null_checked);
+      code_lit(out_c, "SER_VALIDATE(");
+      code_ser_func_name(out_c, field);
+      code_lit(out_c, "(p_ser, ");
+      code_cstr(out_c, field_prefix_cstr(is_primitive, number_of_ptrs - 1));
+      code_field_value(out_c, field, 0, true);
+      code_lit(out_c, "));\n");
+      if (is_null_checked) {
+        code_null_check_end(out_c, 2);
+      }
+      code_lit(out_c, "\t\tSER_VALIDATE(serializer_json_append_separator(p_ser));\n");
+
+      code_lit(out_c, "\t}\n");
+      code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_array(p_ser));\n");
+      break;
+    }
+    case ANN_BYTES: {
+      // pointers get the size from the @size field, fixed-size arrays from the declaration
+      code_lit(out_c, "\tSER_VALIDATE(");
+      code_bytes_func_name(out_c, &field->type_info);
+      code_lit(out_c, "(p_ser, tmp->");
+      code_sv(out_c, field->name);
+      if (is_fixed_array) {
+        code_lit(out_c, ", ");
+        code_usize(out_c, field->type_info.array_info.dims[0]);
+      } else {
+        code_lit(out_c, ", tmp->");
+        code_sv(out_c, field->type_info.ann_info.as.annotation_bytes.size_field_name);
+      }
+      code_lit(out_c, "));\n");
       break;
     }
     case ANN_CUSTOM_CALLBACK: {
-      StringView cb_ser_name = field->type_info.ann_info.as.annotation_custom_callback.cb_ser_name;
-      fprintf(out_c, "\tSER_VALIDATE(%.*s(p_ser, %stmp->%.*s));\n", 
-              string_view_expand(cb_ser_name), field_prefix_str, string_view_expand(field->name));
-
+      code_lit(out_c, "\tSER_VALIDATE(");
+      code_sv(out_c, field->type_info.ann_info.as.annotation_custom_callback.cb_ser_name);
+      code_lit(out_c, "(p_ser, ");
+      code_cstr(out_c, field_prefix_str);
+      code_lit(out_c, "tmp->");
+      code_sv(out_c, field->name);
+      code_lit(out_c, "));\n");
       break;
     }
     case ANN_EMPTY: {
-      fprintf(out_c, "\tSER_VALIDATE(serializer_%s_to_json(p_ser, %stmp->%.*s));\n", 
-              string_builder_get_cstr(&type), field_prefix_str, string_view_expand(field->name));
+      if (field->type_info.array_info.dims_count > 0) {
+        generate_json_for_fixed_array(field, field_prefix_str, is_graph, out_c);
+        break;
+      }
+
+      bool is_null_checked = is_graph && number_of_ptrs > 0;
+      if (is_null_checked) {
+        code_null_check_begin(out_c, 1, field, 0, false, number_of_ptrs);
+      }
+      code_indent(out_c, 1 + is_null_checked);
+      code_lit(out_c, "SER_VALIDATE(");
+      code_ser_func_name(out_c, field);
+      code_lit(out_c, "(p_ser, ");
+      code_cstr(out_c, field_prefix_str);
+      code_field_value(out_c, field, 0, false);
+      code_lit(out_c, "));\n");
+      if (is_null_checked) {
+        code_null_check_end(out_c, 1);
+      }
       break;
     }
 
@@ -192,122 +557,976 @@ static bool generate_json_for_field(const VarInfo *field, FILE *out_c) {
       assert(false && "not reachable");
   }
 
-  fprintf(out_c, "\tSER_VALIDATE(serializer_json_end_field(p_ser));\n\n");
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_field(p_ser));\n\n");
+
+  return true;
+}
+
+/// Emits SerializerFieldKind of values of the type, unsigned char is serialized as char
+static void code_field_kind(CodeBuffer *out, const TypeInfo *p_ti) {
+  if (TYPE_STRUCT == p_ti->base_type) {
+    code_lit(out, "SER_FIELD_STRUCT");
+    return;
+  }
+
+  code_lit(out, "SER_FIELD_");
+  if (p_ti->is_unsigned && TYPE_CHAR != p_ti->base_type) {
+    code_lit(out, "U_");
+  }
+  for (unsigned int i = 0; i < p_ti->longness; ++i) {
+    code_lit(out, "LONG_");
+  }
+  switch (p_ti->base_type) {
+    case TYPE_CHAR: code_lit(out, "CHAR"); break;
+    case TYPE_SHORT: code_lit(out, "SHORT"); break;
+    case TYPE_INT: code_lit(out, "INT"); break;
+    case TYPE_FLOAT: code_lit(out, "FLOAT"); break;
+    case TYPE_DOUBLE: code_lit(out, "DOUBLE"); break;
+    default: assert(false && "Not reachable"); break;
+  }
+}
+
+/// Finds the field holding the number of elements of @array field (of bytes of @bytes field)
+///
+/// @return const VarInfo*, NULL if the struct has no such integer field
+static const VarInfo* struct_find_size_field(const StructInfo *p_si, const VarInfo *field) {
+  bool is_bytes = ANN_BYTES == field->type_info.ann_info.kind;
+  StringView size_field_name = is_bytes
+                               ? field->type_info.ann_info.as.annotation_bytes.size_field_name
+                               : field->type_info.ann_info.as.annotation_array.array_size_field_name;
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const TypeInfo *p_ti = &p_si->fields[i].type_info;
+    if (!string_view_equals(&p_si->fields[i].name, &size_field_name)) {
+      continue;
+    }
+
+    bool is_integer = TYPE_CHAR == p_ti->base_type || TYPE_SHORT == p_ti->base_type || TYPE_INT == p_ti->base_type;
+    if (is_integer && 0 == p_ti->pointer_info.indirections_count && 0 == p_ti->array_info.dims_count) {
+      return p_si->fields + i;
+    }
+    break;
+  }
+
+  logf_error("CODE_GEN", "Size of %s field " string_view_farg " of struct " string_view_farg
+             " is not an integer field of the struct.\n", is_bytes ? "@bytes" : "@array",
+             string_view_expand(field->name), string_view_expand(p_si->name));
+  return NULL;
+}
+
+/// Emits the entry of the field in the field table of its struct
+static bool generate_json_table_field(const StructInfo *p_si, const VarInfo *field, CodeBuffer *out_c) {
+  const TypeInfo *p_ti = &field->type_info;
+  unsigned int number_of_ptrs = p_ti->pointer_info.indirections_count;
+  bool is_callback = ANN_CUSTOM_CALLBACK == p_ti->ann_info.kind;
+  bool is_bytes = ANN_BYTES == p_ti->ann_info.kind;
+  bool is_fixed_array = p_ti->array_info.dims_count > 0;
+  bool is_array = ANN_ARRAY == p_ti->ann_info.kind || (is_bytes && !is_fixed_array);
+
+  code_lit(out_c, "\t{ .key = \"\\\"");
+  code_sv(out_c, field->name);
+  code_lit(out_c, "\\\":\", .key_length = ");
+  code_usize(out_c, field->name.length + 3);
+  code_lit(out_c, ", .offset = offsetof(");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, ", ");
+  code_sv(out_c, field->name);
+  code_lit(out_c, "),\n\t  .kind = ");
+
+  if (is_callback) {
+    // the callback gets the address of values and the pointer of pointer fields
+    // (pointers to pointers are followed down to the last one), fixed-size arrays decay to the first element
+    code_lit(out_c, "SER_FIELD_CALLBACK, .indirections = ");
+    code_usize(out_c, is_fixed_array ? 0 : number_of_ptrs);
+    code_lit(out_c, ", .callback = ");
+    code_sv(out_c, p_ti->ann_info.as.annotation_custom_callback.cb_ser_name);
+    code_lit(out_c, " },\n");
+    return true;
+  }
+
+  if (is_bytes) {
+    code_cstr(out_c, BYTES_HEX == p_ti->ann_info.as.annotation_bytes.encoding
+                     ? "SER_FIELD_BYTES_HEX" : "SER_FIELD_BYTES_BASE64");
+  } else {
+    code_field_kind(out_c, p_ti);
+  }
+  code_lit(out_c, ", .indirections = ");
+  code_usize(out_c, is_array ? number_of_ptrs - 1 : number_of_ptrs);
+  if (TYPE_STRUCT == p_ti->base_type) {
+    code_lit(out_c, ", .p_type = &serializer_");
+    code_sv(out_c, p_ti->struct_name);
+    code_lit(out_c, "_type");
+  }
+
+  if (is_array) {
+    const VarInfo *p_size_field = struct_find_size_field(p_si, field);
+    if (NULL == p_size_field) {
+      return false;
+    }
+
+    code_lit(out_c, ",\n\t  .is_array = true, .size_kind = ");
+    code_field_kind(out_c, &p_size_field->type_info);
+    code_lit(out_c, ", .size_offset = offsetof(");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, ", ");
+    code_sv(out_c, p_size_field->name);
+    code_lit(out_c, "), .stride = sizeof(*((const ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "*)0)->");
+    code_sv(out_c, field->name);
+    code_lit(out_c, ")");
+  } else if (is_fixed_array) {
+    code_lit(out_c, ",\n\t  .dims = serializer_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_");
+    code_sv(out_c, field->name);
+    code_lit(out_c, "_dims, .dims_count = ");
+    code_usize(out_c, p_ti->array_info.dims_count);
+    code_lit(out_c, ", .stride = sizeof(((const ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "*)0)->");
+    code_sv(out_c, field->name);
+    for (unsigned int d = 0; d < p_ti->array_info.dims_count; ++d) {
+      code_lit(out_c, "[0]");
+    }
+    code_lit(out_c, ")");
+  }
+
+  code_lit(out_c, " },\n");
+  return true;
+}
+
+/// Checks if the field is part of the projection, every field is part of NULL (the whole struct)
+static bool field_is_in_view(const VarInfo *field, const StringView *p_view) {
+  if (ANN_OMIT == field->type_info.ann_info.kind) {
+    return false;
+  }
+  if (NULL == p_view) {
+    return true;
+  }
+
+  for (unsigned int i = 0; i < field->type_info.ann_info.views_count; ++i) {
+    if (string_view_equals(&field->type_info.ann_info.views[i], p_view)) return true;
+  }
+  return false;
+}
+
+/// Checks if the view of the field is not named by any field before, so every projection is emitted once
+static bool is_first_view(const StructInfo *p_si, size_t field_index, unsigned int view_index) {
+  const StringView *p_view = p_si->fields[field_index].type_info.ann_info.views + view_index;
+  for (size_t i = 0; i < field_index; ++i) {
+    if (field_is_in_view(p_si->fields + i, p_view)) return false;
+  }
+  for (unsigned int j = 0; j < view_index; ++j) {
+    if (string_view_equals(p_si->fields[field_index].type_info.ann_info.views + j, p_view)) return false;
+  }
+  return true;
+}
+
+/// Returns number of fields that are serialized (not omitted), the masked serializer has a bit for each
+static usize struct_serialized_fields_count(const StructInfo *p_si) {
+  usize count = 0;
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    count += ANN_OMIT != p_si->fields[i].type_info.ann_info.kind;
+  }
+  return count;
+}
+
+/// Emits serializer_<T>[_<view>] part of names of serializers and tables of the projection
+static void code_view_name(CodeBuffer *out, const StructInfo *p_si, const StringView *p_view) {
+  code_lit(out, "serializer_");
+  code_sv(out, p_si->name);
+  if (NULL != p_view) {
+    code_lit(out, "_");
+    code_sv(out, *p_view);
+  }
+}
+
+/// Emits the table of fields of the projection (of the whole struct if p_view is NULL)
+static bool generate_json_table(const StructInfo *p_si, const StringView *p_view, CodeBuffer *out_c) {
+  usize fields_count = 0;
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    if (!field_is_in_view(p_si->fields + i, p_view)) continue;
+
+    if (0 == fields_count) {
+      code_lit(out_c, "static const SerializerField ");
+      code_view_name(out_c, p_si, p_view);
+      code_lit(out_c, "_fields[] = {\n");
+    }
+    ++fields_count;
+
+    if (!generate_json_table_field(p_si, p_si->fields + i, out_c)) return false;
+  }
+  if (fields_count > 0) {
+    code_lit(out_c, "};\n");
+  }
+
+  code_lit(out_c, "static const SerializerType ");
+  code_view_name(out_c, p_si, p_view);
+  code_lit(out_c, "_type = { .name = \"");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "\", .fields = ");
+  if (fields_count > 0) {
+    code_view_name(out_c, p_si, p_view);
+    code_lit(out_c, "_fields");
+  } else {
+    code_lit(out_c, "NULL");
+  }
+  code_lit(out_c, ", .fields_count = ");
+  code_usize(out_c, fields_count);
+  code_lit(out_c, " };\n");
+  return true;
+}
+
+/// Emits field tables of the struct and its projections,
+/// serializer_table_to_json walks them instead of generated code
+static bool generate_json_table_for_struct(const StructInfo *p_si, CodeBuffer *out_c) {
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (ANN_OMIT == field->type_info.ann_info.kind) {
+      continue;
+    }
+    if (!field_is_serializable(field)) {
+      return false;
+    }
+
+    const ArrayInfo *p_array = &field->type_info.array_info;
+    if (0 == p_array->dims_count || ANN_CUSTOM_CALLBACK == field->type_info.ann_info.kind) {
+      continue;
+    }
+
+    code_lit(out_c, "static const uint32_t serializer_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_");
+    code_sv(out_c, field->name);
+    code_lit(out_c, "_dims[] = {");
+    for (unsigned int d = 0; d < p_array->dims_count; ++d) {
+      code_lit(out_c, " ");
+      code_usize(out_c, p_array->dims[d]);
+      code_lit(out_c, ",");
+    }
+    code_lit(out_c, " };\n");
+  }
+
+  if (!generate_json_table(p_si, NULL, out_c)) return false;
+
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const AnnotationInfo *p_ann = &p_si->fields[i].type_info.ann_info;
+    for (unsigned int j = 0; j < p_ann->views_count; ++j) {
+      if (is_first_view(p_si, i, j) && !generate_json_table(p_si, p_ann->views + j, out_c)) return false;
+    }
+  }
+
+  code_lit(out_c, "\n");
+  return true;
+}
+
+/// Returns index of the struct named name, -1 if there is none
+static isize struct_order_find(const StructOrder *p_order, StringView name) {
+  const Symbol *p_symbol = symbol_find(&p_order->names, name);
+  return NULL == p_symbol || 0 == p_symbol->struct_index ? -1 : (isize)p_symbol->struct_index - 1;
+}
+
+/// Checks if the generated serializer of the field struct type is called for the field
+static bool field_calls_struct_serializer(const VarInfo *field) {
+  const TypeInfo *p_ti = &field->type_info;
+  return TYPE_STRUCT == p_ti->base_type
+    && ANN_OMIT != p_ti->ann_info.kind && ANN_CUSTOM_CALLBACK != p_ti->ann_info.kind;
+}
+
+/// Checks if definition of the field struct type has to come first:
+/// it is contained by value or its serializer is called
+static bool field_depends_on_struct(const VarInfo *field) {
+  const TypeInfo *p_ti = &field->type_info;
+  return field_calls_struct_serializer(field)
+    || (TYPE_STRUCT == p_ti->base_type && 0 == p_ti->pointer_info.indirections_count);
+}
+
+/// Emits serializer_<T>_to_json_masked, fields are selected by bits SER_MASK_<T>_<field>
+static bool generate_json_masked_for_struct(const StructInfo *p_si, const CodeGenOptions *p_options,
+                                            CodeBuffer *out_c) {
+  code_lit(out_c, "bool serializer_");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask) {\n");
+
+  if (p_options->is_table_driven) {
+    code_lit(out_c, "\treturn serializer_table_to_json_masked(p_ser, &serializer_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_type, p_val, mask);\n");
+    code_lit(out_c, "}\n\n");
+    return true;
+  }
+
+  if (0 == struct_serialized_fields_count(p_si)) {
+    code_lit(out_c, "\t(void)p_val;\n");
+    code_lit(out_c, "\t(void)mask;\n\n");
+  } else {
+    code_lit(out_c, "\tconst ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, " *tmp = (const ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "*)p_val;\n");
+    code_lit(out_c, "\tassert(NULL != tmp);\n\n");
+  }
+
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_object(p_ser));\n\n");
+
+  // a predictable bit test per field, unselected fields are not formatted at all
+  CodeBuffer field_code = { .ok = true };
+  bool ok = true;
+  for (size_t i = 0; ok && i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (ANN_OMIT == field->type_info.ann_info.kind) continue;
+
+    field_code.count = 0;
+    ok = generate_json_for_field(field, p_options->is_graph, &field_code);
+
+    code_lit(out_c, "\tif (0 != (mask & SER_MASK_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_");
+    code_sv(out_c, field->name);
+    code_lit(out_c, ")) {\n");
+    code_indented(out_c, &field_code);
+    code_lit(out_c, "\t}\n");
+  }
+  code_buffer_free(&field_code);
+  if (!ok) return false;
+
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_object(p_ser));\n");
+  code_lit(out_c, "\treturn true;\n");
+  code_lit(out_c, "}\n\n");
+  return true;
+}
+
+/// Emits serializer_<T>_fragments_init and serializer_<T>_to_json_incremental,
+/// every field is formatted into its own cached fragment only when it is dirty
+static bool generate_json_incremental_for_struct(const StructInfo *p_si, const CodeGenOptions *p_options,
+                                                 CodeBuffer *out_c) {
+  usize fields_count = struct_serialized_fields_count(p_si);
+
+  code_lit(out_c, "bool serializer_");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_fragments_init(SerializerFragments *p_fragments) {\n");
+  code_lit(out_c, "\treturn serializer_fragments_init(p_fragments, ");
+  code_usize(out_c, fields_count);
+  code_lit(out_c, ");\n");
+  code_lit(out_c, "}\n\n");
+
+  code_lit(out_c, "bool serializer_");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_to_json_incremental(Serializer *p_out, const void *p_val, SerializerFragments *p_fragments) {\n");
+
+  if (p_options->is_table_driven) {
+    code_lit(out_c, "\treturn serializer_table_to_json_incremental(p_out, &serializer_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_type, p_val, p_fragments);\n");
+    code_lit(out_c, "}\n\n");
+    return true;
+  }
+
+  if (0 == fields_count) {
+    code_lit(out_c, "\t(void)p_val;\n");
+    code_lit(out_c, "\t(void)p_fragments;\n");
+  } else {
+    // generated field code writes to p_ser, here it is the fragment of the field
+    code_lit(out_c, "\tconst ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, " *tmp = (const ");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "*)p_val;\n");
+    code_lit(out_c, "\tSerializer *p_ser = NULL;\n");
+    code_lit(out_c, "\tassert(NULL != tmp);\n");
+  }
+  code_lit(out_c, "\tassert(");
+  code_usize(out_c, fields_count);
+  code_lit(out_c, " == p_fragments->fields_count);\n\n");
+
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_object(p_out));\n\n");
+
+  CodeBuffer field_code = { .ok = true };
+  bool ok = true;
+  usize index = 0;
+  for (size_t i = 0; ok && i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (ANN_OMIT == field->type_info.ann_info.kind) continue;
+
+    field_code.count = 0;
+    ok = generate_json_for_field(field, p_options->is_graph, &field_code);
+
+    code_lit(out_c, "\tif (NULL != (p_ser = serializer_fragment_begin(p_fragments, ");
+    code_usize(out_c, index);
+    code_lit(out_c, "))) {\n");
+    code_indented(out_c, &field_code);
+    code_lit(out_c, "\t\tSER_VALIDATE(serializer_fragment_end(p_fragments, ");
+    code_usize(out_c, index);
+    code_lit(out_c, "));\n");
+    code_lit(out_c, "\t}\n");
+    code_lit(out_c, "\tSER_VALIDATE(serializer_fragment_append(p_out, p_fragments, ");
+    code_usize(out_c, index);
+    code_lit(out_c, "));\n");
+    ++index;
+  }
+  code_buffer_free(&field_code);
+  if (!ok) return false;
 
-  string_builder_free(type);
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_object(p_out));\n");
+  code_lit(out_c, "\treturn true;\n");
+  code_lit(out_c, "}\n\n");
   return true;
 }
 
-bool generate_json_for_struct(const StructInfo *p_si, FILE *out_h, FILE *out_c) {
+/// Emits serializer_<T>_<view>_to_json specialized for fields of the projection
+static bool generate_json_view_for_struct(const StructInfo *p_si, const StringView *p_view,
+                                          const CodeGenOptions *p_options, CodeBuffer *out_c) {
+  code_lit(out_c, "bool ");
+  code_view_name(out_c, p_si, p_view);
+  code_lit(out_c, "_to_json(Serializer *p_ser, const void *p_val) {\n");
+
+  if (p_options->is_table_driven) {
+    code_lit(out_c, "\treturn serializer_table_to_json(p_ser, &");
+    code_view_name(out_c, p_si, p_view);
+    code_lit(out_c, "_type, p_val);\n");
+    code_lit(out_c, "}\n\n");
+    return true;
+  }
+
+  code_lit(out_c, "\tconst ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, " *tmp = (const ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "*)p_val;\n");
+  code_lit(out_c, "\tassert(NULL != tmp);\n\n");
+
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_object(p_ser));\n\n");
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    if (field_is_in_view(p_si->fields + i, p_view)
+        && !generate_json_for_field(p_si->fields + i, p_options->is_graph, out_c)) {
+      return false;
+    }
+  }
+  code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_object(p_ser));\n");
+  code_lit(out_c, "\treturn true;\n");
+  code_lit(out_c, "}\n\n");
+  return true;
+}
+
+/// Emits static inline serializer of the struct with code unrolled per field
+static bool generate_json_functions_for_struct(const StructInfo *p_si, const StructOrder *p_order,
+                                               const CodeGenOptions *p_options, CodeBuffer *out_c) {
+  // serializers of structs that come later (through pointers) are declared first
+  usize position = p_order->positions[p_si - p_order->structs];
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (!field_calls_struct_serializer(field)) {
+      continue;
+    }
+
+    isize index = struct_order_find(p_order, field->type_info.struct_name);
+    assert(index >= 0);
+    if (p_order->positions[index] <= position) {
+      continue;
+    }
+
+    bool is_declared = false;
+    for (size_t j = 0; !is_declared && j < i; ++j) {
+      is_declared = field_calls_struct_serializer(p_si->fields + j)
+        && string_view_equals(&p_si->fields[j].type_info.struct_name, &field->type_info.struct_name);
+    }
+    if (is_declared) continue;
+
+    code_lit(out_c, "static inline bool serializer_");
+    code_sv(out_c, field->type_info.struct_name);
+    code_lit(out_c, "_to_json_inline(Serializer *p_ser, const ");
+    code_sv(out_c, field->type_info.struct_name);
+    code_lit(out_c, " *tmp);\n");
+  }
+
+  // graph mode: address of the key tells objects of this type from others at the same address
+  if (p_options->is_graph) {
+    code_lit(out_c, "static const char serializer_");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_ref_key = 0;\n");
+  }
+
+  // serialize function, nested structs call it directly with the right type, so it can be inlined
+  code_lit(out_c, "static inline bool serializer_");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_to_json_inline(Serializer *p_ser, const ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, " *tmp) {\n");
+  {
+    code_lit(out_c, "\tassert(NULL != tmp);\n\n");
+
+    if (p_options->is_graph) {
+      code_lit(out_c, "\tbool is_new = true;\n");
+      code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_shared_object(p_ser, tmp, &serializer_");
+      code_sv(out_c, p_si->name);
+      code_lit(out_c, "_ref_key, &is_new));\n");
+      code_lit(out_c, "\tif (!is_new) return true;\n\n");
+    } else {
+      code_lit(out_c, "\tSER_VALIDATE(serializer_json_start_object(p_ser));\n\n");
+    }
+
+    // serialize fields
+    for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+      if (!generate_json_for_field(p_si->fields + i, p_options->is_graph, out_c)) return false;
+    }
+
+    code_lit(out_c, "\tSER_VALIDATE(serializer_json_end_object(p_ser));\n");
+    code_lit(out_c, "\treturn true;\n");
+  }
+  code_lit(out_c, "}\n\n");
+
+  return true;
+}
+
+static bool generate_json_for_struct(const StructInfo *p_si, const StructOrder *p_order,
+                                     const CodeGenOptions *p_options, CodeBuffer *out_h, CodeBuffer *out_c) {
   assert(NULL != p_si);
+  assert(NULL != p_order);
+  assert(NULL != p_options);
   assert(NULL != out_h);
   assert(NULL != out_c);
 
-  fprintf(out_h, "bool serializer_%.*s_to_json(Serializer *p_ser, const void *p_val);\n",
-          string_view_expand(p_si->name));
+  code_lit(out_h, "bool serializer_");
+  code_sv(out_h, p_si->name);
+  code_lit(out_h, "_to_json(Serializer *p_ser, const void *p_val);\n");
+
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (ANN_OMIT == field->type_info.ann_info.kind && field->type_info.ann_info.views_count > 0) {
+      logf_error("CODE_GEN", "Field " string_view_farg " of struct " string_view_farg
+                 " is omitted and cannot be part of a @view.\n",
+                 string_view_expand(field->name), string_view_expand(p_si->name));
+      return false;
+    }
+  }
+
+  // bit of every serialized field in the mask, in declaration order
+  bool has_masked = struct_serialized_fields_count(p_si) <= SER_MASK_MAX_FIELDS;
+  usize bit = 0;
+  for (size_t i = 0; has_masked && i < vec_count(p_si->fields); ++i) {
+    if (ANN_OMIT == p_si->fields[i].type_info.ann_info.kind) continue;
+
+    code_lit(out_h, "#define SER_MASK_");
+    code_sv(out_h, p_si->name);
+    code_lit(out_h, "_");
+    code_sv(out_h, p_si->fields[i].name);
+    code_lit(out_h, " ((uint64_t)1 << ");
+    code_usize(out_h, bit++);
+    code_lit(out_h, ")\n");
+  }
+  if (has_masked) {
+    code_lit(out_h, "bool serializer_");
+    code_sv(out_h, p_si->name);
+    code_lit(out_h, "_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask);\n");
+  }
+
+  // fragments are marked dirty with the bits of the mask
+  if (p_si->is_incremental && !has_masked) {
+    logf_error("CODE_GEN", "Struct " string_view_farg " has more than %d serialized fields and cannot be @incremental.\n",
+               string_view_expand(p_si->name), SER_MASK_MAX_FIELDS);
+    return false;
+  }
+  if (p_si->is_incremental) {
+    code_lit(out_h, "bool serializer_");
+    code_sv(out_h, p_si->name);
+    code_lit(out_h, "_fragments_init(SerializerFragments *p_fragments);\n");
+    code_lit(out_h, "bool serializer_");
+    code_sv(out_h, p_si->name);
+    code_lit(out_h, "_to_json_incremental(Serializer *p_ser, const void *p_val, SerializerFragments *p_fragments);\n");
+  }
+
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const AnnotationInfo *p_ann = &p_si->fields[i].type_info.ann_info;
+    for (unsigned int j = 0; j < p_ann->views_count; ++j) {
+      if (!is_first_view(p_si, i, j)) continue;
+
+      code_lit(out_h, "bool ");
+      code_view_name(out_h, p_si, p_ann->views + j);
+      code_lit(out_h, "_to_json(Serializer *p_ser, const void *p_val);\n");
+    }
+  }
 
   // defining struct for serializing
-  fprintf(out_c, "typedef struct " string_view_farg " {\n",
-          string_view_expand(p_si->name));
+  code_lit(out_c, "typedef struct ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, " {\n");
   {
     // members
-    vec_for_each(p_si->fields, i, {
-                  StringBuilder type = type_info_get_type_str(&p_si->fields[i].type_info);
-                  fprintf(out_c, "\t%s %.*s;\n", 
-                          string_builder_get_cstr(&type), string_view_expand(p_si->fields[i].name));
-                  string_builder_free(type);
-                 });
+    for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+      code_lit(out_c, "\t");
+      code_type_str(out_c, &p_si->fields[i].type_info);
+      code_lit(out_c, " ");
+      code_sv(out_c, p_si->fields[i].name);
+      const ArrayInfo *p_array = &p_si->fields[i].type_info.array_info;
+      for (unsigned int d = 0; d < p_array->dims_count; ++d) {
+        code_lit(out_c, "[");
+        code_usize(out_c, p_array->dims[d]);
+        code_lit(out_c, "]");
+      }
+      code_lit(out_c, ";\n");
+    }
+  }
+  code_lit(out_c, "} ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, ";\n");
+
+  // the compiler checks layout the schema was generated with
+  if (p_si->has_layout) {
+    code_lit(out_c, "SER_LAYOUT_ASSERT(sizeof(");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, ") == ");
+    code_usize(out_c, p_si->size);
+    code_lit(out_c, ");\n");
+
+    code_lit(out_c, "SER_LAYOUT_ASSERT(_Alignof(");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, ") == ");
+    code_usize(out_c, p_si->align);
+    code_lit(out_c, ");\n");
+
+    for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+      code_lit(out_c, "SER_LAYOUT_ASSERT(offsetof(");
+      code_sv(out_c, p_si->name);
+      code_lit(out_c, ", ");
+      code_sv(out_c, p_si->fields[i].name);
+      code_lit(out_c, ") == ");
+      code_usize(out_c, p_si->fields[i].offset);
+      code_lit(out_c, ");\n");
+    }
   }
-  fprintf(out_c, "} " string_view_farg ";\n", string_view_expand(p_si->name));
 
   // forward decl for all custom callbacks
-  vec_for_each(p_si->fields, i, {
-                if (p_si->fields[i].type_info.ann_info.kind == ANN_CUSTOM_CALLBACK) {
-                  AnnotationCustomCallback acc = p_si->fields[i].type_info.ann_info.as.annotation_custom_callback;
-                  fprintf(out_c, "bool %.*s(Serializer *p_ser, const void *value);\n", string_view_expand(acc.cb_ser_name));
-                  fprintf(out_c, "bool %.*s(Serializer *p_ser, void *value);\n", string_view_expand(acc.cb_deser_name));
-                }
-               });
-
-
-  // serialize function
-  fprintf(out_c, "bool serializer_%.*s_to_json(Serializer *p_ser, const void *p_val) {\n",
-          string_view_expand(p_si->name));
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    if (p_si->fields[i].type_info.ann_info.kind == ANN_CUSTOM_CALLBACK) {
+      AnnotationCustomCallback acc = p_si->fields[i].type_info.ann_info.as.annotation_custom_callback;
+      code_lit(out_c, "bool ");
+      code_sv(out_c, acc.cb_ser_name);
+      code_lit(out_c, "(Serializer *p_ser, const void *value);\n");
+      code_lit(out_c, "bool ");
+      code_sv(out_c, acc.cb_deser_name);
+      code_lit(out_c, "(Serializer *p_ser, void *value);\n");
+    }
+  }
+
+  code_lit(out_c, "#ifdef SERC_SIZE_HINTS\n");
+  code_lit(out_c, "static SerializerSizeHint ");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_size_hint;\n");
+  code_lit(out_c, "#endif // SERC_SIZE_HINTS\n");
+
+  if (p_options->is_table_driven) {
+    if (!generate_json_table_for_struct(p_si, out_c)) return false;
+  } else if (!generate_json_functions_for_struct(p_si, p_order, p_options, out_c)) {
+    return false;
+  }
+
+  code_lit(out_c, "bool serializer_");
+  code_sv(out_c, p_si->name);
+  code_lit(out_c, "_to_json(Serializer *p_ser, const void *p_val) {\n");
   {
-    fputs("\tassert(NULL != p_val);\n\n", out_c);
+    code_lit(out_c, "\tassert(NULL != p_val);\n\n");
+
+    code_lit(out_c, "#ifdef SERC_SIZE_HINTS\n");
+    code_lit(out_c, "\tsize_t size_hint_begin = serializer_size_hint_begin(p_ser, &");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_size_hint);\n");
+    code_lit(out_c, "#endif // SERC_SIZE_HINTS\n\n");
+
+    if (p_options->is_table_driven) {
+      code_lit(out_c, "\tSER_VALIDATE(serializer_table_to_json(p_ser, &serializer_");
+      code_sv(out_c, p_si->name);
+      code_lit(out_c, "_type, p_val));\n\n");
+    } else {
+      code_lit(out_c, "\tSER_VALIDATE(serializer_");
+      code_sv(out_c, p_si->name);
+      code_lit(out_c, "_to_json_inline(p_ser, (const ");
+      code_sv(out_c, p_si->name);
+      code_lit(out_c, "*)p_val));\n\n");
+    }
 
-    // cast void* to struct*
-    fprintf(out_c, "\tconst " string_view_farg " *tmp = (const " string_view_farg "*)p_val;\n\n",
-            string_view_expand(p_si->name), string_view_expand(p_si->name));
+    code_lit(out_c, "#ifdef SERC_SIZE_HINTS\n");
+    code_lit(out_c, "\tserializer_size_hint_end(p_ser, &");
+    code_sv(out_c, p_si->name);
+    code_lit(out_c, "_size_hint, size_hint_begin);\n");
+    code_lit(out_c, "#endif // SERC_SIZE_HINTS\n");
+    code_lit(out_c, "\treturn true;\n");
+  }
+  code_lit(out_c, "}\n\n");
 
-    // serialize fields
-    vec_for_each(p_si->fields, i, { if (!generate_json_for_field(p_si->fields + i, out_c)) return false; });
+  if (has_masked && !generate_json_masked_for_struct(p_si, p_options, out_c)) {
+    return false;
+  }
+
+  if (p_si->is_incremental && !generate_json_incremental_for_struct(p_si, p_options, out_c)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const AnnotationInfo *p_ann = &p_si->fields[i].type_info.ann_info;
+    for (unsigned int j = 0; j < p_ann->views_count; ++j) {
+      if (is_first_view(p_si, i, j) && !generate_json_view_for_struct(p_si, p_ann->views + j, p_options, out_c)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void generate_json_for_struct_task(void *ctx, usize index) {
+  const CodeGenContext *p_ctx = (const CodeGenContext*)ctx;
+  StructOutput *p_out = p_ctx->outputs + index;
+
+  p_out->h.ok = p_out->c.ok = true;
+  p_out->ok = generate_json_for_struct(p_ctx->structs + index, p_ctx->p_order, p_ctx->p_options,
+                                      &p_out->h, &p_out->c);
+}
+
+// ----------------- | ORDER |
+
+enum {
+  ORDER_NONE = 0,
+  ORDER_ACTIVE,
+  ORDER_DONE,
+};
+
+/// Appends the struct to the order after everything it depends on.
+/// A dependency that is being visited is a cycle through pointers, it is declared instead
+///
+/// @return bool, false if a field refers to a struct that is not defined
+static bool struct_order_visit(StructOrder *p_order, usize index) {
+  if (ORDER_NONE != p_order->states[index]) {
+    return true;
+  }
+  p_order->states[index] = ORDER_ACTIVE;
+
+  bool ok = true;
+  const StructInfo *p_si = p_order->structs + index;
+  for (size_t i = 0; i < vec_count(p_si->fields); ++i) {
+    const VarInfo *field = p_si->fields + i;
+    if (!field_depends_on_struct(field)) {
+      continue;
+    }
+
+    isize dependency = struct_order_find(p_order, field->type_info.struct_name);
+    if (dependency < 0) {
+      logf_error("CODE_GEN", "Field " string_view_farg " of struct " string_view_farg
+                 " has type struct " string_view_farg " that is not defined in the inputs.\n",
+                 string_view_expand(field->name), string_view_expand(p_si->name),
+                 string_view_expand(field->type_info.struct_name));
+      log_error("CODE_GEN", "NOTE: add the definition to the inputs, provide custom callback or omit the field");
+      ok = false;
+      continue;
+    }
+
+    ok = struct_order_visit(p_order, (usize)dependency) && ok;
+  }
+
+  p_order->states[index] = ORDER_DONE;
+  p_order->positions[index] = p_order->order_count;
+  p_order->order[p_order->order_count++] = index;
+  return ok;
+}
+
+/// Orders structs for emitting, see StructOrder
+///
+/// @return bool, false if out of memory or a struct refers to an undefined one
+static bool struct_order_init(StructOrder *p_order, const StructInfo *structs, usize structs_count) {
+  *p_order = (StructOrder){ .structs = structs, .structs_count = structs_count };
+  symbol_table_init(&p_order->names);
+  arena_init(&p_order->arena, 0);
+
+  usize capacity = 0 == structs_count ? 1 : structs_count;
+  p_order->order = (usize*)malloc(capacity * sizeof(usize));
+  p_order->positions = (usize*)malloc(capacity * sizeof(usize));
+  p_order->states = (u8*)calloc(capacity, sizeof(u8));
+  if (NULL == p_order->order || NULL == p_order->positions || NULL == p_order->states) {
+    log_error("CODE_GEN", "out of memory");
+    return false;
+  }
+
+  StringView anonymous = string_view_from_cstr("<anonymous>");
+  for (usize i = 0; i < structs_count; ++i) {
+    if (string_view_equals(&structs[i].name, &anonymous)) continue;
 
-    fputs("\treturn true;\n", out_c);
+    Symbol *p_symbol = symbol_intern(&p_order->names, &p_order->arena, structs[i].name);
+    p_symbol->struct_index = i + 1;
   }
-  fputs("}\n\n", out_c);
 
+  bool ok = true;
+  for (usize i = 0; i < structs_count; ++i) {
+    ok = struct_order_visit(p_order, i) && ok;
+  }
+  return ok;
+}
 
+static void struct_order_free(StructOrder *p_order) {
+  free(p_order->order);
+  free(p_order->positions);
+  free(p_order->states);
+  symbol_table_free(&p_order->names);
+  arena_free(&p_order->arena);
+  *p_order = (StructOrder){0};
+}
+
+u64 code_gen_options_hash(const CodeGenOptions *p_options) {
+  assert(NULL != p_options);
+
+  u64 hash = hash_bytes(&(u32){ CODE_GEN_VERSION }, sizeof(u32), 0);
+  hash = hash_bytes(&(u8){ p_options->is_table_driven }, sizeof(u8), hash);
+  hash = hash_bytes(&(u8){ p_options->is_graph }, sizeof(u8), hash);
+  return hash_cstr(NULL != p_options->path ? p_options->path : SERIALIZATION_DIR, hash);
+}
+
+void code_gen_output_path(StringBuilder *p_path, const char *dir, const char *file_name) {
+  assert(NULL != p_path);
+  assert(NULL != file_name);
+
+  if (NULL == dir) dir = SERIALIZATION_DIR;
+  string_builder_append_cstr(p_path, dir);
+  size_t length = strlen(dir);
+  if (0 != length && '/' != dir[length - 1]) {
+    string_builder_append_rune(p_path, '/');
+  }
+  string_builder_append_cstr(p_path, file_name);
+}
+
+/// Replaces the generated file at path if its content is not data
+static bool write_out_file(const char *path, const char *data, size_t size) {
+  bool is_written = false;
+  if (!file_write_if_changed(path, data, size, &is_written)) {
+    logf_error("CODE_GEN", "Could not write file %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  if (is_written) {
+    logf_trace("CODE_GEN", "%s updated\n", path);
+  }
   return true;
 }
 
+/// Concatenates prologue, parts of all structs and epilogue into p_out
+///
+/// @param order: indices of outputs in the order they are joined, schema order if NULL
+static void join_outputs(CodeBuffer *p_out, const CodeBuffer *p_prologue, const StructOutput *outputs,
+                         const usize *order, usize outputs_count, bool is_header, const CodeBuffer *p_epilogue) {
+  usize size = p_prologue->count + p_epilogue->count;
+  for (usize i = 0; i < outputs_count; ++i) {
+    size += is_header ? outputs[i].h.count : outputs[i].c.count;
+  }
 
-#define SERIALIZATION_DIR "./src/serialization/"
+  // sized upfront, so the file is copied once
+  p_out->data = (char*)malloc(0 == size ? 1 : size);
+  p_out->capacity = 0 == size ? 1 : size;
+  p_out->ok = NULL != p_out->data;
+  if (!p_out->ok) {
+    p_out->capacity = 0;
+    return;
+  }
 
-bool generate_json_serialization(const vec(StructInfo) const * p_si, const char *path) {
+  code_write(p_out, p_prologue->data, p_prologue->count);
+  for (usize i = 0; i < outputs_count; ++i) {
+    const StructOutput *p_output = outputs + (NULL != order ? order[i] : i);
+    const CodeBuffer *p_part = is_header ? &p_output->h : &p_output->c;
+    code_write(p_out, p_part->data, p_part->count);
+  }
+  code_write(p_out, p_epilogue->data, p_epilogue->count);
+}
+
+bool generate_json_serialization(const vec(StructInfo) const * p_si, const CodeGenOptions *p_options,
+                                 ThreadPool *p_pool) {
   assert(NULL != p_si);
-  StringBuilder dotc; string_builder_init(dotc);
-  StringBuilder doth; string_builder_init(doth);
+  assert(NULL != p_options);
+
+  usize structs_count = vec_count(*p_si);
   bool ok = true;
 
-  if (NULL != path) {
-    string_builder_append_cstr(&dotc, path);
-    string_builder_append_cstr(&doth, path);
-  } else {
-    string_builder_append_cstr(&dotc, SERIALIZATION_DIR);
-    string_builder_append_cstr(&doth, SERIALIZATION_DIR);
+  CodeBuffer prologue_h = { .ok = true }, prologue_c = { .ok = true };
+  CodeBuffer epilogue_h = { .ok = true }, epilogue_c = { .ok = true };
+  CodeBuffer out_h = {0}, out_c = {0};
+
+  StructOutput *outputs = (StructOutput*)calloc(0 == structs_count ? 1 : structs_count, sizeof(StructOutput));
+  if (NULL == outputs) {
+    log_error("CODE_GEN", "out of memory");
+    return false;
   }
 
-  string_builder_append_cstr(&dotc, "json.c");
-  string_builder_append_cstr(&doth, "json.h");
+  initialize_out_files_json(&prologue_h, &prologue_c);
+
+  StructOrder order;
+  ok = struct_order_init(&order, *p_si, structs_count);
 
-  FILE *out_c = fopen(string_builder_get_cstr(&dotc), "w+");
-  if (NULL == out_c) {
-    logf_error("CODE_GEN", "Could not open file %s: %s\n", string_builder_get_cstr(&dotc), strerror(errno));
-    goto cleanup_error;
+  // every struct is declared upfront, so structs can refer to each other through pointers
+  StringView anonymous = string_view_from_cstr("<anonymous>");
+  for (usize i = 0; ok && i < structs_count; ++i) {
+    if (string_view_equals(&(*p_si)[i].name, &anonymous)) continue;
+
+    code_lit(&prologue_c, "typedef struct ");
+    code_sv(&prologue_c, (*p_si)[i].name);
+    code_lit(&prologue_c, " ");
+    code_sv(&prologue_c, (*p_si)[i].name);
+    code_lit(&prologue_c, ";\n");
   }
+  for (usize i = 0; ok && p_options->is_table_driven && i < structs_count; ++i) {
+    // tables refer to each other, so cycles through pointers are allowed as well
+    if (string_view_equals(&(*p_si)[i].name, &anonymous)) continue;
 
-  FILE *out_h = fopen(string_builder_get_cstr(&doth), "w+");
-  if (NULL == out_h) {
-    logf_error("CODE_GEN", "Could not open file %s: %s\n", string_builder_get_cstr(&doth), strerror(errno));
-    goto cleanup_error;
+    code_lit(&prologue_c, "static const SerializerType serializer_");
+    code_sv(&prologue_c, (*p_si)[i].name);
+    code_lit(&prologue_c, "_type;\n");
   }
+  code_lit(&prologue_c, "\n");
 
-  if (!initialize_out_files_json(out_h, out_c, path)) {
-    goto cleanup_error;
+  CodeGenContext ctx = { .structs = *p_si, .p_order = &order, .p_options = p_options, .outputs = outputs };
+  if (ok && NULL != p_pool) {
+    thread_pool_run(p_pool, structs_count, generate_json_for_struct_task, &ctx);
+  } else if (ok) {
+    for (usize i = 0; i < structs_count; ++i) generate_json_for_struct_task(&ctx, i);
   }
 
-  for (size_t i = 0; i < vec_count(*p_si); ++i) {
-    if (!generate_json_for_struct(vec_at(*p_si, i), out_h, out_c)) {
-      goto cleanup_error;
+  finalize_out_files_json(&epilogue_h, &epilogue_c);
+
+  for (usize i = 0; ok && i < structs_count; ++i) {
+    ok = outputs[i].ok;
+    if (ok && !(outputs[i].h.ok && outputs[i].c.ok)) {
+      log_error("CODE_GEN", "out of memory");
+      ok = false;
     }
   }
 
-  if (!finalize_out_files_json(out_h, out_c)) {
-    goto cleanup_error;
-  }
+  if (ok) {
+    join_outputs(&out_h, &prologue_h, outputs, NULL, structs_count, true, &epilogue_h);
+    join_outputs(&out_c, &prologue_c, outputs, order.order, structs_count, false, &epilogue_c);
 
+    if (!(out_h.ok && out_c.ok && prologue_h.ok && prologue_c.ok && epilogue_h.ok)) {
+      log_error("CODE_GEN", "out of memory");
+      ok = false;
+    }
+  }
 
-  goto cleanup;
+  StringBuilder dotc; string_builder_init(dotc);
+  StringBuilder doth; string_builder_init(doth);
+  code_gen_output_path(&dotc, p_options->path, JSON_SOURCE_FILE_NAME);
+  code_gen_output_path(&doth, p_options->path, JSON_HEADER_FILE_NAME);
 
-cleanup_error:
-  ok = false;
-  if (NULL != out_c) remove(string_builder_get_cstr(&dotc));
-  if (NULL != out_h) remove(string_builder_get_cstr(&doth));
+  // header first: json.c is never newer than the json.h it includes
+  ok = ok
+    && write_out_file(string_builder_get_cstr(&doth), out_h.data, out_h.count)
+    && write_out_file(string_builder_get_cstr(&dotc), out_c.data, out_c.count);
 
-cleanup:
-  if (NULL != out_c) fclose(out_c);
-  if (NULL != out_h) fclose(out_h);
+  for (usize i = 0; i < structs_count; ++i) {
+    code_buffer_free(&outputs[i].h);
+    code_buffer_free(&outputs[i].c);
+  }
+  free(outputs);
+  struct_order_free(&order);
+  code_buffer_free(&prologue_h);
+  code_buffer_free(&prologue_c);
+  code_buffer_free(&epilogue_h);
+  code_buffer_free(&epilogue_c);
+  code_buffer_free(&out_h);
+  code_buffer_free(&out_c);
   string_builder_free(dotc);
   string_builder_free(doth);
 
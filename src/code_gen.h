@@ -1,14 +1,70 @@
 #ifndef __SERC_CODEGEN_H__
 #define __SERC_CODEGEN_H__
 
+#include "./lib/ds/string_builder.h"
 #include "./lib/ds/vec.h"
 #include "parser.h"
+#include "thread_pool.h"
 
-/// Generates *.c and *.h files for serialization structs pointed by p_si
+/// Default directory of generated files
+#define SERIALIZATION_DIR "./src/serialization/"
+
+/// Names of generated files inside the output directory
+#define JSON_SOURCE_FILE_NAME "json.c"
+#define JSON_HEADER_FILE_NAME "json.h"
+
+/// Bump when generated code changes for the same input,
+/// so caches keyed by code_gen_options_hash are invalidated
+#define CODE_GEN_VERSION 13
+
+/// Structs with at most that many serialized fields get serializer_<T>_to_json_masked,
+/// the mask is uint64_t with bit SER_MASK_<T>_<field> for every field
+#define SER_MASK_MAX_FIELDS 64
+
+/// Everything besides the schema that affects generated files
+typedef struct {
+  /// path to the directory where to save generated files,
+  /// "./src/serialization/" if NULL
+  const char *path;
+
+  /// emit a static field table per struct walked by serializer_table_to_json
+  /// instead of unrolled code, smaller output for schemas with many types
+  bool is_table_driven;
+
+  /// serializers of structs write shared objects once ({"$id":N,...}, then {"$ref":N})
+  /// when the serializer has refs attached (serializer_set_refs), so cycles terminate.
+  /// NULL pointers are written as null. Table serializers always do both
+  bool is_graph;
+} CodeGenOptions;
+
+/// Hashes the options together with CODE_GEN_VERSION
+///
+/// @param p_options: options to hash
+/// @return u64, hash of the options
+u64 code_gen_options_hash(const CodeGenOptions *p_options);
+
+/// Appends path of the file named file_name inside the output directory dir to p_path,
+/// the directory may lack the trailing '/'
+///
+/// @param dir: output directory, SERIALIZATION_DIR if NULL
+void code_gen_output_path(StringBuilder *p_path, const char *dir, const char *file_name);
+
+/// Generates *.c and *.h files for serialization structs pointed by p_si.
+/// Code of every struct is generated into its own buffer, in parallel,
+/// then buffers are joined: declarations in schema order, definitions in dependency order,
+/// so serializers of nested structs are defined (static inline) before they are called.
+/// Besides serializer_<T>_to_json every struct gets serializer_<T>_to_json_masked
+/// and serializer_<T>_<view>_to_json for every projection its fields declare with `@view <name>`.
+/// Structs annotated with `@incremental` right after '{' also get serializer_<T>_to_json_incremental.
+/// Files are replaced only if their content changes,
+/// so up to date outputs keep their timestamps and do not trigger recompilation
 ///
 /// @param p_si: vector of structs to generate json serialization for
-/// @param path: path to the directory where to save generated files
-bool generate_json_serialization(const vec(StructInfo) const * p_si, const char *path);
+/// @param p_options: generator options
+/// @param p_pool: optional, pool to generate structs on
+/// @return bool, false on failure, e.g. a field refers to a struct that is not defined
+bool generate_json_serialization(const vec(StructInfo) const * p_si, const CodeGenOptions *p_options,
+                                 ThreadPool *p_pool);
 
 
 #endif // !__SERC_CODEGEN_H__
@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH_K0 0xa0761d6478bd642full
+#define HASH_K1 0xe7037ed1a0b428dbull
+#define HASH_K2 0x8ebc6af09c88c6e3ull
+
+/// Multiplies a and b to 128 bits and folds the halves
+static u64 hash_mix(u64 a, u64 b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (u64)r ^ (u64)(r >> 64);
+}
+
+static u64 hash_read_u64(const u8 *p) {
+  u64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+u64 hash_bytes(const void *data, usize length, u64 seed) {
+  const u8 *p = (const u8*)data;
+  const usize total = length;
+  u64 h = seed ^ HASH_K0;
+
+  // two independent lanes per iteration keep both multipliers busy
+  while (length >= 16) {
+    u64 a = hash_read_u64(p);
+    u64 b = hash_read_u64(p + 8);
+    h = hash_mix(a ^ HASH_K1, b ^ h);
+    p += 16;
+    length -= 16;
+  }
+
+  u64 tail = 0;
+  if (length >= 8) {
+    h = hash_mix(hash_read_u64(p) ^ HASH_K1, h ^ HASH_K2);
+    p += 8;
+    length -= 8;
+  }
+  memcpy(&tail, p, length);
+
+  return hash_mix(h ^ tail ^ HASH_K2, (u64)total ^ HASH_K1);
+}
+
+u64 hash_cstr(const char *str, u64 seed) {
+  return hash_bytes(str, strlen(str), seed);
+}
@@ -0,0 +1,18 @@
+#ifndef __SERC_HASH_H__
+#define __SERC_HASH_H__
+
+#include "common.h"
+
+/// Fast non-cryptographic 64 bit hash of the bytes,
+/// used to detect changes of inputs and options between runs
+///
+/// @param data: pointer to the bytes
+/// @param length: number of bytes
+/// @param seed: initial value, allows to chain hashes of several buffers
+/// @return u64, hash value
+u64 hash_bytes(const void *data, usize length, u64 seed);
+
+/// Hash of the NUL-terminated string, see hash_bytes
+u64 hash_cstr(const char *str, u64 seed);
+
+#endif // !__SERC_HASH_H__
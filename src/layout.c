@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "layout.h"
+#include "./lib/ds/logger.h"
+
+#define LAYOUT_POINTER_SIZE 8
+
+enum {
+  LAYOUT_NONE = 0,
+  LAYOUT_ACTIVE,
+  LAYOUT_DONE,
+};
+
+typedef struct {
+  Schema *p_schema;
+
+  /// state of every struct of the schema in the depth-first walk
+  u8 *states;
+  bool ok;
+} LayoutContext;
+
+static usize align_up(usize value, usize align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+/// Layout of scalar (not struct) types
+static bool type_info_get_scalar_layout(const TypeInfo *p_ti, TypeLayout *p_out) {
+  usize size = 0;
+  switch (p_ti->base_type) {
+    case TYPE_CHAR: size = 1; break;
+    case TYPE_SHORT: size = 2; break;
+    case TYPE_INT: size = 0 == p_ti->longness ? 4 : 8; break;
+    case TYPE_LONG: size = 8; break;
+    case TYPE_FLOAT: size = 4; break;
+    case TYPE_DOUBLE: size = 0 == p_ti->longness ? 8 : 16; break;
+    default: return false;
+  }
+
+  *p_out = (TypeLayout){ .size = size, .align = size };
+  return true;
+}
+
+/// Turns layout of the element into layout of the fixed-size array of p_ti (if it is one)
+///
+/// @return bool, false if the array is too large
+static bool array_apply_layout(const TypeInfo *p_ti, TypeLayout *p_layout) {
+  for (unsigned int i = 0; i < p_ti->array_info.dims_count; ++i) {
+    u32 dim = p_ti->array_info.dims[i];
+    if (p_layout->size > SIZE_MAX / dim) {
+      return false;
+    }
+    p_layout->size *= dim;
+  }
+  return true;
+}
+
+/// Returns index of the struct named name in the merged schema, -1 if there is none
+static isize schema_find_struct(const Schema *p_schema, StringView name) {
+  const Symbol *p_symbol = symbol_find(&p_schema->symbols, name);
+  return NULL == p_symbol || 0 == p_symbol->struct_index ? -1 : (isize)p_symbol->struct_index - 1;
+}
+
+static bool struct_compute_layout(LayoutContext *p_ctx, usize index);
+
+/// Layout of the field type without its array dimensions,
+/// computing layout of its struct first if needed
+///
+/// @return bool, false if unknown
+static bool field_get_element_layout(LayoutContext *p_ctx, const TypeInfo *p_ti, TypeLayout *p_out) {
+  if (p_ti->pointer_info.indirections_count > 0) {
+    *p_out = (TypeLayout){ .size = LAYOUT_POINTER_SIZE, .align = LAYOUT_POINTER_SIZE };
+    return true;
+  }
+
+  if (TYPE_STRUCT != p_ti->base_type) {
+    return type_info_get_scalar_layout(p_ti, p_out);
+  }
+
+  isize index = schema_find_struct(p_ctx->p_schema, p_ti->struct_name);
+  if (index < 0) {
+    return false;
+  }
+
+  if (LAYOUT_ACTIVE == p_ctx->states[index]) {
+    logf_error("LAYOUT", "struct " string_view_farg " contains itself\n", string_view_expand(p_ti->struct_name));
+    p_ctx->ok = false;
+    return false;
+  }
+
+  if (!struct_compute_layout(p_ctx, (usize)index)) {
+    return false;
+  }
+
+  const StructInfo *p_si = vec_at(p_ctx->p_schema->structs, index);
+  *p_out = (TypeLayout){ .size = p_si->size, .align = p_si->align };
+  return true;
+}
+
+/// Layout of the field type, computing layout of its struct first if needed
+///
+/// @return bool, false if unknown
+static bool field_get_layout(LayoutContext *p_ctx, const TypeInfo *p_ti, TypeLayout *p_out) {
+  return field_get_element_layout(p_ctx, p_ti, p_out) && array_apply_layout(p_ti, p_out);
+}
+
+/// Lays out fields of the struct in declaration order, each at the first offset aligned for it
+///
+/// @return bool, true if the struct has layout
+static bool struct_compute_layout(LayoutContext *p_ctx, usize index) {
+  StructInfo *p_si = vec_at(p_ctx->p_schema->structs, index);
+  if (LAYOUT_DONE == p_ctx->states[index]) {
+    return p_si->has_layout;
+  }
+
+  p_ctx->states[index] = LAYOUT_ACTIVE;
+
+  bool has_layout = true;
+  usize offset = 0;
+  usize align = 1;
+
+  for (size_t i = 0; has_layout && i < vec_count(p_si->fields); ++i) {
+    VarInfo *p_field = p_si->fields + i;
+
+    TypeLayout layout;
+    has_layout = field_get_layout(p_ctx, &p_field->type_info, &layout);
+    if (has_layout) {
+      offset = align_up(offset, layout.align);
+      p_field->offset = (unsigned int)offset;
+      offset += layout.size;
+      if (layout.align > align) align = layout.align;
+    }
+  }
+
+  p_si->has_layout = has_layout;
+  p_si->align = has_layout ? align : 0;
+  p_si->size = has_layout ? align_up(offset, align) : 0;
+  p_ctx->states[index] = LAYOUT_DONE;
+
+  if (!has_layout) {
+    logf_trace("LAYOUT", "layout of struct " string_view_farg " is unknown\n", string_view_expand(p_si->name));
+  }
+  return has_layout;
+}
+
+bool schema_compute_layout(Schema *p_schema) {
+  assert(NULL != p_schema);
+
+  usize structs_count = vec_count(p_schema->structs);
+  LayoutContext ctx = {
+    .p_schema = p_schema,
+    .states = (u8*)calloc(0 == structs_count ? 1 : structs_count, sizeof(u8)),
+    .ok = true,
+  };
+  if (NULL == ctx.states) {
+    log_error("LAYOUT", "out of memory");
+    return false;
+  }
+
+  for (usize i = 0; ctx.ok && i < structs_count; ++i) {
+    (void)struct_compute_layout(&ctx, i);
+  }
+
+  free(ctx.states);
+  return ctx.ok;
+}
+
+bool type_info_get_layout(const Schema *p_schema, const TypeInfo *p_ti, TypeLayout *p_out) {
+  assert(NULL != p_schema);
+  assert(NULL != p_ti);
+  assert(NULL != p_out);
+
+  if (p_ti->pointer_info.indirections_count > 0) {
+    *p_out = (TypeLayout){ .size = LAYOUT_POINTER_SIZE, .align = LAYOUT_POINTER_SIZE };
+  } else if (TYPE_STRUCT != p_ti->base_type) {
+    if (!type_info_get_scalar_layout(p_ti, p_out)) return false;
+  } else {
+    isize index = schema_find_struct(p_schema, p_ti->struct_name);
+    if (index < 0 || !vec_at(p_schema->structs, index)->has_layout) {
+      return false;
+    }
+
+    const StructInfo *p_si = vec_at(p_schema->structs, index);
+    *p_out = (TypeLayout){ .size = p_si->size, .align = p_si->align };
+  }
+
+  return array_apply_layout(p_ti, p_out);
+}
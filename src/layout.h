@@ -0,0 +1,30 @@
+#ifndef __SERC_LAYOUT_H__
+#define __SERC_LAYOUT_H__
+
+#include "common.h"
+#include "parser.h"
+
+/// Size and alignment of a type. Layout follows the LP64 SysV ABIs
+/// of x86-64 and AArch64, which agree on every type the parser knows
+typedef struct {
+  usize size;
+  usize align;
+} TypeLayout;
+
+/// Computes size and alignment of every struct of the merged schema and offsets of their fields.
+/// Structs that contain (not point to) a struct missing from the schema are left without layout
+///
+/// @param p_schema: merged schema, see schema_merge
+/// @return bool, false if a struct contains itself
+bool schema_compute_layout(Schema *p_schema);
+
+/// Returns layout of the type, layouts of struct types are taken from p_schema,
+/// so schema_compute_layout has to be called first
+///
+/// @param p_schema: schema struct types are looked up in
+/// @param p_ti: type to get layout of
+/// @param p_out: layout of the type
+/// @return bool, false if layout of the type is unknown
+bool type_info_get_layout(const Schema *p_schema, const TypeInfo *p_ti, TypeLayout *p_out);
+
+#endif // !__SERC_LAYOUT_H__
@@ -1,10 +1,18 @@
 #include <errno.h>
+#include <limits.h>
 #include <dirent.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
 #include "parser.h"
 #include "code_gen.h"
+#include "layout.h"
+#include "thread_pool.h"
+#include "source.h"
+#include "source_graph.h"
+#include "cache.h"
+#include "watch.h"
 #include "./lib/ds/logger.h"
 #include "./lib/ds/vec.h"
 #include "./lib/ds/string_builder.h"
@@ -14,84 +22,18 @@
 
 LogSeverity g_log_severity = LOG_ALL;
 
+/// Only ds containers (vec, Table, StringBuilder) allocate from the ds allocator,
+/// schemas keep the rest in growable arenas released per source file on merge
+#ifndef SERC_DS_ALLOCATOR_SIZE
+#define SERC_DS_ALLOCATOR_SIZE (64 * 1024 * 1024)
+#endif
 
-char *get_file_content(const char *path) {
-  FILE *f = fopen(path, "r");
-  if (NULL == f) return NULL;
+/// Quiet period after a change before watch mode regenerates,
+/// so saving several files at once triggers a single run
+#ifndef SERC_WATCH_SETTLE_MS
+#define SERC_WATCH_SETTLE_MS 50
+#endif
 
-  char *content = NULL;
-  long size;
-  if (-1 == fseek(f, 0, SEEK_END) || -1 == (size = ftell(f))) {
-    goto cleanup_error;
-  }
-
-  content = (char*)a_allocate(size + 1);
-  if (NULL == content) {
-    goto cleanup_error;
-  }
-
-  rewind(f);
-
-  size_t bytes = 0;
-  while (bytes != (size_t)size) {
-    size_t read_bytes = fread(content + bytes, 1, size - bytes, f);
-    if (0 == read_bytes) {
-      goto cleanup_error;
-    }
-    bytes += read_bytes;
-  }
-  content[size] = '\0';
-
-  goto cleanup;
-
-cleanup_error:
-  a_free(content);
-  content = NULL;
-cleanup:
-  fclose(f);
-  return content;
-}
-
-
-int main(int argc, char **argv) {
-  if (argc < 2) {
-    log_error("MAIN", "please provide *.c file");
-    return 1;
-  }
-
-  allocator_init(1024 * 1024 * 1024);  // 1 GiB
-
-  char *content = get_file_content(argv[1]);
-  if (NULL == content) {
-    logf_error("PARSER", "error reading file %s: %s\n", argv[1], strerror(errno));
-    return 1;
-  }
-
-  vec(StructInfo) structs;
-  vec_alloc(structs);
-
-  bool ok = parse(content, &structs);
-  if (!ok) {
-    goto cleanup;
-  }
-
-  ok = generate_json_serialization((const vec(StructInfo) const *)&structs, NULL);
-  if (!ok) {
-    goto cleanup;
-  }
-
-
-cleanup:
-  for (size_t i = 0; i < vec_count(structs); ++i) {
-    struct_info_free(vec_at(structs, i));
-  }
-  vec_free(structs);
-  a_free(content);
-
-  allocator_finalize();
-
-  return !ok;
-}
 
 bool cstr_ends_with(const char *str, const char *suffix) {
     size_t strLen = strlen(str);
@@ -167,32 +109,459 @@ bool get_dir_files(const char *dir_path, const char *extension, vec(StringBuilde
   return true;
 }
 
-int main2(int argc, char **argv) {
-  if (argc < 2) {
-    log_error("MAIN", "please provide *.c file or directory with *.c files");
-    return 1;
+typedef struct {
+  Schema schema;
+  bool has_schema;
+  bool ok;
+
+  /// schema was moved into the merged one
+  bool is_merged;
+
+  /// schema of the unit for the next run, the blob points into the loaded cache on a hit
+  SchemaCacheEntry cache_entry;
+  bool owns_blob;
+} SourceUnit;
+
+typedef struct {
+  /// units[i] belongs to graph.nodes[i]
+  SourceUnit *units;
+
+  /// nodes of the level being parsed
+  SourceNode **nodes;
+
+  const SchemaCache *p_cache;
+  bool use_cache;
+} ParseContext;
+
+/// Initializes schema of the unit with typedefs of the files it includes,
+/// they are visible in the whole file
+static void init_unit_schema(const ParseContext *p_ctx, const SourceNode *p_node, SourceUnit *p_unit) {
+  ARENA_LOCKED(schema_init(&p_unit->schema));
+  p_unit->has_schema = true;
+
+  for (size_t i = 0; i < p_node->includes_count; ++i) {
+    const SourceNode *p_included = p_node->includes[i];
+    const SourceUnit *p_included_unit = p_ctx->units + p_included->index;
+
+    // files of the same or higher level close an include cycle, they are not parsed yet
+    if (p_included->level < p_node->level && p_included_unit->has_schema) {
+      schema_import(&p_unit->schema, &p_included_unit->schema);
+    }
+  }
+}
+
+/// Takes the schema of the unit from the cache if neither the source
+/// nor anything it includes has changed since the last run
+///
+/// @return bool, true on a cache hit
+static bool load_unit_from_cache(const ParseContext *p_ctx, const SourceNode *p_node, SourceUnit *p_unit) {
+  const SchemaBlob *p_blob = schema_cache_find(p_ctx->p_cache, p_node->real_path, p_node->key_hash);
+  if (NULL == p_blob) {
+    return false;
+  }
+
+  bool ok = false;
+  ARENA_LOCKED(ok = schema_deserialize(p_blob, &p_unit->schema));
+  if (!ok) {
+    logf_trace("CACHE", "cached schema of %s is corrupted\n", p_node->path);
+    ARENA_LOCKED(schema_free(&p_unit->schema));
+    init_unit_schema(p_ctx, p_node, p_unit);
+    return false;
+  }
+
+  p_unit->cache_entry.blob = *p_blob;
+  return true;
+}
+
+static void parse_unit_task(void *ctx, size_t index) {
+  const ParseContext *p_ctx = (const ParseContext*)ctx;
+  const SourceNode *p_node = p_ctx->nodes[index];
+  SourceUnit *p_unit = p_ctx->units + p_node->index;
+
+  if (!p_node->is_open) {
+    return;
   }
 
-  allocator_init(1024 * 1024 * 1024);  // 1 GiB
+  init_unit_schema(p_ctx, p_node, p_unit);
+
+  if (p_ctx->use_cache) {
+    p_unit->cache_entry.path = p_node->real_path;
+    p_unit->cache_entry.content_hash = p_node->key_hash;
+
+    if (load_unit_from_cache(p_ctx, p_node, p_unit)) {
+      p_unit->ok = true;
+      return;
+    }
+  }
+
+  // included headers are only looked into for typedefs, so they may hold anything
+  p_unit->ok = parse_schema(p_node->source.data, p_node->source.length, !p_node->is_input, &p_unit->schema);
+
+  if (p_unit->ok && p_ctx->use_cache) {
+    // a unit that fails to serialize is parsed again next time
+    p_unit->owns_blob = schema_serialize(&p_unit->schema, &p_unit->cache_entry.blob);
+  }
+}
+
+static int path_cmp(const void *lhs, const void *rhs) {
+  return strcmp(string_builder_get_cstr((const StringBuilder*)lhs),
+                string_builder_get_cstr((const StringBuilder*)rhs));
+}
+
+static void print_usage(const char *program) {
+  logf_error("MAIN", "usage: %s [-j <jobs>] [-o <output dir>] [-I <include dir>]... [--no-cache] [--schema <file>] "
+             "[--tables] [--graph] [--watch] <*.c/*.h file or directory>...\n", program);
+}
+
+/// Parsed command line
+typedef struct {
+  CodeGenOptions code_gen;
+  u64 code_gen_hash;
+
+  /// files and directories given on the command line
+  const char **inputs;
+  size_t inputs_count;
+
+  const char **include_dirs;
+  size_t include_dirs_count;
+
+  size_t jobs;
+  const char *schema_path;
+  const char *cache_path;
+  bool use_cache;
+  bool is_watching;
+} Options;
+
+/// Collects *.c and *.h files of the inputs, sorted,
+/// so output does not depend on the order of directory entries or on scheduling
+///
+/// @return bool, false if an input cannot be read
+static bool collect_paths(const Options *p_options, vec(StringBuilder) *p_paths) {
+  bool ok = true;
+
+  for (size_t i = 0; ok && i < p_options->inputs_count; ++i) {
+    const char *input = p_options->inputs[i];
+
+    struct stat st;
+    if (-1 == stat(input, &st)) {
+      logf_error("MAIN", "error reading %s: %s\n", input, strerror(errno));
+      ok = false;
+    } else if (S_ISDIR(st.st_mode)) {
+      if (!get_dir_files(input, ".h", p_paths) || !get_dir_files(input, ".c", p_paths)) {
+        logf_error("MAIN", "get_dir_files failed: %s\n", strerror(errno));
+        ok = false;
+      }
+    } else {
+      StringBuilder path; string_builder_init(path);
+      string_builder_append_cstr(&path, input);
+      vec_push(*p_paths, path);
+    }
+  }
+
+  qsort(*p_paths, vec_count(*p_paths), sizeof(StringBuilder), path_cmp);
+  return ok;
+}
+
+/// Watches directories of all files of the graph, so edits of included headers
+/// outside of the inputs are noticed too
+static void watch_source_dirs(Watcher *p_watcher, const SourceGraph *p_graph) {
+  for (size_t i = 0; i < p_graph->count; ++i) {
+    const char *real_path = p_graph->nodes[i]->real_path;
+    const char *p_slash = strrchr(real_path, '/');
+
+    char dir[PATH_MAX];
+    usize length = NULL == p_slash ? 0 : (usize)(p_slash - real_path);
+    if (length >= sizeof(dir)) continue;
+    memcpy(dir, real_path, length);
+    dir[length] = '\0';
+
+    if (!watcher_add_dir(p_watcher, 0 == length ? "/" : dir, false)) {
+      logf_trace("MAIN", "could not watch %s: %s\n", dir, strerror(errno));
+    }
+  }
+}
+
+/// Generates serialization for all inputs
+///
+/// @param p_options: parsed command line
+/// @param p_cache: schemas of the previous run, in watch mode replaced with schemas of this one
+/// @param p_pool: pool to open, parse and generate files on
+/// @param p_watcher: optional, directories of all files read are added to it
+/// @return bool, false on failure
+static bool generate(const Options *p_options, SchemaCache *p_cache, ThreadPool *p_pool, Watcher *p_watcher) {
+  bool ok = true;
 
   vec(StringBuilder) paths; vec_alloc(paths);
-  const char *extension = ".c";
-  bool ok = get_dir_files(argv[1], extension, &paths);
+  ok = collect_paths(p_options, &paths);
+  size_t inputs_count = vec_count(paths);
+
+  SourceGraph graph;
+  source_graph_init(&graph, p_options->include_dirs, p_options->include_dirs_count);
+
+  SourceNode **inputs = a_callocate(inputs_count, sizeof(SourceNode*));
+  for (size_t i = 0; ok && i < inputs_count; ++i) {
+    const char *path = string_builder_get_cstr(vec_at(paths, i));
+    inputs[i] = source_graph_add_input(&graph, path);
+    if (NULL == inputs[i]) {
+      logf_error("MAIN", "error reading %s: %s\n", path, strerror(errno));
+      ok = false;
+    }
+  }
 
-  if (!ok) {
-    logf_error("MAIN", "get_dir_files failed: %s\n", strerror(errno));
+  // the resident cache of watch mode is used even when the cache file is not
+  bool use_cache = p_options->use_cache || p_options->is_watching;
+  SourceUnit *units = NULL;
+
+  if (ok) {
+    ok = source_graph_load(&graph, p_pool);
+    units = a_callocate(graph.count, sizeof(SourceUnit));
+
+    // a file is parsed once, after all files it includes
+    ParseContext ctx = { .units = units, .p_cache = p_cache, .use_cache = use_cache };
+    for (size_t begin = 0; ok && begin < graph.count;) {
+      size_t end = begin;
+      while (end < graph.count && graph.nodes[end]->level == graph.nodes[begin]->level) ++end;
+
+      ctx.nodes = graph.nodes + begin;
+      thread_pool_run(p_pool, end - begin, parse_unit_task, &ctx);
+      begin = end;
+    }
   }
 
-  size_t paths_count = vec_count(paths);
-  logf_trace("MAIN", "%s consist of (filtered by extension '%s'):\n", argv[1], extension);
-  for (size_t i = 0; i < paths_count; ++i) {
-    logf_trace("MAIN", "\t\t%s\n", string_builder_get_cstr(vec_at(paths, i)));
-    string_builder_free(paths[i]);
+  if (NULL != p_watcher) {
+    watch_source_dirs(p_watcher, &graph);
+  }
+
+  Schema schema;
+  schema_init(&schema);
+
+  for (size_t i = 0; ok && i < inputs_count; ++i) {
+    SourceUnit *p_unit = units + inputs[i]->index;
+    if (p_unit->is_merged) {
+      continue; // the same file is passed twice
+    }
+
+    if (!p_unit->ok) {
+      logf_error("MAIN", "failed to parse %s\n", inputs[i]->path);
+      ok = false;
+      break;
+    }
+
+    ok = schema_merge(&schema, &p_unit->schema);
+    p_unit->is_merged = true;
+  }
+
+  if (ok) {
+    ok = schema_compute_layout(&schema);
   }
 
+  if (ok) {
+    ok = generate_json_serialization((const vec(StructInfo) const *)&schema.structs, &p_options->code_gen, p_pool);
+  }
+
+  if (ok && NULL != p_options->schema_path) {
+    ok = schema_file_write(p_options->schema_path, &schema);
+  }
+
+  schema_free(&schema);
+
+  if (ok && use_cache) {
+    SchemaCacheEntry *entries = a_callocate(graph.count, sizeof(SchemaCacheEntry));
+    size_t entries_count = 0;
+    for (size_t i = 0; i < graph.count; ++i) {
+      if (NULL != units[i].cache_entry.blob.data) entries[entries_count++] = units[i].cache_entry;
+    }
+
+    // failure to update the cache only slows down the next run
+    if (p_options->use_cache) {
+      (void)schema_cache_write(p_options->cache_path, p_options->code_gen_hash, entries, entries_count);
+    }
+    if (p_options->is_watching && !schema_cache_retain(p_cache, entries, entries_count)) {
+      log_error("MAIN", "out of memory, all files will be parsed again");
+      schema_cache_free(p_cache);
+      schema_cache_init(p_cache);
+    }
+    a_free(entries);
+  }
+
+  for (size_t i = 0; NULL != units && i < graph.count; ++i) {
+    if (units[i].has_schema && !units[i].is_merged) schema_free(&units[i].schema);
+    if (units[i].owns_blob) schema_blob_free(&units[i].cache_entry.blob);
+  }
+  for (size_t i = 0; i < inputs_count; ++i) {
+    string_builder_free(paths[i]);
+  }
+  if (NULL != units) a_free(units);
+  a_free(inputs);
   vec_free(paths);
-  //bool result = parse(argv[1]);
+  source_graph_free(&graph);
+
+  return ok;
+}
+
+/// Regenerates serialization whenever a source file changes, until an error
+///
+/// @return bool, false if changes can no longer be watched
+static bool watch(const Options *p_options, SchemaCache *p_cache, ThreadPool *p_pool) {
+  Watcher watcher;
+  if (!watcher_init(&watcher)) {
+    logf_error("MAIN", "could not start watching: %s\n", strerror(errno));
+    return false;
+  }
+
+  bool ok = true;
+  const char *outputs[] = { JSON_SOURCE_FILE_NAME, JSON_HEADER_FILE_NAME };
+
+  // generated files may be inside watched directories
+  for (size_t i = 0; ok && i < sizeof(outputs) / sizeof(*outputs); ++i) {
+    StringBuilder output; string_builder_init(output);
+    code_gen_output_path(&output, p_options->code_gen.path, outputs[i]);
+    if (!watcher_ignore(&watcher, string_builder_get_cstr(&output))) {
+      logf_error("MAIN", "could not resolve %s: %s\n", string_builder_get_cstr(&output), strerror(errno));
+      ok = false;
+    }
+    string_builder_free(output);
+  }
+
+  for (size_t i = 0; ok && i < p_options->inputs_count; ++i) {
+    struct stat st;
+    if (0 == stat(p_options->inputs[i], &st) && S_ISDIR(st.st_mode)
+      && !watcher_add_dir(&watcher, p_options->inputs[i], true)) {
+      logf_error("MAIN", "could not watch %s: %s\n", p_options->inputs[i], strerror(errno));
+      ok = false;
+    }
+  }
+
+  for (size_t i = 0; ok && i < p_options->include_dirs_count; ++i) {
+    if (!watcher_add_dir(&watcher, p_options->include_dirs[i], false)) {
+      logf_trace("MAIN", "could not watch %s: %s\n", p_options->include_dirs[i], strerror(errno));
+    }
+  }
+
+  while (ok) {
+    if (generate(p_options, p_cache, p_pool, &watcher)) {
+      logf_trace("MAIN", "serialization is up to date, watching for changes\n");
+    } else {
+      log_error("MAIN", "generation failed, watching for changes");
+    }
+
+    if (!watcher_wait(&watcher, SERC_WATCH_SETTLE_MS)) {
+      logf_error("MAIN", "could not watch for changes: %s\n", strerror(errno));
+      ok = false;
+    }
+  }
+
+  watcher_free(&watcher);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  allocator_init(SERC_DS_ALLOCATOR_SIZE);
+
+  bool ok = true;
+  Options options = {
+    .inputs = a_callocate(argc, sizeof(const char*)),
+    .include_dirs = a_callocate(argc, sizeof(const char*)),
+    .jobs = thread_pool_cpu_count(),
+    .use_cache = true,
+  };
+
+  for (int i = 1; ok && i < argc; ++i) {
+    if (0 == strcmp(argv[i], "-j")) {
+      if (i + 1 == argc || 0 == (options.jobs = strtoul(argv[++i], NULL, 10))) {
+        print_usage(argv[0]);
+        ok = false;
+      }
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "-o")) {
+      if (i + 1 == argc) {
+        print_usage(argv[0]);
+        ok = false;
+      } else {
+        options.code_gen.path = argv[++i];
+      }
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "-I")) {
+      if (i + 1 == argc) {
+        print_usage(argv[0]);
+        ok = false;
+      } else {
+        options.include_dirs[options.include_dirs_count++] = argv[++i];
+      }
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "--schema")) {
+      if (i + 1 == argc) {
+        print_usage(argv[0]);
+        ok = false;
+      } else {
+        options.schema_path = argv[++i];
+      }
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "--no-cache")) {
+      options.use_cache = false;
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "--tables")) {
+      options.code_gen.is_table_driven = true;
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "--graph")) {
+      options.code_gen.is_graph = true;
+      continue;
+    }
+
+    if (0 == strcmp(argv[i], "--watch")) {
+      options.is_watching = true;
+      continue;
+    }
+
+    options.inputs[options.inputs_count++] = argv[i];
+  }
+
+  options.code_gen_hash = code_gen_options_hash(&options.code_gen);
+  StringBuilder cache_path; string_builder_init(cache_path);
+  code_gen_output_path(&cache_path, options.code_gen.path, SCHEMA_CACHE_FILE_NAME);
+  options.cache_path = string_builder_get_cstr(&cache_path);
+
+  SchemaCache cache;
+  schema_cache_init(&cache);
+  if (ok && options.use_cache) {
+    schema_cache_load(&cache, options.cache_path, options.code_gen_hash);
+  }
+
+  ThreadPool pool;
+  if (ok && !thread_pool_init(&pool, options.jobs - 1)) {
+    log_error("MAIN", "could not start threads");
+    ok = false;
+  } else if (ok) {
+    ok = options.is_watching ? watch(&options, &cache, &pool) : generate(&options, &cache, &pool, NULL);
+    thread_pool_free(&pool);
+  }
+
+  schema_cache_free(&cache);
+  string_builder_free(cache_path);
+  a_free(options.inputs);
+  a_free(options.include_dirs);
+
+  ArenaUsage usage = arena_usage();
+  logf_trace("MAIN", "arenas: %zu bytes in use, %zu bytes at peak\n", usage.current, usage.peak);
 
   allocator_finalize();
-  return  !ok;
+
+  return !ok;
 }
@@ -1,48 +1,65 @@
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "scanner.h"
+#include "thread_pool.h"
 #include "./lib/ds/logger.h"
 
 #include "parser.h"
 
+#define MAX_TYPE_NAME_LENGTH 1024
 
-Parser parser;
 
-static void advance() {
-  parser.previous = parser.current;
-  parser.current = scan_token();
+/// Returns canonical view of the name, equal names share p_begin within a schema
+static StringView intern(Parser *p_parser, StringView name) {
+  Schema *p_schema = p_parser->p_schema;
+  return symbol_intern(&p_schema->symbols, &p_schema->arena, name)->name;
 }
 
-static bool check(TokenKind kind) {
-  return kind == parser.current.kind;
+static void advance(Parser *p_parser) {
+  p_parser->previous = p_parser->current;
+  p_parser->current = scan_token(&p_parser->scanner);
 }
 
-static bool match(TokenKind kind) {
-  if (!check(kind)) return false;
-  advance();
+static bool check(Parser *p_parser, TokenKind kind) {
+  return kind == p_parser->current.kind;
+}
+
+static bool match(Parser *p_parser, TokenKind kind) {
+  if (!check(p_parser, kind)) return false;
+  advance(p_parser);
   return true;
 }
 
 #define should_match(_kind)\
   do {\
-    if (!match((_kind))) {\
-      logf_error("PARSER", "Expected token kind %s, but got %s\n", \
-                 token_kind_to_cstr((_kind)), token_kind_to_cstr(parser.current.kind));\
+    if (!match(p_parser, (_kind))) {\
+      if (!p_parser->is_lenient) {\
+        logf_error("PARSER", "Expected token kind %s, but got %s\n", \
+                   token_kind_to_cstr((_kind)), token_kind_to_cstr(p_parser->current.kind));\
+      }\
       return false;\
     }\
   } while (0);
 
 #define should_be(_kind)\
   do {\
-    if (!check((_kind))) {\
-      logf_error("PARSER", "Expected token kind %s, but got %s\n", \
-                 token_kind_to_cstr((_kind)), token_kind_to_cstr(parser.current.kind));\
+    if (!check(p_parser, (_kind))) {\
+      if (!p_parser->is_lenient) {\
+        logf_error("PARSER", "Expected token kind %s, but got %s\n", \
+                   token_kind_to_cstr((_kind)), token_kind_to_cstr(p_parser->current.kind));\
+      }\
       return false;\
     }\
   } while (0);
 
 
-static void error_at(const Token *token, const char *message) {
+static void error_at(Parser *p_parser, const Token *token, const char *message) {
+  // lenient parser skips what it does not understand silently
+  if (p_parser->is_lenient) return;
+
   StringView at = TOK_EOF == token->kind 
                               ? string_view_from_cstr("end")
                               : token->lexeme;
@@ -51,22 +68,36 @@ static void error_at(const Token *token, const char *message) {
              token->line, string_view_expand(at), message);
 }
 
-static void error_at_current(const char *message) {
-  error_at(&parser.current, message);
+static void error_at_current(Parser *p_parser, const char *message) {
+  error_at(p_parser, &p_parser->current, message);
 }
 
 #define consume(token_kind, message)\
   do {\
-    if (parser.current.kind == (token_kind)) {\
-      advance();\
+    if (p_parser->current.kind == (token_kind)) {\
+      advance(p_parser);\
     } else {\
-      error_at_current(message);\
+      error_at_current(p_parser, message);\
       return false;\
     }\
   } while (0)
 
+/// Checks if sv is a C identifier, names from annotations become parts of generated names
+static bool is_identifier(StringView sv) {
+  if (0 == sv.length || (sv.p_begin[0] >= '0' && sv.p_begin[0] <= '9')) {
+    return false;
+  }
+
+  for (size_t i = 0; i < sv.length; ++i) {
+    char c = sv.p_begin[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || '_' == c)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-static bool process_annotation(const Token *annotation, AnnotationInfo *p_info) {
+static bool process_annotation(Parser *p_parser, const Token *annotation, AnnotationInfo *p_info) {
   assert(NULL != p_info);
 
   size_t len = annotation->lexeme.length;
@@ -91,7 +122,14 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
 
         if (string_view_equals(&word, &string_view_from_cstr("array"))) {
           p_info->kind = ANN_ARRAY;
-        } else if (ANN_ARRAY == p_info->kind && string_view_equals(&word, &string_view_from_cstr("size"))) {
+        } else if (string_view_equals(&word, &string_view_from_cstr("bytes"))) {
+          p_info->kind = ANN_BYTES;
+        } else if (ANN_BYTES == p_info->kind && string_view_equals(&word, &string_view_from_cstr("base64"))) {
+          p_info->as.annotation_bytes.encoding = BYTES_BASE64;
+        } else if (ANN_BYTES == p_info->kind && string_view_equals(&word, &string_view_from_cstr("hex"))) {
+          p_info->as.annotation_bytes.encoding = BYTES_HEX;
+        } else if ((ANN_ARRAY == p_info->kind || ANN_BYTES == p_info->kind)
+          && string_view_equals(&word, &string_view_from_cstr("size"))) {
 
           c = annotation->lexeme.p_begin[i];
           while (i < len && (c == ' ' || c == '\t')) {
@@ -107,12 +145,44 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
           }
 
           if (size_field_name_begin == annotation->lexeme.p_begin + i) {
-            error_at(annotation, "name of @size field should be non empty");
+            error_at(p_parser, annotation, "name of @size field should be non empty");
             return false;
           }
 
-          p_info->as.annotation_array.array_size_field_name = 
+          StringView size_field_name =
             string_view_from_cstr_slice(size_field_name_begin, 0, annotation->lexeme.p_begin + i - size_field_name_begin - (i < len));
+          if (ANN_BYTES == p_info->kind) {
+            p_info->as.annotation_bytes.size_field_name = size_field_name;
+          } else {
+            p_info->as.annotation_array.array_size_field_name = size_field_name;
+          }
+
+        } else if (string_view_equals(&word, &string_view_from_cstr("view"))) {
+          c = annotation->lexeme.p_begin[i];
+          while (i < len && (c == ' ' || c == '\t')) {
+            c = annotation->lexeme.p_begin[i];
+            ++i;
+          }
+
+          const char *view_name_begin = annotation->lexeme.p_begin + i;
+          c = annotation->lexeme.p_begin[i];
+          while (i < len && c != ' ' && c != '\t') {
+            c = annotation->lexeme.p_begin[i];
+            ++i;
+          }
+
+          StringView view_name =
+            string_view_from_cstr_slice(view_name_begin, 0, annotation->lexeme.p_begin + i - view_name_begin - (i < len));
+          if (!is_identifier(view_name)) {
+            error_at(p_parser, annotation, "name of @view should be an identifier");
+            return false;
+          }
+          if (MAX_FIELD_VIEWS == p_info->views_count) {
+            error_at(p_parser, annotation, "maximum number of views of a field has been exceeded");
+            return false;
+          }
+
+          p_info->views[p_info->views_count++] = view_name;
 
         } else if (string_view_equals(&word, &string_view_from_cstr("omit"))) {
           p_info->kind = ANN_OMIT;
@@ -133,7 +203,7 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
           }
 
           if (cb_ser_name == annotation->lexeme.p_begin + i) {
-            error_at(annotation, "name of @s (serialization function) should be non empty");
+            error_at(p_parser, annotation, "name of @s (serialization function) should be non empty");
             return false;
           }
 
@@ -155,7 +225,7 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
           }
 
           if (cb_deser_name == annotation->lexeme.p_begin + i) {
-            error_at(annotation, "name of @d (deserialization function) should be non empty");
+            error_at(p_parser, annotation, "name of @d (deserialization function) should be non empty");
             return false;
           }
 
@@ -163,7 +233,7 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
             string_view_from_cstr_slice(cb_deser_name , 0, annotation->lexeme.p_begin + i - cb_deser_name - (i < len));
 
         } else {
-          error_at(annotation, "unknown annotation keyword after '@'");
+          error_at(p_parser, annotation, "unknown annotation keyword after '@'");
           return false;
         }
       }
@@ -176,8 +246,8 @@ static bool process_annotation(const Token *annotation, AnnotationInfo *p_info)
 
 
 
-static bool validate_type_info(TypeInfo *p_info) {
-#define NOT_VALID(err_msg) do {error_at_current((err_msg)); return false;} while(0)
+static bool validate_type_info(Parser *p_parser, TypeInfo *p_info) {
+#define NOT_VALID(err_msg) do {error_at_current(p_parser, (err_msg)); return false;} while(0)
 
   assert(NULL != p_info);
 
@@ -203,21 +273,21 @@ static bool validate_type_info(TypeInfo *p_info) {
 #undef NOT_VALID
 }
 
-static bool parse_type_info(TypeInfo *p_info) {
+static bool parse_type_info(Parser *p_parser, TypeInfo *p_info) {
   assert(NULL != p_info);
 
 #define SET_BASE_TYPE(t) \
   do {\
     if (p_info->base_type != TYPE_UNINITIALIZED) {\
-      error_at_current("cannot combine with previous declaration");\
+      error_at_current(p_parser, "cannot combine with previous declaration");\
       return false;\
     }\
     p_info->base_type = (t);\
   } while (0)
 
 
-  while (!check(TOK_EOF)) {
-    switch (parser.current.kind) {
+  while (!check(p_parser, TOK_EOF)) {
+    switch (p_parser->current.kind) {
       case TOK_CHAR: SET_BASE_TYPE(TYPE_CHAR); break;
       case TOK_SHORT: SET_BASE_TYPE(TYPE_SHORT); break;
       case TOK_INT: SET_BASE_TYPE(TYPE_INT); break;
@@ -227,9 +297,9 @@ static bool parse_type_info(TypeInfo *p_info) {
 
       case TOK_STRUCT: {
         SET_BASE_TYPE(TYPE_STRUCT); 
-        advance();
+        advance(p_parser);
         should_be(TOK_IDENTIFIER);
-        p_info->struct_name = parser.current.lexeme;
+        p_info->struct_name = intern(p_parser, p_parser->current.lexeme);
         break; 
       }
 
@@ -243,7 +313,7 @@ static bool parse_type_info(TypeInfo *p_info) {
       }
 
       case TOK_CONST: {
-        if (parser.previous.kind == TOK_STAR) {
+        if (p_parser->previous.kind == TOK_STAR) {
           p_info->pointer_info.is_const[p_info->pointer_info.indirections_count - 1] = true;
           break;
         }
@@ -254,7 +324,7 @@ static bool parse_type_info(TypeInfo *p_info) {
 
       case TOK_STAR: {
         if (p_info->pointer_info.indirections_count++ == MAX_INDERECTION_LEVEL) {
-          error_at_current("maximum level of indirection has been exceeded");
+          error_at_current(p_parser, "maximum level of indirection has been exceeded");
           return false;
         }
         break;
@@ -262,65 +332,129 @@ static bool parse_type_info(TypeInfo *p_info) {
 
 
       case TOK_IDENTIFIER: {
-        if (parser.current.lexeme.length >= 1024) {
-          error_at_current("Type name is too long.");
-          return false;
-        }
-
-        char buff[1024] = {0};
-        strncpy(buff, parser.current.lexeme.p_begin, parser.current.lexeme.length);
-
-        TypeInfo *tmp = NULL;
-        if (table_get(&parser.typedefs, buff, (void**)&tmp)) {
-          *p_info = *tmp;
+        const Symbol *p_symbol = symbol_find(&p_parser->p_schema->symbols, p_parser->current.lexeme);
+        if (NULL != p_symbol && NULL != p_symbol->p_typedef) {
+          *p_info = *(const TypeInfo*)p_symbol->p_typedef;
           break; // continue parsing the rest of the type
         }
 
         if (TYPE_UNINITIALIZED == p_info->base_type && p_info->longness > 0) p_info->base_type = TYPE_INT;
-        return validate_type_info(p_info);
+        return validate_type_info(p_parser, p_info);
       }
 
       case TOK_ANNOTATION: break; // probably commented out annotation
 
       default:
-        error_at_current("expect type");
+        error_at_current(p_parser, "expect type");
         return false;
     }
 
-    advance();
+    advance(p_parser);
   }
 
-  error_at_current("unexpeted end of file");
+  error_at_current(p_parser, "unexpeted end of file");
   return false;
 
 #undef SET_BASE_TYPE
 }
 
-static bool handle_struct_body(StructInfo *out) {
+/// Parses array declarators ([N][M]...) after the declared name into p_info,
+/// dimensions of an array typedef p_info may already have become inner ones
+static bool parse_array_dims(Parser *p_parser, TypeInfo *p_info) {
+  u32 dims[MAX_ARRAY_DIMENSIONS];
+  unsigned int dims_count = 0;
+
+  while (match(p_parser, TOK_LEFT_BRACKET)) {
+    if (!check(p_parser, TOK_NUMBER)) {
+      error_at_current(p_parser, "array size must be an integer literal");
+      return false;
+    }
+
+    char literal[32] = {0};
+    StringView lexeme = p_parser->current.lexeme;
+    char *end = literal;
+    unsigned long long dim = 0;
+    if (lexeme.length < sizeof(literal)) {
+      memcpy(literal, lexeme.p_begin, lexeme.length);
+      errno = 0;
+      dim = strtoull(literal, &end, 0);
+    }
+    // only integer suffixes may follow the digits
+    while ('u' == *end || 'U' == *end || 'l' == *end || 'L' == *end) ++end;
+
+    if ('\0' != *end || 0 != errno || 0 == dim || dim > UINT32_MAX) {
+      error_at_current(p_parser, "invalid array size");
+      return false;
+    }
+    if (dims_count + p_info->array_info.dims_count == MAX_ARRAY_DIMENSIONS) {
+      error_at_current(p_parser, "maximum number of array dimensions has been exceeded");
+      return false;
+    }
+    dims[dims_count++] = (u32)dim;
+
+    advance(p_parser);
+    consume(TOK_RIGHT_BRACKET, "expect ']'");
+  }
+
+  ArrayInfo *p_array = &p_info->array_info;
+  memmove(p_array->dims + dims_count, p_array->dims, p_array->dims_count * sizeof(u32));
+  memcpy(p_array->dims, dims, dims_count * sizeof(u32));
+  p_array->dims_count += dims_count;
+
+  return true;
+}
+
+/// Applies annotation written right after '{' of the struct.
+/// Anything but struct annotations is left alone, it may be a commented out field with its annotation
+///
+/// @return bool, true if the annotation is applied
+static bool process_struct_annotation(const Token *annotation, StructInfo *out) {
+  StringView sv = annotation->lexeme;
+  while (sv.length > 0 && (' ' == sv.p_begin[0] || '\t' == sv.p_begin[0])) {
+    ++sv.p_begin;
+    --sv.length;
+  }
+  while (sv.length > 0 && (' ' == sv.p_begin[sv.length - 1] || '\t' == sv.p_begin[sv.length - 1])) {
+    --sv.length;
+  }
+
+  if (string_view_equals(&sv, &string_view_from_cstr("@incremental"))) {
+    out->is_incremental = true;
+    return true;
+  }
+  return false;
+}
+
+static bool handle_struct_body(Parser *p_parser, StructInfo *out) {
   assert(NULL != out);
 
-  unsigned int offset = 0;
+  if (check(p_parser, TOK_ANNOTATION) && process_struct_annotation(&p_parser->current, out)) {
+    advance(p_parser);
+  }
 
-  while (!check(TOK_EOF) && !check(TOK_RIGHT_BRACE)) {
+  while (!check(p_parser, TOK_EOF) && !check(p_parser, TOK_RIGHT_BRACE)) {
     VarInfo var_info = {0};
-    if (!parse_type_info(&var_info.type_info)) {
+    if (!parse_type_info(p_parser, &var_info.type_info)) {
       return false;
     }
 
-    var_info.name = parser.current.lexeme;
-    var_info.offset = offset;
-    offset += type_info_get_size(&var_info.type_info);
+    var_info.name = p_parser->current.lexeme;
 
-    advance();
+    advance(p_parser);
+    if (!parse_array_dims(p_parser, &var_info.type_info)) {
+      return false;
+    }
     consume(TOK_SEMICOLON, "expect ';'");
 
-    if (check(TOK_ANNOTATION)) {
-      logf_trace("PARSER", "annotation %.*s\n", string_view_expand(parser.current.lexeme));
-      process_annotation(&parser.current, &var_info.type_info.ann_info);
-      advance();
+    if (check(p_parser, TOK_ANNOTATION)) {
+      logf_trace("PARSER", "annotation %.*s\n", string_view_expand(p_parser->current.lexeme));
+      if (!process_annotation(p_parser, &p_parser->current, &var_info.type_info.ann_info)) {
+        return false;
+      }
+      advance(p_parser);
     }
 
-    vec_push(out->fields, var_info);
+    ARENA_LOCKED(vec_push(out->fields, var_info));
 
     // {
     //   // logging
@@ -332,7 +466,7 @@ static bool handle_struct_body(StructInfo *out) {
     //   logf_trace("PARSER", 
     //              "symbol " string_view_farg " with offset %d "
     //              " %shas base type " string_view_farg ", %slongness %d%s\n",
-    //              string_view_expand(parser.current.lexeme), var_info.offset,
+    //              string_view_expand(p_parser->current.lexeme), var_info.offset,
     //              var_info.type_info.is_const ? "is const, " : "",
     //              string_view_expand(base_type),
     //              var_info.type_info.pointer_info.indirections_count > 0 ? "is pointer, " : "",
@@ -351,46 +485,46 @@ static bool handle_struct_body(StructInfo *out) {
   return true;
 }
 
-static bool handle_struct_definition(vec(StructInfo) *out) {
+static bool handle_struct_definition(Parser *p_parser, vec(StructInfo) *out) {
   assert(NULL != out);
-  advance();
-  if (match(TOK_EOF)) {
-    error_at_current("unexpeted end of file");
+  advance(p_parser);
+  if (match(p_parser, TOK_EOF)) {
+    error_at_current(p_parser, "unexpeted end of file");
     return false;
   }
 
   StringView struct_name = string_view_from_cstr("<anonymous>");
 
-  if (!match(TOK_IDENTIFIER)) {
+  if (!match(p_parser, TOK_IDENTIFIER)) {
     should_match(TOK_LEFT_BRACE);
   } else {
-    struct_name = parser.previous.lexeme;
-    if (!match(TOK_LEFT_BRACE)) {
+    struct_name = intern(p_parser, p_parser->previous.lexeme);
+    if (!match(p_parser, TOK_LEFT_BRACE)) {
       return true; // not a struct definition
     }
   }
 
   StructInfo struct_info;
-  struct_info_init(struct_info);
+  ARENA_LOCKED(struct_info_init(struct_info));
   logf_trace("PARSER", "====struct " string_view_farg " begin====\n", string_view_expand(struct_name));
-  bool ok = handle_struct_body(&struct_info);
+  bool ok = handle_struct_body(p_parser, &struct_info);
   // logf_trace("PARSER", "====struct " string_view_farg " end====\n", string_view_expand(struct_name));
 
   if (!ok) {
-    struct_info_free(&struct_info);
+    ARENA_LOCKED(struct_info_free(&struct_info));
     return false;
   }
 
   struct_info.name = struct_name;
-  vec_push(*out, struct_info);
+  ARENA_LOCKED(vec_push(*out, struct_info));
   return true;
 }
 
-static bool parse_iteration(vec(StructInfo) *out) {
-  switch (parser.current.kind) {
+static bool parse_iteration(Parser *p_parser, vec(StructInfo) *out) {
+  switch (p_parser->current.kind) {
     case TOK_STRUCT: {
       size_t out_count = vec_count(*out);
-      if (!handle_struct_definition(out)) {
+      if (!handle_struct_definition(p_parser, out)) {
         return false;
       } 
       if (out_count < vec_count(*out)) { // if it was a struct definition
@@ -400,71 +534,303 @@ static bool parse_iteration(vec(StructInfo) *out) {
     }
 
     case TOK_TYPEDEF: {
-      advance();
-      TypeInfo *p_ti = a_callocate(1, sizeof(TypeInfo));
+      advance(p_parser);
+      TypeInfo type_info = {0};
 
-      if (TOK_STRUCT == parser.current.kind) {
-        if (!handle_struct_definition(out)) {
-          a_free(p_ti);
+      if (TOK_STRUCT == p_parser->current.kind) {
+        size_t out_count = vec_count(*out);
+        if (!handle_struct_definition(p_parser, out)) {
           return false;
         } 
 
-        StructInfo *p_si = vec_back(*out);
-        p_ti->struct_name = p_si->name;
-        p_ti->base_type = TYPE_STRUCT;
+        if (out_count < vec_count(*out)) {
+          StructInfo *p_si = vec_back(*out);
+          type_info.struct_name = p_si->name;
+        } else { // typedef of a struct declared elsewhere
+          type_info.struct_name = intern(p_parser, p_parser->previous.lexeme);
+        }
+        type_info.base_type = TYPE_STRUCT;
       } else {
-        if (!parse_type_info(p_ti)) {
-          a_free(p_ti);
+        if (!parse_type_info(p_parser, &type_info)) {
           return false;
         }
       }
 
-      char *key = a_callocate(parser.current.lexeme.length, sizeof(char));
-      strncpy(key, parser.current.lexeme.p_begin, parser.current.lexeme.length);
-      if (!table_set(&parser.typedefs, key, p_ti)) {
-        // TODO:
-        log_error("PARSER", "Current implementation does not support not unique typedefs even in different source files.");
-        a_free(p_ti);
-        a_free(key);
+      StringView name = p_parser->current.lexeme;
+      if (name.length >= MAX_TYPE_NAME_LENGTH) {
+        error_at_current(p_parser, "Type name is too long.");
+        return false;
+      }
+
+      Token name_token = p_parser->current;
+      advance(p_parser);
+      if (!parse_array_dims(p_parser, &type_info)) {
+        return false;
+      }
+
+      bool is_unique = false;
+      ARENA_LOCKED(is_unique = schema_add_typedef(p_parser->p_schema, name, &type_info));
+
+      if (!is_unique) {
+        error_at(p_parser, &name_token, "conflicting definition of typedef.");
         return false;
       }
 
-      advance();
       consume(TOK_SEMICOLON, "expect ';' after typedef");
       break;
     }
 
-    default: advance();
+    case TOK_LEFT_BRACE: {
+      // function body or initializer, nothing of interest is inside;
+      // braces after anything else may come from macros, they are scanned token by token
+      bool is_body = TOK_RIGHT_PAREN == p_parser->previous.kind
+        || (TOK_OTHER == p_parser->previous.kind && '=' == *p_parser->previous.lexeme.p_begin);
+
+      if (is_body) {
+        scanner_skip_block(&p_parser->scanner);
+      }
+      advance(p_parser);
+      break;
+    }
+
+    default: advance(p_parser);
   }
 
   return true;
 }
 
-static bool typedefs_key_cmp(const char *lhs, const char *rhs) {
-  return 0 == strcmp(lhs, rhs);
+void schema_init(Schema *p_schema) {
+  assert(NULL != p_schema);
+  vec_alloc(p_schema->structs);
+  vec_alloc(p_schema->typedefs);
+  symbol_table_init(&p_schema->symbols);
+  p_schema->structs_indexed = 0;
+  arena_init(&p_schema->arena, 0);
 }
 
-static void typedefs_free_cb(char *key, TypeInfo *value) {
-  a_free(key);
-  a_free(value);
+void schema_free(Schema *p_schema) {
+  assert(NULL != p_schema);
+
+  for (size_t i = 0; i < vec_count(p_schema->structs); ++i) {
+    struct_info_free(vec_at(p_schema->structs, i));
+  }
+  vec_free(p_schema->structs);
+
+  vec_free(p_schema->typedefs);
+
+  symbol_table_free(&p_schema->symbols);
+  arena_free(&p_schema->arena);
 }
 
-bool parse(const char *source, vec(StructInfo) *out) {
-  // TODO: parser initialization and destruction
-  bool ret = true;
-  scanner_init(source);
-  table_init(&parser.typedefs, hash_cstr_default, 
-             (KeyCmpFunc)typedefs_key_cmp, (FreeKeyValFunc)typedefs_free_cb);
-  advance();
-
-  do {
-    if (!parse_iteration(out)) {
-      ret = false;
-      break;
+static bool type_info_equals(const TypeInfo *lhs, const TypeInfo *rhs);
+
+bool schema_add_typedef(Schema *p_schema, StringView name, const TypeInfo *p_ti) {
+  assert(NULL != p_schema);
+  assert(NULL != p_ti);
+
+  Symbol *p_symbol = symbol_intern(&p_schema->symbols, &p_schema->arena, name);
+  if (NULL != p_symbol->p_typedef) {
+    // e.g. the same typedef in an included header
+    return type_info_equals(p_symbol->p_typedef, p_ti);
+  }
+
+  TypeInfo *p_copy = arena_alloc(&p_schema->arena, sizeof(TypeInfo));
+  if (NULL == p_copy) {
+    logf_fatal("PARSER", 1, "out of memory\n");
+  }
+  *p_copy = *p_ti;
+  p_symbol->p_typedef = p_copy;
+
+  vec_push(p_schema->typedefs, ((TypedefInfo){ .name = p_symbol->name, .p_type_info = p_copy }));
+  return true;
+}
+
+static bool type_info_equals(const TypeInfo *lhs, const TypeInfo *rhs) {
+  if (lhs->base_type != rhs->base_type
+    || lhs->longness != rhs->longness
+    || lhs->is_const != rhs->is_const
+    || lhs->is_unsigned != rhs->is_unsigned
+    || lhs->pointer_info.indirections_count != rhs->pointer_info.indirections_count
+    || lhs->array_info.dims_count != rhs->array_info.dims_count
+    || lhs->ann_info.kind != rhs->ann_info.kind) {
+    return false;
+  }
+
+  for (unsigned int i = 0; i < lhs->array_info.dims_count; ++i) {
+    if (lhs->array_info.dims[i] != rhs->array_info.dims[i]) return false;
+  }
+
+  if (TYPE_STRUCT == lhs->base_type && !string_view_equals(&lhs->struct_name, &rhs->struct_name)) {
+    return false;
+  }
+
+  for (unsigned int i = 0; i < lhs->pointer_info.indirections_count; ++i) {
+    if (lhs->pointer_info.is_const[i] != rhs->pointer_info.is_const[i]) return false;
+  }
+
+  if (lhs->ann_info.views_count != rhs->ann_info.views_count) {
+    return false;
+  }
+  for (unsigned int i = 0; i < lhs->ann_info.views_count; ++i) {
+    if (!string_view_equals(&lhs->ann_info.views[i], &rhs->ann_info.views[i])) return false;
+  }
+
+  switch (lhs->ann_info.kind) {
+    case ANN_ARRAY:
+      return string_view_equals(&lhs->ann_info.as.annotation_array.array_size_field_name,
+                                &rhs->ann_info.as.annotation_array.array_size_field_name);
+    case ANN_BYTES:
+      return lhs->ann_info.as.annotation_bytes.encoding == rhs->ann_info.as.annotation_bytes.encoding
+        && string_view_equals(&lhs->ann_info.as.annotation_bytes.size_field_name,
+                              &rhs->ann_info.as.annotation_bytes.size_field_name);
+    case ANN_CUSTOM_CALLBACK:
+      return string_view_equals(&lhs->ann_info.as.annotation_custom_callback.cb_ser_name,
+                                &rhs->ann_info.as.annotation_custom_callback.cb_ser_name)
+        && string_view_equals(&lhs->ann_info.as.annotation_custom_callback.cb_deser_name,
+                              &rhs->ann_info.as.annotation_custom_callback.cb_deser_name);
+    default:
+      return true;
+  }
+}
+
+static bool struct_info_equals(const StructInfo *lhs, const StructInfo *rhs) {
+  if (vec_count(lhs->fields) != vec_count(rhs->fields) || lhs->is_incremental != rhs->is_incremental) {
+    return false;
+  }
+
+  for (size_t i = 0; i < vec_count(lhs->fields); ++i) {
+    if (!string_view_equals(&lhs->fields[i].name, &rhs->fields[i].name)
+      || !type_info_equals(&lhs->fields[i].type_info, &rhs->fields[i].type_info)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool struct_is_anonymous(const StructInfo *p_si) {
+  StringView anonymous = string_view_from_cstr("<anonymous>");
+  return string_view_equals(&p_si->name, &anonymous);
+}
+
+bool schema_merge(Schema *p_dst, Schema *p_src) {
+  assert(NULL != p_dst);
+  assert(NULL != p_src);
+
+  bool ok = true;
+
+  for (size_t i = 0; i < vec_count(p_src->typedefs); ++i) {
+    TypedefInfo td = p_src->typedefs[i];
+
+    const Symbol *p_symbol = symbol_find(&p_dst->symbols, td.name);
+    if (NULL != p_symbol && NULL != p_symbol->p_typedef) {
+      if (!type_info_equals(p_symbol->p_typedef, td.p_type_info)) {
+        logf_error("PARSER", "conflicting definitions of typedef " string_view_farg "\n",
+                   string_view_expand(td.name));
+        ok = false;
+      }
+      continue;
+    }
+
+    schema_add_typedef(p_dst, td.name, td.p_type_info);
+  }
+
+  // index structs that came to p_dst not through merge
+  for (; p_dst->structs_indexed < vec_count(p_dst->structs); ++p_dst->structs_indexed) {
+    const StructInfo *p_si = vec_at(p_dst->structs, p_dst->structs_indexed);
+    if (struct_is_anonymous(p_si)) continue;
+
+    Symbol *p_symbol = symbol_intern(&p_dst->symbols, &p_dst->arena, p_si->name);
+    if (0 == p_symbol->struct_index) {
+      p_symbol->struct_index = p_dst->structs_indexed + 1;
+    }
+  }
+
+  for (size_t i = 0; i < vec_count(p_src->structs); ++i) {
+    StructInfo *p_si = vec_at(p_src->structs, i);
+
+    if (!struct_is_anonymous(p_si)) {
+      Symbol *p_symbol = symbol_intern(&p_dst->symbols, &p_dst->arena, p_si->name);
+      if (0 != p_symbol->struct_index) {
+        if (!struct_info_equals(vec_at(p_dst->structs, p_symbol->struct_index - 1), p_si)) {
+          logf_error("PARSER", "conflicting definitions of struct " string_view_farg "\n",
+                     string_view_expand(p_si->name));
+          ok = false;
+        }
+        struct_info_free(p_si);
+        continue;
+      }
+
+      p_symbol->struct_index = vec_count(p_dst->structs) + 1;
+    }
+
+    vec_push(p_dst->structs, *p_si);
+    p_dst->structs_indexed = vec_count(p_dst->structs);
+  }
+
+  vec_free(p_src->structs);
+  vec_free(p_src->typedefs);
+  symbol_table_free(&p_src->symbols);
+  arena_free(&p_src->arena);
+
+  return ok;
+}
+
+void schema_import(Schema *p_dst, const Schema *p_src) {
+  assert(NULL != p_dst);
+  assert(NULL != p_src);
+
+  const SymbolTable *p_symbols = &p_src->symbols;
+  for (usize i = 0; i < p_symbols->capacity; ++i) {
+    const Symbol *p_src_symbol = p_symbols->slots[i];
+    if (NULL == p_src_symbol || NULL == p_src_symbol->p_typedef) continue;
+
+    Symbol *p_symbol = symbol_intern(&p_dst->symbols, &p_dst->arena, p_src_symbol->name);
+    if (NULL == p_symbol->p_typedef) {
+      p_symbol->p_typedef = p_src_symbol->p_typedef;
+    }
+  }
+}
+
+/// Skips tokens up to and including the next ';' after a parse error
+static void synchronize(Parser *p_parser) {
+  while (!check(p_parser, TOK_EOF) && !match(p_parser, TOK_SEMICOLON)) {
+    advance(p_parser);
+  }
+}
+
+bool parse_schema(const char *source, size_t length, bool is_lenient, Schema *p_out) {
+  assert(NULL != source);
+  assert(NULL != p_out);
+
+  Parser parser = { .p_schema = p_out, .is_lenient = is_lenient };
+  scanner_init(&parser.scanner, source, length);
+  advance(&parser);
+
+  while (parser.current.kind != TOK_EOF) {
+    if (!parse_iteration(&parser, &p_out->structs)) {
+      if (!is_lenient) {
+        return false;
+      }
+      synchronize(&parser);
     }
-  } while (parser.current.kind != TOK_EOF);
+  }
+
+  return true;
+}
+
+bool parse(const char *source, vec(StructInfo) *out) {
+  Schema schema;
+  schema_init(&schema);
+
+  bool ret = parse_schema(source, strlen(source), false, &schema);
+
+  for (size_t i = 0; i < vec_count(schema.structs); ++i) {
+    vec_push(*out, schema.structs[i]);
+  }
+  vec_count(schema.structs) = 0;
+  schema_free(&schema);
 
-  table_free(&parser.typedefs);
   return ret;
 }
 
@@ -482,27 +848,3 @@ const char* base_type_to_cstr(BaseType t) {
     default: return "<unknown base type>";
   }
 }
-
-
-size_t type_info_get_size(const TypeInfo *p_ti) {
-  assert(NULL != p_ti);
-  assert(TYPE_UNINITIALIZED != p_ti->base_type);
-
-  if (p_ti->pointer_info.indirections_count > 0) return sizeof(void*);
-
-  if (TYPE_STRUCT == p_ti->base_type) return 0;
-
-  if (0 == p_ti->longness) {
-    switch (p_ti->base_type) {
-      case TYPE_CHAR: return sizeof(char);
-      case TYPE_SHORT: return sizeof(short);
-      case TYPE_INT: return sizeof(int);
-      case TYPE_FLOAT: return sizeof(float);
-      case TYPE_DOUBLE: return sizeof(double);
-
-      default: break;
-    }
-  }
-
-  return 0;
-}
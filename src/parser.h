@@ -3,16 +3,12 @@
 
 #include "common.h"
 #include "token.h"
+#include "scanner.h"
+#include "arena.h"
+#include "symbol.h"
 #include "./lib/ds/vec.h"
-#include "./lib/ds/table.h"
 #include "./serialization/primitives.h"
 
-typedef struct {
-  Token current;
-  Token previous;
-  Table typedefs;
-} Parser;
-
 // Enum to represent the base types
 typedef enum {
   TYPE_UNINITIALIZED = 0,
@@ -36,11 +32,20 @@ typedef struct {
   unsigned int indirections_count;
 } PointerInfo;
 
+#define MAX_ARRAY_DIMENSIONS 4
+
+// Struct representing dimensions of fixed-size array (T x[N][M]), outermost first
+typedef struct {
+  u32 dims[MAX_ARRAY_DIMENSIONS];
+  unsigned int dims_count;
+} ArrayInfo;
+
 typedef enum {
   ANN_EMPTY,
   ANN_ARRAY,
   ANN_CUSTOM_CALLBACK,
   ANN_OMIT,
+  ANN_BYTES,
 } AnnotationKind;
 
 // typedef bool (*AnnCallbackSer)(Serializer *p_ser, const void *value);
@@ -55,12 +60,33 @@ typedef struct {
   StringView cb_deser_name;
 } AnnotationCustomCallback;
 
+// Text encoding of @bytes fields
+typedef enum {
+  BYTES_BASE64,
+  BYTES_HEX,
+} BytesEncoding;
+
+// Raw byte buffer written as one string (`@bytes @size n @base64`),
+// fixed-size arrays of char take the size from the declaration
+typedef struct {
+  StringView size_field_name;
+  BytesEncoding encoding;
+} AnnotationBytes;
+
+#define MAX_FIELD_VIEWS 8
+
 typedef struct {
   AnnotationKind kind;
   union {
     AnnotationArray annotation_array;
     AnnotationCustomCallback annotation_custom_callback;
+    AnnotationBytes annotation_bytes;
   } as;
+
+  /// names of projections the field is part of (`@view <name>`),
+  /// every projection gets its own serializer_<T>_<name>_to_json
+  StringView views[MAX_FIELD_VIEWS];
+  unsigned int views_count;
 } AnnotationInfo;
 
 // Struct representing type information
@@ -68,6 +94,7 @@ typedef struct {
   AnnotationInfo ann_info;
   StringView struct_name; 
   PointerInfo pointer_info; 
+  ArrayInfo array_info;
   BaseType base_type;
   unsigned int longness; // number of long modifiers
   bool is_const;            
@@ -77,20 +104,90 @@ typedef struct {
 typedef struct {
   StringView name;
   TypeInfo type_info;
+
+  /// offset in bytes from the beginning of the struct, see schema_compute_layout
   unsigned int offset;
 } VarInfo;
 
 typedef struct {
   StringView name;
   vec(VarInfo) fields;
+
+  /// `@incremental` after '{': fragments of serialized fields are cached between serializations
+  bool is_incremental;
+
+  /// set by schema_compute_layout, offsets of fields are valid only if has_layout
+  usize size;
+  usize align;
+  bool has_layout;
 } StructInfo;
 
-#define struct_info_init(si) do { (si).name = (StringView){0}; vec_alloc((si).fields); } while (0)
+#define struct_info_init(si) do { (si) = (StructInfo){0}; vec_alloc((si).fields); } while (0)
 #define struct_info_free(p_si) do { (p_si)->name = (StringView){0}; vec_free((p_si)->fields); } while (0)
 
+typedef struct {
+  StringView name;
+  TypeInfo *p_type_info;
+} TypedefInfo;
+
+/// Structs and typedefs of one or more translation units
+typedef struct {
+  vec(StructInfo) structs;
+
+  /// TypeInfo of typedefs are owned by arena
+  vec(TypedefInfo) typedefs;
+
+  /// names of structs and typedefs, Symbol.p_typedef is TypeInfo*,
+  /// Symbol.struct_index is filled by schema_merge
+  SymbolTable symbols;
+  size_t structs_indexed;
+
+  /// owns symbols and TypeInfo of typedefs,
+  /// released at once when the schema is freed or merged
+  Arena arena;
+} Schema;
+
+typedef struct {
+  Scanner scanner;
+  Token current;
+  Token previous;
+  Schema *p_schema;
+
+  /// errors are not reported, the parser skips to the next ';' and goes on
+  bool is_lenient;
+} Parser;
+
+void schema_init(Schema *p_schema);
+void schema_free(Schema *p_schema);
+
+/// Adds typedef of *p_ti named name to the schema, *p_ti is copied.
+/// Callers running in parallel hold the arena lock
+///
+/// @return bool, false if a different typedef with the same name exists
+bool schema_add_typedef(Schema *p_schema, StringView name, const TypeInfo *p_ti);
+
+/// Moves structs and typedefs of p_src to p_dst in order, definitions already present
+/// in p_dst are deduplicated, conflicting ones are reported.
+/// p_src is freed even on failure
+///
+/// @return bool, false if any definition conflicts
+bool schema_merge(Schema *p_dst, Schema *p_src);
+
+/// Makes typedefs visible in p_src (its own and imported) visible in p_dst.
+/// TypeInfo is shared, not copied, so p_src has to outlive parsing into p_dst.
+/// Typedefs already visible in p_dst are kept
+void schema_import(Schema *p_dst, const Schema *p_src);
+
+/// Parses source of length bytes (no NUL terminator needed) into p_out,
+/// StringViews of the schema point into source
+///
+/// @param is_lenient: skip declarations that cannot be parsed without reporting them,
+///   used for headers that are only looked into for typedefs
+/// @return bool, false on the first error if not lenient
+bool parse_schema(const char *source, size_t length, bool is_lenient, Schema *p_out);
+
 bool parse(const char *source, vec(StructInfo) *out);
 const char* base_type_to_cstr(BaseType t);
-size_t type_info_get_size(const TypeInfo *p_ti);
 
 
 #endif // !__SERC_PARSER_H__
@@ -5,30 +5,15 @@
 #include "scanner.h"
 #include "./lib/ds/logger.h"
 
-/// Represent the source code scanner
-typedef struct {
-  /// Pointer to the beginning of the token that is currently being parsed
-  const char *start;
-
-  /// Pointer to the current location in source code 
-  const char *current;
-
-  /// Number of the current line in source file
-  i32 line;
-} Scanner;
-
-/// scanner singleton
-Scanner scanner;
-
-/// Checks if current position is at the end of the sequence ('\0')
+/// Checks if current position is at the end of the source
 ///
 /// @return bool, true if at the end
-static bool is_at_end();
+static bool is_at_end(Scanner *p_scanner);
 
-/// Advances current position by one
+/// Advances current position by one, does nothing at the end of the source
 ///
-/// @return char, character at the position before advance
-static char advance();
+/// @return char, character at the position before advance or '\0' at the end
+static char advance(Scanner *p_scanner);
 
 /// Creates a Token of passed kind with lexeme starting 
 /// at the current position of the scanner 
@@ -36,25 +21,26 @@ static char advance();
 ///
 /// @param kind: kind of the Token to be created
 /// @return Token, newly created Token
-static Token token_create(TokenKind kind);
+static Token token_create(Scanner *p_scanner, TokenKind kind);
 
 /// Advances current position while it points to the whitespace symbol,
 /// gracefully handles newline characters.
 /// Also skips comments
 ///
 /// @return Token: token of kind TOK_EMPTY or TOK_ANNOTATION
-static Token skip_whitespace();
+static Token skip_whitespace(Scanner *p_scanner);
 
-/// Peeks current character in the scanner
+/// Peeks current character in the scanner, if current is the end of file,
+/// function will return '\0'
 ///
 /// @return char
-static char peek();
+static char peek(Scanner *p_scanner);
 
 /// Peeks the next to current character, if current is the end of file,
 /// function will return '\0'
 ///
 /// @return char
-static char peek_next();
+static char peek_next(Scanner *p_scanner);
 
 /// Checks if the param char c is a digit
 ///
@@ -73,122 +59,350 @@ static bool is_alpha(char c);
 /// or TOK_<keyword> if it is a keyword
 ///
 /// @return Token
-static Token process_identifier();
+static Token process_identifier(Scanner *p_scanner);
+
+/// Processes integer literal, including its base prefix and suffix (0x10, 16u)
+///
+/// @return Token, TOK_NUMBER
+static Token process_number(Scanner *p_scanner);
 
 /// Determines kind of the identifier that is being parsed
 ///
 /// @return TokenKind
-static TokenKind identifier_kind();
+static TokenKind identifier_kind(Scanner *p_scanner);
 
-/// Checks if the rest of the word pointed by scanner.current + start param
+/// Checks if the rest of the word pointed by p_scanner->current + start param
 /// with the length of length param is equal to the rest param
 /// if it is, return kind param,
 /// otherwise return TOK_IDENTIFIER
 ///
 /// @param start: offset to the beginning of the rest of word pointed by
-///   scanner.current
+///   p_scanner->current
 /// @param length: length of the rest of word
 /// @param rest: pointer to the rest of the keyword to compare with
 /// @param kind: kind of token to return if rest of the word is matched
 ///   with the rest param
 /// @return TokenKind, determined kind of token
-static TokenKind check_keyword(i32 start, i32 length,
+static TokenKind check_keyword(Scanner *p_scanner, i32 start, i32 length,
                               const char *rest, TokenKind kind);
 
 
-void scanner_init(const char *source) {
-  scanner.start = source;
-  scanner.current = source;
-  scanner.line = 1;
+// ----------------- | BULK SCANNING |
+//
+// Helpers below scan blocks of SCAN_WIDTH bytes at once where SSE2 or AVX2 is available
+// and fall back to one byte at a time for the tail of the source and on other targets.
+// Every helper reads only [p, end)
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SCAN_WIDTH 32
+typedef __m256i ScanBlock;
+#define scan_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define scan_set1(c) _mm256_set1_epi8(c)
+#define scan_eq(a, b) _mm256_cmpeq_epi8((a), (b))
+#define scan_gt(a, b) _mm256_cmpgt_epi8((a), (b))
+#define scan_or(a, b) _mm256_or_si256((a), (b))
+#define scan_and(a, b) _mm256_and_si256((a), (b))
+#define scan_movemask(a) ((u32)_mm256_movemask_epi8(a))
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SCAN_WIDTH 16
+typedef __m128i ScanBlock;
+#define scan_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define scan_set1(c) _mm_set1_epi8(c)
+#define scan_eq(a, b) _mm_cmpeq_epi8((a), (b))
+#define scan_gt(a, b) _mm_cmpgt_epi8((a), (b))
+#define scan_or(a, b) _mm_or_si128((a), (b))
+#define scan_and(a, b) _mm_and_si128((a), (b))
+#define scan_movemask(a) ((u32)_mm_movemask_epi8(a))
+
+#endif
+
+#ifdef SCAN_WIDTH
+
+/// Bit i is set if byte i of the block is c
+static inline u32 scan_mask_eq(ScanBlock block, char c) {
+  return scan_movemask(scan_eq(block, scan_set1(c)));
+}
+
+/// Bit i is set if byte i of the block is in [lo, hi],
+/// bytes >= 0x80 are negative in signed compare and never match
+static inline u32 scan_mask_range(ScanBlock block, char lo, char hi) {
+  return scan_movemask(scan_and(scan_gt(block, scan_set1(lo - 1)), scan_gt(scan_set1(hi + 1), block)));
+}
+
+/// Bit i is set if byte i of the block may be a part of identifier: [a-zA-Z0-9_]
+static inline u32 scan_mask_identifier(ScanBlock block) {
+  ScanBlock lower = scan_or(block, scan_set1(0x20));
+  return scan_mask_range(lower, 'a', 'z') | scan_mask_range(block, '0', '9') | scan_mask_eq(block, '_');
+}
+
+/// Bit i is set if byte i of the block is ' ', '\t', '\r' or '\n'
+static inline u32 scan_mask_space(ScanBlock block) {
+  return scan_mask_eq(block, ' ') | scan_mask_eq(block, '\t')
+    | scan_mask_eq(block, '\r') | scan_mask_eq(block, '\n');
+}
+
+#define SCAN_FULL_MASK ((u32)((1ull << SCAN_WIDTH) - 1))
+
+#endif // !SCAN_WIDTH
+
+/// Finds the first '\n' (or '`' if stop_at_backtick) in [p, end)
+///
+/// @return const char*, pointer to the found character or end
+static const char* scan_find_line_end(const char *p, const char *end, bool stop_at_backtick) {
+#ifdef SCAN_WIDTH
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+    ScanBlock block = scan_load(p);
+    u32 mask = scan_mask_eq(block, '\n');
+    if (stop_at_backtick) mask |= scan_mask_eq(block, '`');
+    if (0 != mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < end; ++p) {
+    if ('\n' == *p || (stop_at_backtick && '`' == *p)) break;
+  }
+  return p;
+}
+
+/// Finds the first "*/" in [p, end) and counts newlines before it
+///
+/// @param p_lines: incremented by number of '\n' in [p, found)
+/// @return const char*, pointer to the '*' of "*/" or end
+static const char* scan_find_block_comment_end(const char *p, const char *end, i32 *p_lines) {
+#ifdef SCAN_WIDTH
+  // the block and the block shifted by one are loaded, so one byte past the block is needed
+  for (; end - p > SCAN_WIDTH; p += SCAN_WIDTH) {
+    ScanBlock block = scan_load(p);
+    u32 newlines = scan_mask_eq(block, '\n');
+    u32 found = scan_mask_eq(block, '*') & scan_mask_eq(scan_load(p + 1), '/');
+    if (0 != found) {
+      u32 index = __builtin_ctz(found);
+      *p_lines += __builtin_popcount(newlines & ((1u << index) - 1));
+      return p + index;
+    }
+    *p_lines += __builtin_popcount(newlines);
+  }
+#endif
+  for (; p < end; ++p) {
+    if ('*' == *p && end - p >= 2 && '/' == p[1]) break;
+    *p_lines += '\n' == *p;
+  }
+  return p;
+}
+
+/// Skips ' ', '\t', '\r' and '\n' in [p, end) and counts newlines
+///
+/// @param p_lines: incremented by number of skipped '\n'
+/// @return const char*, pointer to the first other character or end
+static const char* scan_skip_spaces(const char *p, const char *end, i32 *p_lines) {
+#ifdef SCAN_WIDTH
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+    ScanBlock block = scan_load(p);
+    u32 newlines = scan_mask_eq(block, '\n');
+    u32 other = ~scan_mask_space(block) & SCAN_FULL_MASK;
+    if (0 != other) {
+      u32 index = __builtin_ctz(other);
+      *p_lines += __builtin_popcount(newlines & ((1u << index) - 1));
+      return p + index;
+    }
+    *p_lines += __builtin_popcount(newlines);
+  }
+#endif
+  for (; p < end; ++p) {
+    if (' ' != *p && '\t' != *p && '\r' != *p && '\n' != *p) break;
+    *p_lines += '\n' == *p;
+  }
+  return p;
+}
+
+/// Skips identifier characters [a-zA-Z0-9_] in [p, end)
+///
+/// @return const char*, pointer to the first other character or end
+static const char* scan_skip_identifier(const char *p, const char *end) {
+#ifdef SCAN_WIDTH
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+    u32 other = ~scan_mask_identifier(scan_load(p)) & SCAN_FULL_MASK;
+    if (0 != other) return p + __builtin_ctz(other);
+  }
+#endif
+  for (; p < end; ++p) {
+    if (!is_alpha(*p) && !is_digit(*p)) break;
+  }
+  return p;
+}
+
+/// Finds the first character that matters for brace balancing: '{', '}', '"', '\'', '/' or '#',
+/// counts newlines before it
+///
+/// @param p_lines: incremented by number of '\n' in [p, found)
+/// @return const char*, pointer to the found character or end
+static const char* scan_find_block_special(const char *p, const char *end, i32 *p_lines) {
+#ifdef SCAN_WIDTH
+  for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+    ScanBlock block = scan_load(p);
+    u32 newlines = scan_mask_eq(block, '\n');
+    u32 found = scan_mask_eq(block, '{') | scan_mask_eq(block, '}')
+      | scan_mask_eq(block, '"') | scan_mask_eq(block, '\'')
+      | scan_mask_eq(block, '/') | scan_mask_eq(block, '#');
+    if (0 != found) {
+      u32 index = __builtin_ctz(found);
+      *p_lines += __builtin_popcount(newlines & ((1u << index) - 1));
+      return p + index;
+    }
+    *p_lines += __builtin_popcount(newlines);
+  }
+#endif
+  for (; p < end; ++p) {
+    char c = *p;
+    if ('{' == c || '}' == c || '"' == c || '\'' == c || '/' == c || '#' == c) break;
+    *p_lines += '\n' == c;
+  }
+  return p;
+}
+
+/// Skips string or char literal starting at the quote p points to.
+/// Literal that is not closed on its line ends before the newline,
+/// so a stray quote (e.g. in #error) cannot swallow the rest of the file
+///
+/// @param p_lines: incremented by number of escaped newlines
+/// @return const char*, pointer past the literal
+static const char* scan_skip_literal(const char *p, const char *end, i32 *p_lines) {
+  char quote = *p++;
+  while (p < end) {
+    char c = *p;
+    if ('\\' == c) {
+      if (end - p >= 2 && '\n' == p[1]) ++*p_lines;
+      p += end - p >= 2 ? 2 : 1;
+    } else if (quote == c) {
+      return p + 1;
+    } else if ('\n' == c) {
+      return p;
+    } else {
+      ++p;
+    }
+  }
+  return p;
+}
+
+/// Skips preprocessor directive starting at p with its continuation lines
+///
+/// @param p_lines: incremented by number of continued lines
+/// @return const char*, pointer to the newline ending the directive or end
+static const char* scan_skip_directive(const char *p, const char *end, i32 *p_lines) {
+  for (;;) {
+    p = scan_find_line_end(p, end, false);
+    if (p == end) return p;
+
+    const char *p_last = p - 1;
+    if ('\r' == *p_last) --p_last;
+    if ('\\' != *p_last) return p;
+
+    ++*p_lines;
+    ++p;
+  }
+}
+
+// ----------------- | SCANNER |
+
+void scanner_init(Scanner *p_scanner, const char *source, usize length) {
+  p_scanner->start = source;
+  p_scanner->current = source;
+  p_scanner->end = source + length;
+  p_scanner->line = 1;
 }
 
-Token scan_token() {
-  Token annotation = skip_whitespace();
+Token scan_token(Scanner *p_scanner) {
+  Token annotation = skip_whitespace(p_scanner);
   if (annotation.kind == TOK_ANNOTATION) {
     return annotation;
   }
 
-  scanner.start = scanner.current;
+  p_scanner->start = p_scanner->current;
 
-  if (is_at_end()) return token_create(TOK_EOF);
+  if (is_at_end(p_scanner)) return token_create(p_scanner, TOK_EOF);
 
-  char c = advance();
+  char c = advance(p_scanner);
 
-  if (is_alpha(c)) return process_identifier();
+  if (is_alpha(c)) return process_identifier(p_scanner);
+  if (is_digit(c)) return process_number(p_scanner);
 
   switch (c) {
-    case '(': return token_create(TOK_LEFT_PAREN);
-    case ')': return token_create(TOK_RIGHT_PAREN);
-    case '{': return token_create(TOK_LEFT_BRACE);
-    case '}': return token_create(TOK_RIGHT_BRACE);
-    case ';': return token_create(TOK_SEMICOLON);
-    case ',': return token_create(TOK_COMMA);
-    case '*': return token_create(TOK_STAR);
-
-    default: return token_create(TOK_OTHER);
+    case '(': return token_create(p_scanner, TOK_LEFT_PAREN);
+    case ')': return token_create(p_scanner, TOK_RIGHT_PAREN);
+    case '{': return token_create(p_scanner, TOK_LEFT_BRACE);
+    case '}': return token_create(p_scanner, TOK_RIGHT_BRACE);
+    case '[': return token_create(p_scanner, TOK_LEFT_BRACKET);
+    case ']': return token_create(p_scanner, TOK_RIGHT_BRACKET);
+    case ';': return token_create(p_scanner, TOK_SEMICOLON);
+    case ',': return token_create(p_scanner, TOK_COMMA);
+    case '*': return token_create(p_scanner, TOK_STAR);
+
+    default: return token_create(p_scanner, TOK_OTHER);
   }
 }
 
 
-static bool is_at_end() {
-  return *scanner.current == '\0';
+static bool is_at_end(Scanner *p_scanner) {
+  return p_scanner->current >= p_scanner->end;
 }
 
-static char advance() {
-  return *scanner.current++;
+static char advance(Scanner *p_scanner) {
+  if (is_at_end(p_scanner)) return '\0';
+  return *p_scanner->current++;
 }
 
-static Token token_create(TokenKind kind) {
+static Token token_create(Scanner *p_scanner, TokenKind kind) {
   return (Token) {
     .kind = kind,
-    .lexeme = string_view_from_cstr_slice(scanner.start, 0, scanner.current - scanner.start),
-    .line = scanner.line
+    .lexeme = string_view_from_cstr_slice(p_scanner->start, 0, p_scanner->current - p_scanner->start),
+    .line = p_scanner->line
   };
 }
 
-static Token skip_whitespace() {
+static Token skip_whitespace(Scanner *p_scanner) {
   Token annotation = {.kind = TOK_EMPTY};
   for (;;) {
-    char c = peek();
+    char c = peek(p_scanner);
     switch (c) {
       case ' ':
       case '\r':
       case '\t':
-        advance();
-        break;
-
       case '\n':
-        ++scanner.line;
-        advance();
+        p_scanner->current = scan_skip_spaces(p_scanner->current, p_scanner->end, &p_scanner->line);
         break;
 
       case '/':
-        if (peek_next() == '/') {
-          while (peek() != '\n' && !is_at_end()) {
-            if ('`' == peek() && TOK_EMPTY == annotation.kind) {
-              advance(); // `
-              annotation.kind = TOK_ANNOTATION;
-              annotation.line = scanner.line;
-              const char *ann_begin_str = scanner.current;
-              do {
-                advance();
-              } while ('`' != peek() && '\n' != peek() && !is_at_end());
-              if ('`' != peek()) {
-                logf_fatal("SCANNER", 1, "Missing closing '`' for annotation at the line %d\n", scanner.line);
-              }
-              annotation.lexeme = string_view_from_cstr_slice(ann_begin_str, 0, scanner.current - ann_begin_str);
+        if (peek_next(p_scanner) == '/') {
+          for (;;) {
+            // only the first annotation is taken, later backticks are a part of the comment
+            p_scanner->current = scan_find_line_end(p_scanner->current, p_scanner->end,
+                                                    TOK_EMPTY == annotation.kind);
+            if ('`' != peek(p_scanner)) break;
+
+            advance(p_scanner); // `
+            annotation.kind = TOK_ANNOTATION;
+            annotation.line = p_scanner->line;
+            const char *ann_begin_str = p_scanner->current;
+            advance(p_scanner);
+            p_scanner->current = scan_find_line_end(p_scanner->current, p_scanner->end, true);
+            if ('`' != peek(p_scanner)) {
+              logf_fatal("SCANNER", 1, "Missing closing '`' for annotation at the line %d\n", p_scanner->line);
             }
-            advance();
-          } 
-        } else if (peek_next() == '*') {
-          do { 
-            advance(); 
-            scanner.line += peek() == '\n';
-          } while (!is_at_end() && !(peek() == '*' && peek_next() == '/'));
-          if (!is_at_end()) 
+            annotation.lexeme = string_view_from_cstr_slice(ann_begin_str, 0, p_scanner->current - ann_begin_str);
+            advance(p_scanner); // `
+          }
+        } else if (peek_next(p_scanner) == '*') {
+          // "/*/" closes the comment, so the search starts at '*'
+          p_scanner->current = scan_find_block_comment_end(p_scanner->current + 1, p_scanner->end,
+                                                           &p_scanner->line);
+          if (!is_at_end(p_scanner)) 
             {
-              advance();  // '*'
-              advance();  // '/'
+              advance(p_scanner);  // '*'
+              advance(p_scanner);  // '/'
             }
         } else {
           return annotation;
@@ -201,13 +415,101 @@ static Token skip_whitespace() {
   }
 }
 
-static char peek() {
-  return *scanner.current;
+bool scanner_skip_block(Scanner *p_scanner) {
+  const char *p = p_scanner->current;
+  const char *end = p_scanner->end;
+  i32 line = p_scanner->line;
+  usize depth = 1;
+
+  for (;;) {
+    p = scan_find_block_special(p, end, &line);
+    if (p == end) {
+      return false;
+    }
+
+    switch (*p) {
+      case '{':
+        ++depth;
+        ++p;
+        break;
+
+      case '}':
+        ++p;
+        if (0 == --depth) {
+          p_scanner->start = p_scanner->current = p;
+          p_scanner->line = line;
+          return true;
+        }
+        break;
+
+      case '"':
+      case '\'':
+        p = scan_skip_literal(p, end, &line);
+        break;
+
+      case '#':
+        p = scan_skip_directive(p, end, &line);
+        break;
+
+      case '/':
+        if (end - p >= 2 && '/' == p[1]) {
+          p = scan_find_line_end(p, end, false);
+        } else if (end - p >= 2 && '*' == p[1]) {
+          p = scan_find_block_comment_end(p + 2, end, &line);
+          p += end - p >= 2 ? 2 : end - p;
+        } else {
+          ++p;
+        }
+        break;
+    }
+  }
 }
 
-static char peek_next() {
-  if (is_at_end()) return '\0';
-  return scanner.current[1];
+/// Skips ' ' and '\t' in [p, end)
+static const char* scan_skip_blanks(const char *p, const char *end) {
+  while (p < end && (' ' == *p || '\t' == *p)) ++p;
+  return p;
+}
+
+bool scanner_next_include(Scanner *p_scanner, StringView *p_path) {
+  const char *p = p_scanner->current;
+  const char *end = p_scanner->end;
+
+  while (p < end) {
+    p = scan_skip_blanks(p, end);
+    if (p < end && '#' == *p) {
+      p = scan_skip_blanks(p + 1, end);
+      if (end - p > 7 && 0 == memcmp(p, "include", 7)) {
+        p = scan_skip_blanks(p + 7, end);
+        if (p < end && '"' == *p) {
+          const char *begin = ++p;
+          while (p < end && '"' != *p && '\n' != *p) ++p;
+
+          if (p < end && '"' == *p) {
+            *p_path = (StringView){ .p_begin = begin, .length = (usize)(p - begin) };
+            p_scanner->current = p + 1;
+            return true;
+          }
+        }
+      }
+    }
+
+    p = scan_find_line_end(p, end, false);
+    if (p < end) ++p; // '\n'
+  }
+
+  p_scanner->current = end;
+  return false;
+}
+
+static char peek(Scanner *p_scanner) {
+  if (is_at_end(p_scanner)) return '\0';
+  return *p_scanner->current;
+}
+
+static char peek_next(Scanner *p_scanner) {
+  if (p_scanner->end - p_scanner->current < 2) return '\0';
+  return p_scanner->current[1];
 }
 
 static bool is_digit(char c) {
@@ -220,53 +522,59 @@ static bool is_alpha(char c) {
       || c == '_';
 }
 
-static Token process_identifier() {
-  while (is_alpha(peek()) || is_digit(peek())) advance();
+static Token process_identifier(Scanner *p_scanner) {
+  p_scanner->current = scan_skip_identifier(p_scanner->current, p_scanner->end);
+
+  return token_create(p_scanner, identifier_kind(p_scanner));
+}
+
+static Token process_number(Scanner *p_scanner) {
+  p_scanner->current = scan_skip_identifier(p_scanner->current, p_scanner->end);
 
-  return token_create(identifier_kind());
+  return token_create(p_scanner, TOK_NUMBER);
 }
 
-static TokenKind identifier_kind() {
+static TokenKind identifier_kind(Scanner *p_scanner) {
   // void, char, short, int, long, unsigned, float, double
   // struct, const, typedef
   //
   // char, const, double, float, int, long, short, struct, typedef, void, unsigned
-  switch (*scanner.start) {
+  switch (*p_scanner->start) {
     case 'c': 
-      if (scanner.current - scanner.start > 1) {
-        switch (scanner.start[1]) {
-          case 'h': return check_keyword(2, 2, "ar", TOK_CHAR);
-          case 'o': return check_keyword(2, 3, "nst", TOK_CONST);
+      if (p_scanner->current - p_scanner->start > 1) {
+        switch (p_scanner->start[1]) {
+          case 'h': return check_keyword(p_scanner, 2, 2, "ar", TOK_CHAR);
+          case 'o': return check_keyword(p_scanner, 2, 3, "nst", TOK_CONST);
         }
       }
       break;
 
-    case 'd': return check_keyword(1, 5, "ouble", TOK_DOUBLE);
-    case 'f': return check_keyword(1, 4, "loat", TOK_FLOAT);
-    case 'i': return check_keyword(1, 2, "nt", TOK_INT);
-    case 'l': return check_keyword(1, 3, "ong", TOK_LONG);
+    case 'd': return check_keyword(p_scanner, 1, 5, "ouble", TOK_DOUBLE);
+    case 'f': return check_keyword(p_scanner, 1, 4, "loat", TOK_FLOAT);
+    case 'i': return check_keyword(p_scanner, 1, 2, "nt", TOK_INT);
+    case 'l': return check_keyword(p_scanner, 1, 3, "ong", TOK_LONG);
 
     case 's': 
-      if (scanner.current - scanner.start > 1) {
-        switch (scanner.start[1]) {
-          case 'h': return check_keyword(2, 3, "ort", TOK_SHORT);
-          case 't': return check_keyword(2, 4, "ruct", TOK_STRUCT);
+      if (p_scanner->current - p_scanner->start > 1) {
+        switch (p_scanner->start[1]) {
+          case 'h': return check_keyword(p_scanner, 2, 3, "ort", TOK_SHORT);
+          case 't': return check_keyword(p_scanner, 2, 4, "ruct", TOK_STRUCT);
         }
       }
       break;
 
-    case 't': return check_keyword(1, 6, "ypedef", TOK_TYPEDEF);
-    case 'v': return check_keyword(1, 3, "oid", TOK_VOID);
-    case 'u': return check_keyword(1, 7, "nsigned", TOK_UNSIGNED);
+    case 't': return check_keyword(p_scanner, 1, 6, "ypedef", TOK_TYPEDEF);
+    case 'v': return check_keyword(p_scanner, 1, 3, "oid", TOK_VOID);
+    case 'u': return check_keyword(p_scanner, 1, 7, "nsigned", TOK_UNSIGNED);
   }
 
   return TOK_IDENTIFIER;
 }
 
-static TokenKind check_keyword(i32 start, i32 length,
+static TokenKind check_keyword(Scanner *p_scanner, i32 start, i32 length,
                               const char *rest, TokenKind kind) {
-  if (scanner.current - scanner.start == start + length
-    && 0 == memcmp(scanner.start + start, rest, length)) {
+  if (p_scanner->current - p_scanner->start == start + length
+    && 0 == memcmp(p_scanner->start + start, rest, length)) {
     return kind;
   }
 
@@ -319,7 +627,7 @@ LogSeverity g_log_severity = LOG_ALL;
 
 
 
-#include <sys/ioctl.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 void get_cursor_position(int *x, int *y) {
@@ -353,11 +661,12 @@ int main(int argc, char **argv)
     return 1;
   }
 
-  scanner_init(content);
+  Scanner scanner;
+  scanner_init(&scanner, content, strlen(content));
 
   Token t;
   do {
-    t = scan_token();
+    t = scan_token(&scanner);
     printf("kind: %s", token_kind_to_cstr(t.kind));
     gotox(33);
     printf("line: %d", t.line);
@@ -3,16 +3,52 @@
 
 #include "token.h"
 
+/// Represent the source code scanner
+typedef struct {
+  /// Pointer to the beginning of the token that is currently being parsed
+  const char *start;
+
+  /// Pointer to the current location in source code 
+  const char *current;
+
+  /// Pointer past the last character of source code,
+  /// source does not have to be NUL-terminated
+  const char *end;
+
+  /// Number of the current line in source file
+  i32 line;
+} Scanner;
+
 /// Initializes the Scanner to scan source code
 ///
+/// @param p_scanner: scanner to initialize
 /// @param source: pointer to the source code
+/// @param length: length of the source code
 /// @return void
-void scanner_init(const char *source);
+void scanner_init(Scanner *p_scanner, const char *source, usize length);
 
 /// Scans the next token in the current source file
 ///
+/// @param p_scanner: scanner to scan with
 /// @return Token, scanned token
-Token scan_token();
+Token scan_token(Scanner *p_scanner);
+
+/// Skips raw source up to and including the '}' matching the '{' scanned last,
+/// no tokens are produced. Nested braces, string and char literals, comments
+/// and preprocessor directives are taken into account
+///
+/// @param p_scanner: scanner positioned right after '{'
+/// @return bool, false if the block is not closed before the end of the source,
+///   the scanner is not moved then
+bool scanner_skip_block(Scanner *p_scanner);
+
+/// Finds the next #include "..." directive. This is a separate pass over raw lines,
+/// it is not meant to be mixed with scan_token and does not track lines or comments
+///
+/// @param p_scanner: scanner positioned at the beginning of a line
+/// @param p_path: set to the path between the quotes
+/// @return bool, false if there are no more includes
+bool scanner_next_include(Scanner *p_scanner, StringView *p_path);
 
 
 #endif // !__SERC_SCANNER_H__
@@ -1,18 +1,37 @@
 #include <assert.h>
-#include "./json.h"
+#include <stddef.h>
+#include "json.h"
 
 #define SER_VALIDATE(call) do { if (!(call)) { return false; } } while (0)
 
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__LP64__) && !defined(__APPLE__)
+#define SER_LAYOUT_ASSERT(cond) _Static_assert(cond, #cond)
+#else
+#define SER_LAYOUT_ASSERT(cond) _Static_assert(1, "")
+#endif
+
+typedef struct Test Test;
+typedef struct Test2 Test2;
+
 typedef struct Test {
 	const int  * * * * ids;
 	int  i;
 	float  f;
 	const long double  dl;
 } Test;
-bool serializer_Test_to_json(Serializer *p_ser, const void *p_val) {
-	assert(NULL != p_val);
+SER_LAYOUT_ASSERT(sizeof(Test) == 32);
+SER_LAYOUT_ASSERT(_Alignof(Test) == 16);
+SER_LAYOUT_ASSERT(offsetof(Test, ids) == 0);
+SER_LAYOUT_ASSERT(offsetof(Test, i) == 8);
+SER_LAYOUT_ASSERT(offsetof(Test, f) == 12);
+SER_LAYOUT_ASSERT(offsetof(Test, dl) == 16);
+#ifdef SERC_SIZE_HINTS
+static SerializerSizeHint Test_size_hint;
+#endif // SERC_SIZE_HINTS
+static inline bool serializer_Test_to_json_inline(Serializer *p_ser, const Test *tmp) {
+	assert(NULL != tmp);
 
-	const Test *tmp = (const Test*)p_val;
+	SER_VALIDATE(serializer_json_start_object(p_ser));
 
 	SER_VALIDATE(serializer_json_start_field(p_ser, "ids"));
 	SER_VALIDATE(serializer_int_to_json(p_ser, ****tmp->ids));
@@ -30,25 +49,80 @@ bool serializer_Test_to_json(Serializer *p_ser, const void *p_val) {
 	SER_VALIDATE(serializer_long_double_to_json(p_ser, tmp->dl));
 	SER_VALIDATE(serializer_json_end_field(p_ser));
 
+	SER_VALIDATE(serializer_json_end_object(p_ser));
+	return true;
+}
+
+bool serializer_Test_to_json(Serializer *p_ser, const void *p_val) {
+	assert(NULL != p_val);
+
+#ifdef SERC_SIZE_HINTS
+	size_t size_hint_begin = serializer_size_hint_begin(p_ser, &Test_size_hint);
+#endif // SERC_SIZE_HINTS
+
+	SER_VALIDATE(serializer_Test_to_json_inline(p_ser, (const Test*)p_val));
+
+#ifdef SERC_SIZE_HINTS
+	serializer_size_hint_end(p_ser, &Test_size_hint, size_hint_begin);
+#endif // SERC_SIZE_HINTS
+	return true;
+}
+
+bool serializer_Test_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask) {
+	const Test *tmp = (const Test*)p_val;
+	assert(NULL != tmp);
+
+	SER_VALIDATE(serializer_json_start_object(p_ser));
+
+	if (0 != (mask & SER_MASK_Test_ids)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "ids"));
+		SER_VALIDATE(serializer_int_to_json(p_ser, ****tmp->ids));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	if (0 != (mask & SER_MASK_Test_i)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "i"));
+		SER_VALIDATE(serializer_int_to_json(p_ser, tmp->i));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	if (0 != (mask & SER_MASK_Test_f)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "f"));
+		SER_VALIDATE(serializer_float_to_json(p_ser, tmp->f));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	if (0 != (mask & SER_MASK_Test_dl)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "dl"));
+		SER_VALIDATE(serializer_long_double_to_json(p_ser, tmp->dl));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	SER_VALIDATE(serializer_json_end_object(p_ser));
 	return true;
 }
 
 typedef struct Test2 {
-	Test  * arr;
+	struct Test  * arr;
 	unsigned int  arr_count;
 	void  * v;
 } Test2;
+SER_LAYOUT_ASSERT(sizeof(Test2) == 24);
+SER_LAYOUT_ASSERT(_Alignof(Test2) == 8);
+SER_LAYOUT_ASSERT(offsetof(Test2, arr) == 0);
+SER_LAYOUT_ASSERT(offsetof(Test2, arr_count) == 8);
+SER_LAYOUT_ASSERT(offsetof(Test2, v) == 16);
 bool cb_void_to_json(Serializer *p_ser, const void *value);
 bool cb_json_to_void(Serializer *p_ser, void *value);
-bool serializer_Test2_to_json(Serializer *p_ser, const void *p_val) {
-	assert(NULL != p_val);
+#ifdef SERC_SIZE_HINTS
+static SerializerSizeHint Test2_size_hint;
+#endif // SERC_SIZE_HINTS
+static inline bool serializer_Test2_to_json_inline(Serializer *p_ser, const Test2 *tmp) {
+	assert(NULL != tmp);
 
-	const Test2 *tmp = (const Test2*)p_val;
+	SER_VALIDATE(serializer_json_start_object(p_ser));
 
 	SER_VALIDATE(serializer_json_start_field(p_ser, "arr"));
 	SER_VALIDATE(serializer_json_start_array(p_ser));
-	for (size_t i = 0; i < tmp->arr_count; ++i) {
-		SER_VALIDATE(serializer_Test_to_json(p_ser, tmp->arr + i));
+	for (size_t i = 0; i < (size_t)tmp->arr_count; ++i) {
+		SER_VALIDATE(serializer_Test_to_json_inline(p_ser, &tmp->arr[i]));
+		SER_VALIDATE(serializer_json_append_separator(p_ser));
 	}
 	SER_VALIDATE(serializer_json_end_array(p_ser));
 	SER_VALIDATE(serializer_json_end_field(p_ser));
@@ -57,6 +131,47 @@ bool serializer_Test2_to_json(Serializer *p_ser, const void *p_val) {
 	SER_VALIDATE(cb_void_to_json(p_ser, tmp->v));
 	SER_VALIDATE(serializer_json_end_field(p_ser));
 
+	SER_VALIDATE(serializer_json_end_object(p_ser));
+	return true;
+}
+
+bool serializer_Test2_to_json(Serializer *p_ser, const void *p_val) {
+	assert(NULL != p_val);
+
+#ifdef SERC_SIZE_HINTS
+	size_t size_hint_begin = serializer_size_hint_begin(p_ser, &Test2_size_hint);
+#endif // SERC_SIZE_HINTS
+
+	SER_VALIDATE(serializer_Test2_to_json_inline(p_ser, (const Test2*)p_val));
+
+#ifdef SERC_SIZE_HINTS
+	serializer_size_hint_end(p_ser, &Test2_size_hint, size_hint_begin);
+#endif // SERC_SIZE_HINTS
+	return true;
+}
+
+bool serializer_Test2_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask) {
+	const Test2 *tmp = (const Test2*)p_val;
+	assert(NULL != tmp);
+
+	SER_VALIDATE(serializer_json_start_object(p_ser));
+
+	if (0 != (mask & SER_MASK_Test2_arr)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "arr"));
+		SER_VALIDATE(serializer_json_start_array(p_ser));
+		for (size_t i = 0; i < (size_t)tmp->arr_count; ++i) {
+			SER_VALIDATE(serializer_Test_to_json_inline(p_ser, &tmp->arr[i]));
+			SER_VALIDATE(serializer_json_append_separator(p_ser));
+		}
+		SER_VALIDATE(serializer_json_end_array(p_ser));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	if (0 != (mask & SER_MASK_Test2_v)) {
+		SER_VALIDATE(serializer_json_start_field(p_ser, "v"));
+		SER_VALIDATE(cb_void_to_json(p_ser, tmp->v));
+		SER_VALIDATE(serializer_json_end_field(p_ser));
+	}
+	SER_VALIDATE(serializer_json_end_object(p_ser));
 	return true;
 }
 
@@ -1,8 +1,16 @@
 #ifndef __SERC_JSON_H__
 #define __SERC_JSON_H__
 #include <stdbool.h>
-#include "./primitives.h"
+#include "primitives.h"
 
 bool serializer_Test_to_json(Serializer *p_ser, const void *p_val);
+#define SER_MASK_Test_ids ((uint64_t)1 << 0)
+#define SER_MASK_Test_i ((uint64_t)1 << 1)
+#define SER_MASK_Test_f ((uint64_t)1 << 2)
+#define SER_MASK_Test_dl ((uint64_t)1 << 3)
+bool serializer_Test_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask);
 bool serializer_Test2_to_json(Serializer *p_ser, const void *p_val);
+#define SER_MASK_Test2_arr ((uint64_t)1 << 0)
+#define SER_MASK_Test2_v ((uint64_t)1 << 1)
+bool serializer_Test2_to_json_masked(Serializer *p_ser, const void *p_val, uint64_t mask);
 #endif // !__SERC_JSON_H__
@@ -3,43 +3,255 @@
 #include <limits.h>
 #include <stdio.h>
 #include <float.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "primitives.h"
 
 #define SER_GROW_FACTOR 2
 #define SER_INIT_CAPACITY 64
+#define SER_SINK_CAPACITY (64 * 1024)
+
+// size hint loses 1/16 of the difference to a smaller sample per serialization
+#define SER_SIZE_HINT_DECAY_SHIFT 4
 
 #define SER_VALIDATE(call) do { if (!(call)) { return false; } } while (0)
 
 
 // ----------------- | PRIVATE |
+static bool serializer_has_sink(const Serializer *p_ser) {
+  return NULL != p_ser->sink.write || NULL != p_ser->sink.exchange;
+}
+
+static void *serializer_allocate(Serializer *p_ser, size_t size) {
+  if (NULL == p_ser->allocator.allocate) {
+    return malloc(size);
+  }
+  return p_ser->allocator.allocate(p_ser->allocator.ctx, size);
+}
+
+static void *serializer_reallocate(Serializer *p_ser, void *ptr, size_t old_size, size_t new_size) {
+  if (NULL == p_ser->allocator.allocate) {
+    return realloc(ptr, new_size);
+  }
+  if (NULL == ptr) {
+    return p_ser->allocator.allocate(p_ser->allocator.ctx, new_size);
+  }
+  return p_ser->allocator.reallocate(p_ser->allocator.ctx, ptr, old_size, new_size);
+}
+
+static void serializer_deallocate(Serializer *p_ser, void *ptr, size_t size) {
+  if (NULL == ptr) {
+    return;
+  }
+  if (NULL == p_ser->allocator.allocate) {
+    free(ptr);
+    return;
+  }
+  p_ser->allocator.free(p_ser->allocator.ctx, ptr, size);
+}
+
+/// Passes buffered bytes to the sink, last keep bytes stay in the buffer
+static bool serializer_sink_drain(Serializer *p_ser, size_t keep) {
+  assert(NULL != p_ser);
+  assert(serializer_has_sink(p_ser));
+  assert(keep <= p_ser->count);
+
+  size_t count = p_ser->count - keep;
+  if (NULL != p_ser->sink.exchange) {
+    char tail[1];
+    assert(keep <= sizeof(tail));
+    for (size_t i = 0; i < keep; ++i) tail[i] = p_ser->data[count + i];
+
+    size_t capacity = 0;
+    char *tmp = p_ser->sink.exchange(p_ser->sink.ctx, p_ser->data, count, &capacity);
+    p_ser->flushed += count;
+    p_ser->data = tmp;
+    p_ser->count = 0;
+    p_ser->capacity = capacity;
+    if (NULL == tmp || capacity <= keep) {
+      if (NULL != tmp) {
+        p_ser->sink.exchange(p_ser->sink.ctx, tmp, 0, NULL);
+      }
+      p_ser->data = NULL;
+      p_ser->capacity = 0;
+      return false;
+    }
+
+    for (size_t i = 0; i < keep; ++i) p_ser->data[i] = tail[i];
+    p_ser->count = keep;
+    return true;
+  }
+
+  if (0 != count && !p_ser->sink.write(p_ser->sink.ctx, p_ser->data, count)) {
+    return false;
+  }
+  p_ser->flushed += count;
+
+  for (size_t i = 0; i < keep; ++i) p_ser->data[i] = p_ser->data[count + i];
+  p_ser->count = keep;
+  return true;
+}
+
+struct SerializerChunkPool {
+  pthread_mutex_t lock;
+  SerializerChunk *free_list;
+  size_t chunk_capacity;
+};
+
+static SerializerChunk *chunk_pool_get(SerializerChunkPool *p_pool) {
+  assert(NULL != p_pool);
+
+  pthread_mutex_lock(&p_pool->lock);
+  SerializerChunk *p_chunk = p_pool->free_list;
+  if (NULL != p_chunk) {
+    p_pool->free_list = p_chunk->next;
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+
+  if (NULL == p_chunk) {
+    p_chunk = (SerializerChunk*)malloc(sizeof(SerializerChunk) + p_pool->chunk_capacity);
+    if (NULL == p_chunk) {
+      return NULL;
+    }
+    p_chunk->capacity = p_pool->chunk_capacity;
+    p_chunk->is_pooled = true;
+  }
+
+  p_chunk->next = NULL;
+  p_chunk->count = 0;
+  return p_chunk;
+}
+
+/// Returns the list of chunks to the pool,
+/// chunks not taken from it (flattened data) are freed by the serializer allocator
+static void chunk_pool_put_list(SerializerChunkPool *p_pool, Serializer *p_ser, SerializerChunk *p_chunk) {
+  assert(NULL != p_pool);
+  assert(NULL != p_ser);
+
+  SerializerChunk *p_owned = NULL;
+
+  pthread_mutex_lock(&p_pool->lock);
+  while (NULL != p_chunk) {
+    SerializerChunk *next = p_chunk->next;
+    if (p_chunk->is_pooled) {
+      p_chunk->next = p_pool->free_list;
+      p_pool->free_list = p_chunk;
+    } else {
+      p_chunk->next = p_owned;
+      p_owned = p_chunk;
+    }
+    p_chunk = next;
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+
+  // allocator callbacks do not run under the pool lock
+  while (NULL != p_owned) {
+    SerializerChunk *next = p_owned->next;
+    serializer_deallocate(p_ser, p_owned, sizeof(SerializerChunk) + p_owned->capacity);
+    p_owned = next;
+  }
+}
+
+/// Returns chunks linked after p_tail to the pool and makes p_tail the tail chunk again,
+/// all chunks are returned if p_tail is NULL. The caller restores count of the tail
+static void serializer_truncate_chunks(Serializer *p_ser, SerializerChunk *p_tail,
+                                       SerializerChunk *p_before_tail, size_t retired) {
+  assert(NULL != p_ser);
+  assert(NULL != p_ser->p_pool);
+
+  if (NULL == p_tail) {
+    chunk_pool_put_list(p_ser->p_pool, p_ser, p_ser->head);
+    p_ser->head = NULL;
+    p_ser->data = NULL;
+    p_ser->capacity = 0;
+  } else {
+    chunk_pool_put_list(p_ser->p_pool, p_ser, p_tail->next);
+    p_tail->next = NULL;
+    p_ser->data = p_tail->data;
+    p_ser->capacity = p_tail->capacity;
+  }
+
+  p_ser->tail = p_tail;
+  p_ser->before_tail = p_before_tail;
+  p_ser->retired = retired;
+}
+
+static bool serializer_next_chunk(Serializer *p_ser) {
+  assert(NULL != p_ser);
+  assert(NULL != p_ser->p_pool);
+
+  SerializerChunk *p_chunk = chunk_pool_get(p_ser->p_pool);
+  if (NULL == p_chunk) {
+    return false;
+  }
+
+  if (NULL == p_ser->tail) {
+    p_ser->head = p_chunk;
+  } else {
+    p_ser->retired += p_ser->count;
+    p_ser->tail->count = p_ser->count;
+    p_ser->tail->next = p_chunk;
+  }
+  p_ser->before_tail = p_ser->tail;
+  p_ser->tail = p_chunk;
+
+  p_ser->data = p_chunk->data;
+  p_ser->count = 0;
+  p_ser->capacity = p_chunk->capacity;
+  return true;
+}
+
 static bool serializer_data_maybe_expand(Serializer *p_ser) {
   assert(NULL != p_ser);
 
   if (p_ser->count == p_ser->capacity) {
-    p_ser->capacity *= SER_GROW_FACTOR;
-    char *tmp = (char*)realloc(p_ser->data, p_ser->capacity * sizeof(char));
+    if (NULL != p_ser->p_pool) {
+      return serializer_next_chunk(p_ser);
+    }
+
+    if (serializer_has_sink(p_ser)) {
+      // sink buffers never grow
+      return 0 != p_ser->capacity && serializer_sink_drain(p_ser, 1);
+    }
+
+    size_t capacity = 0 == p_ser->capacity ? SER_INIT_CAPACITY : p_ser->capacity * SER_GROW_FACTOR;
+    char *tmp = (char*)serializer_reallocate(p_ser, p_ser->data, p_ser->capacity, capacity * sizeof(char));
     if (NULL == tmp) {
       return false;
     }
     p_ser->data = tmp;
+    p_ser->capacity = capacity;
   }
 
   return true;
 }
 
-static bool serializer_init(Serializer *p_ser) {
+/// Returns pointer to the last byte that is still in the buffer or NULL if the buffer is empty.
+/// In segmented mode the byte may be the last one of the previous chunk
+static char *serializer_back(Serializer *p_ser) {
   assert(NULL != p_ser);
-  
-  p_ser->data = (char*)malloc(SER_INIT_CAPACITY * sizeof(char));
-  if (NULL == p_ser->data) {
-    return false;
+  if (0 != p_ser->count) {
+    return p_ser->data + p_ser->count - 1;
   }
 
-  p_ser->count = 0;
-  p_ser->capacity = SER_INIT_CAPACITY;
+  SerializerChunk *p_prev = p_ser->before_tail;
+  return NULL == p_prev || 0 == p_prev->count ? NULL : p_prev->data + p_prev->count - 1;
+}
 
-  return true;
+/// Removes the byte returned by serializer_back
+static void serializer_pop_back(Serializer *p_ser) {
+  assert(NULL != p_ser);
+  if (0 != p_ser->count) {
+    --p_ser->count;
+  } else {
+    assert(NULL != p_ser->before_tail && 0 != p_ser->before_tail->count);
+    --p_ser->before_tail->count;
+    --p_ser->retired;
+  }
 }
 
 static bool serializer_append_byte(Serializer *p_ser, char byte) {
@@ -71,10 +283,8 @@ static bool serializer_append_cstr(Serializer *p_ser, const char *str) {
 // ----------------- | PUBLIC |
 bool serializer_start_serialization(Serializer *p_ser, SerializationKind kind) {
   assert(NULL != p_ser);
-  // TODO: serializer free
-  if (!serializer_init(p_ser)) {
-    return false;
-  }
+  // buffer is allocated lazily by the first append
+  *p_ser = (Serializer){0};
 
 #ifndef NDEBUG
   p_ser->tag = kind;
@@ -89,6 +299,10 @@ bool serializer_end_serialization(Serializer *p_ser, SerializationKind kind) {
   assert(NULL != p_ser);
   assert(kind == p_ser->tag);
   
+  if (serializer_has_sink(p_ser)) {
+    return serializer_flush(p_ser);
+  }
+
   switch (kind) {
     case SER_KIND_JSON: return serializer_append_byte(p_ser, '\0');
     default: return false;
@@ -97,10 +311,203 @@ bool serializer_end_serialization(Serializer *p_ser, SerializationKind kind) {
 
 void serializer_free(Serializer *p_ser) {
   assert(NULL != p_ser);
-  free(p_ser->data);
+  if (NULL != p_ser->p_pool) {
+    chunk_pool_put_list(p_ser->p_pool, p_ser, p_ser->head);
+  } else if (NULL != p_ser->sink.exchange) {
+    if (NULL != p_ser->data) {
+      p_ser->sink.exchange(p_ser->sink.ctx, p_ser->data, 0, NULL);
+    }
+  } else {
+    serializer_deallocate(p_ser, p_ser->data, p_ser->capacity);
+  }
   *p_ser = (Serializer){0};
 }
 
+void serializer_set_allocator(Serializer *p_ser, SerializerAllocator allocator) {
+  assert(NULL != p_ser);
+  assert(NULL == p_ser->data && "allocator should be set before the first append");
+  assert((NULL == allocator.allocate) == (NULL == allocator.reallocate));
+  assert((NULL == allocator.allocate) == (NULL == allocator.free));
+
+  p_ser->allocator = allocator;
+}
+
+void serializer_set_refs(Serializer *p_ser, SerializerRefs *p_refs) {
+  assert(NULL != p_ser);
+  p_ser->p_refs = p_refs;
+}
+
+void serializer_use_chunks(Serializer *p_ser, SerializerChunkPool *p_pool) {
+  assert(NULL != p_ser);
+  assert(NULL != p_pool);
+  assert(NULL == p_ser->p_pool && !serializer_has_sink(p_ser));
+  assert(0 == p_ser->count);
+
+  serializer_deallocate(p_ser, p_ser->data, p_ser->capacity);
+  p_ser->data = NULL;
+  p_ser->capacity = 0;
+  p_ser->p_pool = p_pool;
+}
+
+void serializer_set_sink(Serializer *p_ser, SerializerSink sink) {
+  assert(NULL != p_ser);
+  assert(!serializer_has_sink(p_ser));
+  assert(NULL == p_ser->p_pool);
+  assert(NULL != sink.write || NULL != sink.exchange);
+
+  p_ser->sink = sink;
+  if (NULL != sink.exchange) {
+    size_t capacity = 0;
+    char *tmp = sink.exchange(sink.ctx, NULL, 0, &capacity);
+
+    // bytes written so far may not fit the buffer of the sink, full buffers are handed to it
+    // while more than a buffer is left, so the last byte stays and separators can be patched
+    size_t copied = 0;
+    while (NULL != tmp && capacity > 1 && p_ser->count - copied > capacity) {
+      memcpy(tmp, p_ser->data + copied, capacity);
+      copied += capacity;
+      p_ser->flushed += capacity;
+      tmp = sink.exchange(sink.ctx, tmp, capacity, &capacity);
+    }
+
+    if (NULL == tmp || capacity <= 1) {
+      if (NULL != tmp) {
+        sink.exchange(sink.ctx, tmp, 0, NULL);
+      }
+      // next append fails on the empty buffer
+      serializer_deallocate(p_ser, p_ser->data, p_ser->capacity);
+      p_ser->data = NULL;
+      p_ser->count = 0;
+      p_ser->capacity = 0;
+      return;
+    }
+
+    if (p_ser->count > copied) {
+      memcpy(tmp, p_ser->data + copied, p_ser->count - copied);
+    }
+    p_ser->count -= copied;
+    serializer_deallocate(p_ser, p_ser->data, p_ser->capacity);
+    p_ser->data = tmp;
+    p_ser->capacity = capacity;
+  } else if (p_ser->capacity < SER_SINK_CAPACITY) {
+    // buffer does not grow anymore, so one write(2) per 64 bytes should be avoided
+    char *tmp = (char*)serializer_reallocate(p_ser, p_ser->data, p_ser->capacity, SER_SINK_CAPACITY * sizeof(char));
+    if (NULL == tmp) {
+      return;
+    }
+    p_ser->data = tmp;
+    p_ser->capacity = SER_SINK_CAPACITY;
+  }
+}
+
+bool serializer_reserve(Serializer *p_ser, size_t additional) {
+  assert(NULL != p_ser);
+
+  if (NULL != p_ser->p_pool || serializer_has_sink(p_ser)
+    || p_ser->capacity - p_ser->count >= additional) {
+    return true;
+  }
+
+  size_t capacity = p_ser->capacity * SER_GROW_FACTOR;
+  if (capacity < p_ser->count + additional) capacity = p_ser->count + additional;
+  if (capacity < SER_INIT_CAPACITY) capacity = SER_INIT_CAPACITY;
+
+  char *tmp = (char*)serializer_reallocate(p_ser, p_ser->data, p_ser->capacity, capacity * sizeof(char));
+  if (NULL == tmp) {
+    return false;
+  }
+  p_ser->data = tmp;
+  p_ser->capacity = capacity;
+  return true;
+}
+
+size_t serializer_bytes_written(const Serializer *p_ser) {
+  assert(NULL != p_ser);
+  return p_ser->flushed + p_ser->retired + p_ser->count;
+}
+
+size_t serializer_size_hint_begin(Serializer *p_ser, SerializerSizeHint *p_hint) {
+  assert(NULL != p_ser);
+  assert(NULL != p_hint);
+
+  // failed reservation is not an error, appends will grow the buffer as usual
+  (void)serializer_reserve(p_ser, atomic_load_explicit(&p_hint->size, memory_order_relaxed));
+  return serializer_bytes_written(p_ser);
+}
+
+void serializer_size_hint_end(const Serializer *p_ser, SerializerSizeHint *p_hint, size_t begin) {
+  assert(NULL != p_ser);
+  assert(NULL != p_hint);
+
+  size_t size = serializer_bytes_written(p_ser) - begin;
+  size_t hint = atomic_load_explicit(&p_hint->size, memory_order_relaxed);
+  if (size < hint) {
+    size_t decayed = hint - ((hint - size) >> SER_SIZE_HINT_DECAY_SHIFT);
+    size = decayed < hint ? decayed : hint - 1;
+  }
+
+  if (size != hint) {
+    atomic_store_explicit(&p_hint->size, size, memory_order_relaxed);
+  }
+}
+
+bool serializer_flush(Serializer *p_ser) {
+  assert(NULL != p_ser);
+  if (!serializer_has_sink(p_ser)) {
+    return true;
+  }
+
+  return 0 == p_ser->count || serializer_sink_drain(p_ser, 0);
+}
+
+bool serializer_ndjson_start(Serializer *p_ser, SerializerBatch batch) {
+  assert(NULL != p_ser);
+  SER_VALIDATE(serializer_start_serialization(p_ser, SER_KIND_JSON));
+  p_ser->batch = batch;
+  return true;
+}
+
+bool serializer_ndjson_append(Serializer *p_ser, SerializeFunc func, const void *p_val) {
+  assert(NULL != p_ser);
+  assert(NULL != func);
+  assert(SER_KIND_JSON == p_ser->tag);
+
+  size_t record_begin = p_ser->count;
+  size_t flushed = p_ser->flushed;
+  size_t retired = p_ser->retired;
+  SerializerChunk *p_tail = p_ser->tail;
+  SerializerChunk *p_before_tail = p_ser->before_tail;
+  if (!func(p_ser, p_val) || !serializer_append_byte(p_ser, '\n')) {
+    if (NULL != p_ser->p_pool) {
+      serializer_truncate_chunks(p_ser, p_tail, p_before_tail, retired);
+      p_ser->count = record_begin;
+    } else if (flushed == p_ser->flushed) {
+      // growable buffer may have been reallocated, the record still starts at the same offset
+      p_ser->count = record_begin;
+    }
+    return false;
+  }
+
+  ++p_ser->batch_records;
+  if (!serializer_has_sink(p_ser)) {
+    return true;
+  }
+
+  if ((0 != p_ser->batch.max_records && p_ser->batch_records >= p_ser->batch.max_records)
+    || (0 != p_ser->batch.max_bytes && p_ser->count >= p_ser->batch.max_bytes)) {
+    p_ser->batch_records = 0;
+    return serializer_flush(p_ser);
+  }
+
+  return true;
+}
+
+bool serializer_ndjson_end(Serializer *p_ser) {
+  assert(NULL != p_ser);
+  p_ser->batch_records = 0;
+  return serializer_end_serialization(p_ser, SER_KIND_JSON);
+}
+
 bool serializer_json_start_object(Serializer *p_ser) {
   assert(NULL != p_ser);
   assert(SER_KIND_JSON == p_ser->tag);
@@ -109,16 +516,16 @@ bool serializer_json_start_object(Serializer *p_ser) {
 
 bool serializer_json_end_object(Serializer *p_ser) {
   assert(NULL != p_ser);
-  assert(0 != p_ser->count);
+  assert(NULL != serializer_back(p_ser) || serializer_has_sink(p_ser));
   assert(SER_KIND_JSON == p_ser->tag);
 
-  char *data_back = p_ser->data + p_ser->count - 1;
-  if (',' == *data_back) {
+  char *data_back = serializer_back(p_ser);
+  if (NULL != data_back && ',' == *data_back) {
     *data_back = '}';
     return true;
   }
   
-  assert('"' == *data_back || ']' == *data_back || '}' == *data_back);
+  assert(NULL == data_back || '{' == *data_back || '"' == *data_back || ']' == *data_back || '}' == *data_back);
   return serializer_append_byte(p_ser, '}');
 }
 
@@ -149,11 +556,11 @@ bool serializer_json_start_array(Serializer *p_ser) {
 
 bool serializer_json_end_array(Serializer *p_ser) {
   assert(NULL != p_ser);
-  assert(0 != p_ser->count);
+  assert(NULL != serializer_back(p_ser) || serializer_has_sink(p_ser));
   assert(SER_KIND_JSON == p_ser->tag);
 
-  char *data_back = p_ser->data + p_ser->count - 1;
-  if (',' == *data_back) {
+  char *data_back = serializer_back(p_ser);
+  if (NULL != data_back && ',' == *data_back) {
     *data_back = ']';
     return true;
   }
@@ -170,7 +577,10 @@ bool serializer_json_append_separator(Serializer *p_ser) {
 void serializer_json_remove_separator_at_end(Serializer *p_ser) {
   assert(NULL != p_ser);
   assert(SER_KIND_JSON == p_ser->tag);
-  p_ser->count -= ',' == p_ser->data[p_ser->count - 1];
+  char *data_back = serializer_back(p_ser);
+  if (NULL != data_back && ',' == *data_back) {
+    serializer_pop_back(p_ser);
+  }
 }
 
 
@@ -192,8 +602,40 @@ bool serializer_json_end_field(Serializer *p_ser) {
 }
 
 
-SerializerData serializer_get_data(const Serializer *p_ser) {
+SerializerData serializer_get_data(Serializer *p_ser) {
   assert(NULL != p_ser);
+
+  if (NULL != p_ser->p_pool && p_ser->head != p_ser->tail) {
+    p_ser->tail->count = p_ser->count;
+
+    size_t total = 0;
+    for (SerializerChunk *p_chunk = p_ser->head; NULL != p_chunk; p_chunk = p_chunk->next) {
+      total += p_chunk->count;
+    }
+
+    SerializerChunk *p_flat = (SerializerChunk*)serializer_allocate(p_ser, sizeof(SerializerChunk) + total);
+    if (NULL == p_flat) {
+      return (SerializerData){0};
+    }
+
+    char *iter = p_flat->data;
+    for (SerializerChunk *p_chunk = p_ser->head; NULL != p_chunk; p_chunk = p_chunk->next) {
+      memcpy(iter, p_chunk->data, p_chunk->count);
+      iter += p_chunk->count;
+    }
+    chunk_pool_put_list(p_ser->p_pool, p_ser, p_ser->head);
+
+    // flattened chunk becomes the only one, further appends link pool chunks after it
+    *p_flat = (SerializerChunk){ .next = NULL, .count = total, .capacity = total, .is_pooled = false };
+    p_ser->head = p_flat;
+    p_ser->tail = p_flat;
+    p_ser->before_tail = NULL;
+    p_ser->retired = 0;
+    p_ser->data = p_flat->data;
+    p_ser->count = total;
+    p_ser->capacity = total;
+  }
+
   return (SerializerData){
     .data = p_ser->data,
     .count = p_ser->count
@@ -201,6 +643,29 @@ SerializerData serializer_get_data(const Serializer *p_ser) {
 }
 
 
+size_t serializer_get_iovec(const Serializer *p_ser, struct iovec *iov, size_t iov_count) {
+  assert(NULL != p_ser);
+  assert(NULL != iov || 0 == iov_count);
+
+  if (NULL == p_ser->p_pool) {
+    if (iov_count > 0) {
+      iov[0] = (struct iovec){ .iov_base = p_ser->data, .iov_len = p_ser->count };
+    }
+    return 1;
+  }
+
+  size_t segments = 0;
+  for (SerializerChunk *p_chunk = p_ser->head; NULL != p_chunk; p_chunk = p_chunk->next, ++segments) {
+    if (segments < iov_count) {
+      size_t count = p_chunk == p_ser->tail ? p_ser->count : p_chunk->count;
+      iov[segments] = (struct iovec){ .iov_base = p_chunk->data, .iov_len = count };
+    }
+  }
+
+  return segments;
+}
+
+
 #define JSON_SERIALIZE_PRIMITIVE_IMPL(type, str_fmt)\
   do {\
     assert(NULL != p_ser);\
@@ -211,6 +676,12 @@ SerializerData serializer_get_data(const Serializer *p_ser) {
     return serializer_append_cstr(p_ser, buff);\
   } while (0)
 
+bool serializer_null_to_json(Serializer *p_ser) {
+  assert(NULL != p_ser);
+  assert(SER_KIND_JSON == p_ser->tag);
+  return serializer_append_cstr(p_ser, "null");
+}
+
 bool serializer_char_to_json(Serializer *p_ser, char val) {
   assert(NULL != p_ser);
   assert(SER_KIND_JSON == p_ser->tag);
@@ -330,3 +801,1374 @@ bool serializer_json_field_from_cstr(Serializer *p_ser, const char *name, const
 
 
 
+// ----------------- | ARRAYS |
+//
+// Kernels below format a whole array of primitives at once: elements and separators
+// are written into a stack buffer that is appended when full, output space is reserved up front
+
+#define SER_ARRAY_STAGE_SIZE 512
+
+static const char ser_digit_pairs[201] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static bool serializer_append_bytes(Serializer *p_ser, const char *data, size_t count) {
+  assert(NULL != p_ser);
+
+  while (count > 0) {
+    SER_VALIDATE(serializer_data_maybe_expand(p_ser));
+
+    size_t n = p_ser->capacity - p_ser->count;
+    if (n > count) n = count;
+    memcpy(p_ser->data + p_ser->count, data, n);
+    p_ser->count += n;
+    data += n;
+    count -= n;
+  }
+  return true;
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+/// Writes 8 decimal digits of value < 100000000 (with leading zeros) to dst.
+/// abcd and efgh halves are divided by 1000, 100, 10 and 1 at once in 16-bit lanes
+static void ser_format_8_digits(char *dst, uint32_t value) {
+  assert(value < 100000000);
+
+  // abcd, efgh = abcdefgh divmod 10000
+  const __m128i abcdefgh = _mm_cvtsi32_si128((int)value);
+  const __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, _mm_set1_epi32((int)0xd1b71759)), 45);
+  const __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+
+  // [ abcd * 4 x4, efgh * 4 x4 ]
+  const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+  const __m128i v2a = _mm_unpacklo_epi16(v1, v1);
+  const __m128i v2 = _mm_unpacklo_epi32(v2a, v2a);
+
+  // [ a, ab, abc, abcd, e, ef, efg, efgh ]
+  const __m128i v3 = _mm_mulhi_epu16(v2, _mm_setr_epi16(8389, 5243, 13108, (short)32768,
+                                                        8389, 5243, 13108, (short)32768));
+  const __m128i v4 = _mm_mulhi_epu16(v3, _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, (short)(1 << 15),
+                                                        1 << 7, 1 << 11, 1 << 13, (short)(1 << 15)));
+
+  // [ a, b, c, d, e, f, g, h ] = v4 - [ 0, a0, ab0, abc0, 0, e0, ef0, efg0 ]
+  const __m128i v5 = _mm_slli_epi64(_mm_mullo_epi16(v4, _mm_set1_epi16(10)), 16);
+  const __m128i digits = _mm_sub_epi16(v4, v5);
+
+  const __m128i ascii = _mm_add_epi8(_mm_packus_epi16(digits, _mm_setzero_si128()), _mm_set1_epi8('0'));
+  _mm_storel_epi64((__m128i*)dst, ascii);
+}
+
+#else
+
+/// Writes 8 decimal digits of value < 100000000 (with leading zeros) to dst
+static void ser_format_8_digits(char *dst, uint32_t value) {
+  assert(value < 100000000);
+
+  uint32_t high = value / 10000;
+  uint32_t low = value % 10000;
+  memcpy(dst, ser_digit_pairs + 2 * (high / 100), 2);
+  memcpy(dst + 2, ser_digit_pairs + 2 * (high % 100), 2);
+  memcpy(dst + 4, ser_digit_pairs + 2 * (low / 100), 2);
+  memcpy(dst + 6, ser_digit_pairs + 2 * (low % 100), 2);
+}
+
+#endif
+
+/// Writes value in decimal without leading zeros
+///
+/// @return size_t, number of characters written, at most 20
+static size_t ser_format_u64(char *dst, uint64_t value) {
+  if (value < 10) {
+    dst[0] = (char)('0' + value);
+    return 1;
+  }
+  if (value < 100) {
+    memcpy(dst, ser_digit_pairs + 2 * value, 2);
+    return 2;
+  }
+
+  // groups of 8 digits, the leading zeros of the first one are dropped
+  char digits[24];
+  size_t length = 8;
+  if (value < 100000000) {
+    ser_format_8_digits(digits, (uint32_t)value);
+  } else if (value < 10000000000000000ULL) {
+    ser_format_8_digits(digits, (uint32_t)(value / 100000000));
+    ser_format_8_digits(digits + 8, (uint32_t)(value % 100000000));
+    length = 16;
+  } else {
+    uint64_t low = value % 10000000000000000ULL;
+    ser_format_8_digits(digits, (uint32_t)(value / 10000000000000000ULL));
+    ser_format_8_digits(digits + 8, (uint32_t)(low / 100000000));
+    ser_format_8_digits(digits + 16, (uint32_t)(low % 100000000));
+    length = 24;
+  }
+
+  size_t skip = 0;
+  while ('0' == digits[skip]) ++skip;
+
+  memcpy(dst, digits + skip, length - skip);
+  return length - skip;
+}
+
+static size_t ser_format_i64(char *dst, int64_t value) {
+  if (value >= 0) {
+    return ser_format_u64(dst, (uint64_t)value);
+  }
+
+  dst[0] = '-';
+  return 1 + ser_format_u64(dst + 1, 0 - (uint64_t)value);
+}
+
+static size_t ser_format_char(char *dst, char value) {
+  dst[0] = '"';
+  dst[1] = value;
+  dst[2] = '"';
+  return 3;
+}
+
+/// Writes [v0,v1,...] of count elements of p_vals, format_expr writes val of type to dst
+/// and evaluates to the number of characters written, at most max_length
+#define JSON_SERIALIZE_ARRAY_IMPL(type, max_length, format_expr)\
+  do {\
+    assert(NULL != p_ser);\
+    assert(SER_KIND_JSON == p_ser->tag);\
+    assert(NULL != p_vals || 0 == count);\
+    if (count < (SIZE_MAX - 2) / ((max_length) + 1)) {\
+      SER_VALIDATE(serializer_reserve(p_ser, 2 + count * ((max_length) + 1)));\
+    }\
+    char stage[SER_ARRAY_STAGE_SIZE];\
+    size_t used = 0;\
+    stage[used++] = '[';\
+    for (size_t i = 0; i < count; ++i) {\
+      if (used + (max_length) + 2 > SER_ARRAY_STAGE_SIZE) {\
+        SER_VALIDATE(serializer_append_bytes(p_ser, stage, used));\
+        used = 0;\
+      }\
+      type val = p_vals[i];\
+      char *dst = stage + used;\
+      used += (format_expr);\
+      stage[used++] = ',';\
+    }\
+    if (0 == count) {\
+      stage[used++] = ']';\
+    } else {\
+      stage[used - 1] = ']';\
+    }\
+    return serializer_append_bytes(p_ser, stage, used);\
+  } while (0)
+
+bool serializer_char_array_to_json(Serializer *p_ser, const char *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(char, 3, ser_format_char(dst, val));
+}
+
+bool serializer_fixed_cstr_to_json(Serializer *p_ser, const char *p_chars, size_t capacity) {
+  assert(NULL != p_ser);
+  assert(SER_KIND_JSON == p_ser->tag);
+  assert(NULL != p_chars || 0 == capacity);
+
+  static const char hex_digits[] = "0123456789abcdef";
+
+  const char *p_nul = (const char*)memchr(p_chars, '\0', capacity);
+  size_t length = NULL == p_nul ? capacity : (size_t)(p_nul - p_chars);
+  SER_VALIDATE(serializer_append_byte(p_ser, '"'));
+
+  // runs of characters that need no escaping are appended at once
+  size_t run_begin = 0;
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char c = (unsigned char)p_chars[i];
+    if (c >= 0x20 && '"' != c && '\\' != c) {
+      continue;
+    }
+
+    SER_VALIDATE(serializer_append_bytes(p_ser, p_chars + run_begin, i - run_begin));
+    run_begin = i + 1;
+
+    char escape[6] = { '\\', (char)c };
+    size_t escape_length = 2;
+    switch (c) {
+      case '"': case '\\': break;
+      case '\b': escape[1] = 'b'; break;
+      case '\f': escape[1] = 'f'; break;
+      case '\n': escape[1] = 'n'; break;
+      case '\r': escape[1] = 'r'; break;
+      case '\t': escape[1] = 't'; break;
+      default:
+        memcpy(escape + 1, "u00", 3);
+        escape[4] = hex_digits[c >> 4];
+        escape[5] = hex_digits[c & 15];
+        escape_length = 6;
+        break;
+    }
+    SER_VALIDATE(serializer_append_bytes(p_ser, escape, escape_length));
+  }
+  SER_VALIDATE(serializer_append_bytes(p_ser, p_chars + run_begin, length - run_begin));
+
+  return serializer_append_byte(p_ser, '"');
+}
+
+bool serializer_short_array_to_json(Serializer *p_ser, const short *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(short, 6, ser_format_i64(dst, val));
+}
+
+bool serializer_int_array_to_json(Serializer *p_ser, const int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(int, 11, ser_format_i64(dst, val));
+}
+
+bool serializer_long_int_array_to_json(Serializer *p_ser, const long int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(long int, 20, ser_format_i64(dst, val));
+}
+
+bool serializer_long_long_int_array_to_json(Serializer *p_ser, const long long int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(long long int, 20, ser_format_i64(dst, val));
+}
+
+bool serializer_u_short_array_to_json(Serializer *p_ser, const unsigned short *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(unsigned short, 5, ser_format_u64(dst, val));
+}
+
+bool serializer_u_int_array_to_json(Serializer *p_ser, const unsigned int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(unsigned int, 10, ser_format_u64(dst, val));
+}
+
+bool serializer_u_long_int_array_to_json(Serializer *p_ser, const unsigned long int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(unsigned long int, 20, ser_format_u64(dst, val));
+}
+
+bool serializer_u_long_long_int_array_to_json(Serializer *p_ser, const unsigned long long int *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(unsigned long long int, 20, ser_format_u64(dst, val));
+}
+
+bool serializer_float_array_to_json(Serializer *p_ser, const float *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(float, 16, (size_t)snprintf(dst, 17, "%.7g", val));
+}
+
+bool serializer_double_array_to_json(Serializer *p_ser, const double *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(double, 24, (size_t)snprintf(dst, 25, "%.15g", val));
+}
+
+bool serializer_long_double_array_to_json(Serializer *p_ser, const long double *p_vals, size_t count) {
+  JSON_SERIALIZE_ARRAY_IMPL(long double, 32, (size_t)snprintf(dst, 33, "%.*Lg", LDBL_DIG, val));
+}
+
+
+
+// ----------------- | BYTES |
+//
+// Encoders of raw byte buffers (@bytes fields), whole 16-byte blocks are encoded
+// with SIMD when the target has it, the rest byte by byte
+
+#define SER_BYTES_STAGE_SIZE 4096
+
+static const char ser_base64_alphabet[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+
+/// Encodes 12 bytes of src per 16 characters of dst while at least 16 bytes can be read.
+/// Bytes are split into 6-bit indices in 8-bit lanes, then every index gets the offset
+/// of its range of the alphabet from a 16-entry table
+///
+/// @return size_t, number of bytes encoded, a multiple of 12
+static size_t ser_base64_encode_blocks(char *dst, const uint8_t *src, size_t count) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                        '/' - 63, 'A', 0, 0);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 12) {
+    // [ b1 b0 b2 b1 ] per 3 bytes, 4 indices are shifted out of every 32-bit lane
+    const __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle);
+    const __m128i ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    const __m128i bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(ac, bd);
+
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i is_upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    ranges = _mm_or_si128(ranges, _mm_and_si128(is_upper, _mm_set1_epi8(13)));
+
+    const __m128i ascii = _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, ranges));
+    _mm_storeu_si128((__m128i*)(dst + i / 3 * 4), ascii);
+  }
+  return i;
+}
+
+#else
+
+static size_t ser_base64_encode_blocks(char *dst, const uint8_t *src, size_t count) {
+  (void)dst;
+  (void)src;
+  (void)count;
+  return 0;
+}
+
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+/// Encodes 16 bytes of src per 32 characters of dst, nibbles above 9 are moved to 'a'..'f'
+///
+/// @return size_t, number of bytes encoded, a multiple of 16
+static size_t ser_hex_encode_blocks(char *dst, const uint8_t *src, size_t count) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(in, 4), nibble);
+    __m128i low = _mm_and_si128(in, nibble);
+
+    high = _mm_add_epi8(_mm_add_epi8(high, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letters));
+    low = _mm_add_epi8(_mm_add_epi8(low, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letters));
+
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+  }
+  return i;
+}
+
+#else
+
+static size_t ser_hex_encode_blocks(char *dst, const uint8_t *src, size_t count) {
+  (void)dst;
+  (void)src;
+  (void)count;
+  return 0;
+}
+
+#endif
+
+size_t serializer_base64_encode(char *dst, const void *p_src, size_t count) {
+  assert(NULL != dst || 0 == count);
+  assert(NULL != p_src || 0 == count);
+
+  const uint8_t *src = (const uint8_t*)p_src;
+  size_t i = ser_base64_encode_blocks(dst, src, count);
+  char *p = dst + i / 3 * 4;
+
+  for (; i + 3 <= count; i += 3) {
+    uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i + 1] << 8 | src[i + 2];
+    p[0] = ser_base64_alphabet[v >> 18];
+    p[1] = ser_base64_alphabet[(v >> 12) & 63];
+    p[2] = ser_base64_alphabet[(v >> 6) & 63];
+    p[3] = ser_base64_alphabet[v & 63];
+    p += 4;
+  }
+
+  if (i < count) {
+    bool has_second = i + 1 < count;
+    uint32_t v = (uint32_t)src[i] << 16 | (has_second ? (uint32_t)src[i + 1] << 8 : 0);
+    p[0] = ser_base64_alphabet[v >> 18];
+    p[1] = ser_base64_alphabet[(v >> 12) & 63];
+    p[2] = has_second ? ser_base64_alphabet[(v >> 6) & 63] : '=';
+    p[3] = '=';
+    p += 4;
+  }
+
+  return (size_t)(p - dst);
+}
+
+/// Returns value of the base64 character, -1 if it is not one
+static int ser_base64_value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if ('+' == c) return 62;
+  if ('/' == c) return 63;
+  return -1;
+}
+
+bool serializer_base64_decode(void *p_dst, size_t *p_count, const char *src, size_t length) {
+  assert(NULL != p_dst || 0 == length);
+  assert(NULL != p_count);
+  assert(NULL != src || 0 == length);
+
+  if (0 != length % 4) {
+    return false;
+  }
+
+  uint8_t *dst = (uint8_t*)p_dst;
+  size_t count = 0;
+  for (size_t i = 0; i < length; i += 4) {
+    // only the last quantum can be padded
+    int padding = 0;
+    if (i + 4 == length && '=' == src[i + 3]) {
+      padding = '=' == src[i + 2] ? 2 : 1;
+    }
+
+    int a = ser_base64_value(src[i]);
+    int b = ser_base64_value(src[i + 1]);
+    int c = padding > 1 ? 0 : ser_base64_value(src[i + 2]);
+    int d = padding > 0 ? 0 : ser_base64_value(src[i + 3]);
+    if ((a | b | c | d) < 0) {
+      return false;
+    }
+
+    uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+    dst[count++] = (uint8_t)(v >> 16);
+    if (padding < 2) dst[count++] = (uint8_t)(v >> 8);
+    if (padding < 1) dst[count++] = (uint8_t)v;
+  }
+
+  *p_count = count;
+  return true;
+}
+
+size_t serializer_hex_encode(char *dst, const void *p_src, size_t count) {
+  assert(NULL != dst || 0 == count);
+  assert(NULL != p_src || 0 == count);
+
+  static const char digits[] = "0123456789abcdef";
+
+  const uint8_t *src = (const uint8_t*)p_src;
+  for (size_t i = ser_hex_encode_blocks(dst, src, count); i < count; ++i) {
+    dst[2 * i] = digits[src[i] >> 4];
+    dst[2 * i + 1] = digits[src[i] & 15];
+  }
+  return 2 * count;
+}
+
+/// Returns value of the hex digit, -1 if it is not one
+static int ser_hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool serializer_hex_decode(void *p_dst, const char *src, size_t length) {
+  assert(NULL != p_dst || 0 == length);
+  assert(NULL != src || 0 == length);
+
+  if (0 != length % 2) {
+    return false;
+  }
+
+  uint8_t *dst = (uint8_t*)p_dst;
+  for (size_t i = 0; i < length; i += 2) {
+    int high = ser_hex_value(src[i]);
+    int low = ser_hex_value(src[i + 1]);
+    if ((high | low) < 0) {
+      return false;
+    }
+    dst[i / 2] = (uint8_t)(high << 4 | low);
+  }
+  return true;
+}
+
+/// Writes count bytes of p_bytes as one JSON string of encoded_size characters.
+/// Encodes straight into the buffer when it has room, otherwise chunk_size bytes
+/// (at most SER_BYTES_STAGE_SIZE characters) at a time through a stack buffer
+static bool serializer_bytes_to_json(Serializer *p_ser, const void *p_bytes, size_t count, size_t encoded_size,
+                                     size_t chunk_size, size_t (*encode)(char*, const void*, size_t)) {
+  assert(NULL != p_ser);
+  assert(SER_KIND_JSON == p_ser->tag);
+  assert(NULL != p_bytes || 0 == count);
+
+  if (encoded_size < SIZE_MAX - 2) {
+    SER_VALIDATE(serializer_reserve(p_ser, encoded_size + 2));
+  }
+
+  if (encoded_size < SIZE_MAX - 2 && p_ser->capacity - p_ser->count >= encoded_size + 2) {
+    char *dst = p_ser->data + p_ser->count;
+    dst[0] = '"';
+    encode(dst + 1, p_bytes, count);
+    dst[encoded_size + 1] = '"';
+    p_ser->count += encoded_size + 2;
+    return true;
+  }
+
+  const uint8_t *src = (const uint8_t*)p_bytes;
+  char stage[SER_BYTES_STAGE_SIZE + 2];
+  size_t used = 0;
+  stage[used++] = '"';
+  while (count > chunk_size) {
+    used += encode(stage + used, src, chunk_size);
+    SER_VALIDATE(serializer_append_bytes(p_ser, stage, used));
+    src += chunk_size;
+    count -= chunk_size;
+    used = 0;
+  }
+  used += encode(stage + used, src, count);
+  stage[used++] = '"';
+  return serializer_append_bytes(p_ser, stage, used);
+}
+
+bool serializer_bytes_base64_to_json(Serializer *p_ser, const void *p_bytes, size_t count) {
+  size_t encoded_size = count < SIZE_MAX / 4 ? SER_BASE64_ENCODED_SIZE(count) : SIZE_MAX;
+  return serializer_bytes_to_json(p_ser, p_bytes, count, encoded_size,
+                                  SER_BYTES_STAGE_SIZE / 4 * 3, serializer_base64_encode);
+}
+
+bool serializer_bytes_hex_to_json(Serializer *p_ser, const void *p_bytes, size_t count) {
+  size_t encoded_size = count < SIZE_MAX / 2 ? 2 * count : SIZE_MAX;
+  return serializer_bytes_to_json(p_ser, p_bytes, count, encoded_size,
+                                  SER_BYTES_STAGE_SIZE / 2, serializer_hex_encode);
+}
+
+
+
+// ----------------- | TABLES |
+//
+// Interpreter of generated field tables: one small loop shared by all types
+// instead of unrolled code per type
+
+/// Reads the integer of kind at p
+static size_t ser_table_read_size(const char *p, uint8_t kind) {
+  switch (kind) {
+    case SER_FIELD_CHAR: return (size_t)*(const char*)p;
+    case SER_FIELD_SHORT: return (size_t)*(const short*)p;
+    case SER_FIELD_INT: return (size_t)*(const int*)p;
+    case SER_FIELD_LONG_INT: return (size_t)*(const long int*)p;
+    case SER_FIELD_LONG_LONG_INT: return (size_t)*(const long long int*)p;
+    case SER_FIELD_U_SHORT: return (size_t)*(const unsigned short*)p;
+    case SER_FIELD_U_INT: return (size_t)*(const unsigned int*)p;
+    case SER_FIELD_U_LONG_INT: return (size_t)*(const unsigned long int*)p;
+    case SER_FIELD_U_LONG_LONG_INT: return (size_t)*(const unsigned long long int*)p;
+    default: assert(false && "not an integer"); return 0;
+  }
+}
+
+static bool serializer_u64_to_json(Serializer *p_ser, uint64_t val) {
+  char buff[24];
+  return serializer_append_bytes(p_ser, buff, ser_format_u64(buff, val));
+}
+
+/// Serializes the value (or element) of the field at p, null if one of its pointers is NULL
+static bool serializer_table_value_to_json(Serializer *p_ser, const SerializerField *p_field, const char *p) {
+  for (uint8_t i = 0; i < p_field->indirections; ++i) {
+    p = *(const char* const*)p;
+    if (NULL == p) {
+      return serializer_null_to_json(p_ser);
+    }
+  }
+
+  switch (p_field->kind) {
+    case SER_FIELD_CHAR: return serializer_char_to_json(p_ser, *(const char*)p);
+    case SER_FIELD_SHORT: return serializer_short_to_json(p_ser, *(const short*)p);
+    case SER_FIELD_INT: return serializer_int_to_json(p_ser, *(const int*)p);
+    case SER_FIELD_LONG_INT: return serializer_long_int_to_json(p_ser, *(const long int*)p);
+    case SER_FIELD_LONG_LONG_INT: return serializer_long_long_int_to_json(p_ser, *(const long long int*)p);
+    case SER_FIELD_U_SHORT: return serializer_u64_to_json(p_ser, *(const unsigned short*)p);
+    case SER_FIELD_U_INT: return serializer_u64_to_json(p_ser, *(const unsigned int*)p);
+    case SER_FIELD_U_LONG_INT: return serializer_u64_to_json(p_ser, *(const unsigned long int*)p);
+    case SER_FIELD_U_LONG_LONG_INT: return serializer_u64_to_json(p_ser, *(const unsigned long long int*)p);
+    case SER_FIELD_FLOAT: return serializer_float_to_json(p_ser, *(const float*)p);
+    case SER_FIELD_DOUBLE: return serializer_double_to_json(p_ser, *(const double*)p);
+    case SER_FIELD_LONG_DOUBLE: return serializer_long_double_to_json(p_ser, *(const long double*)p);
+    case SER_FIELD_STRUCT: return serializer_table_to_json(p_ser, p_field->p_type, p);
+    default: assert(false && "not reachable"); return false;
+  }
+}
+
+/// Serializes count elements of the field starting at p as JSON array
+static bool serializer_table_elements_to_json(Serializer *p_ser, const SerializerField *p_field,
+                                              const char *p, size_t count) {
+  if (0 == p_field->indirections) {
+    switch (p_field->kind) {
+      case SER_FIELD_CHAR: return serializer_char_array_to_json(p_ser, (const char*)p, count);
+      case SER_FIELD_SHORT: return serializer_short_array_to_json(p_ser, (const short*)p, count);
+      case SER_FIELD_INT: return serializer_int_array_to_json(p_ser, (const int*)p, count);
+      case SER_FIELD_LONG_INT: return serializer_long_int_array_to_json(p_ser, (const long int*)p, count);
+      case SER_FIELD_LONG_LONG_INT:
+        return serializer_long_long_int_array_to_json(p_ser, (const long long int*)p, count);
+      case SER_FIELD_U_SHORT: return serializer_u_short_array_to_json(p_ser, (const unsigned short*)p, count);
+      case SER_FIELD_U_INT: return serializer_u_int_array_to_json(p_ser, (const unsigned int*)p, count);
+      case SER_FIELD_U_LONG_INT:
+        return serializer_u_long_int_array_to_json(p_ser, (const unsigned long int*)p, count);
+      case SER_FIELD_U_LONG_LONG_INT:
+        return serializer_u_long_long_int_array_to_json(p_ser, (const unsigned long long int*)p, count);
+      case SER_FIELD_FLOAT: return serializer_float_array_to_json(p_ser, (const float*)p, count);
+      case SER_FIELD_DOUBLE: return serializer_double_array_to_json(p_ser, (const double*)p, count);
+      case SER_FIELD_LONG_DOUBLE: return serializer_long_double_array_to_json(p_ser, (const long double*)p, count);
+      default: break;
+    }
+  }
+
+  SER_VALIDATE(serializer_json_start_array(p_ser));
+  for (size_t i = 0; i < count; ++i) {
+    SER_VALIDATE(serializer_table_value_to_json(p_ser, p_field, p + i * p_field->stride));
+    SER_VALIDATE(serializer_json_append_separator(p_ser));
+  }
+  return serializer_json_end_array(p_ser);
+}
+
+/// Serializes dimensions of fixed-size array from dim on, starting at p, as nested JSON arrays
+static bool serializer_table_dims_to_json(Serializer *p_ser, const SerializerField *p_field,
+                                          const char *p, uint32_t dim) {
+  // rows of chars are text
+  if (dim + 1 == p_field->dims_count && SER_FIELD_CHAR == p_field->kind && 0 == p_field->indirections) {
+    return serializer_fixed_cstr_to_json(p_ser, p, p_field->dims[dim]);
+  }
+  if (dim + 1 == p_field->dims_count) {
+    return serializer_table_elements_to_json(p_ser, p_field, p, p_field->dims[dim]);
+  }
+
+  size_t row_size = p_field->stride;
+  for (uint32_t d = dim + 1; d < p_field->dims_count; ++d) {
+    row_size *= p_field->dims[d];
+  }
+
+  SER_VALIDATE(serializer_json_start_array(p_ser));
+  for (uint32_t i = 0; i < p_field->dims[dim]; ++i) {
+    SER_VALIDATE(serializer_table_dims_to_json(p_ser, p_field, p + i * row_size, dim + 1));
+    SER_VALIDATE(serializer_json_append_separator(p_ser));
+  }
+  return serializer_json_end_array(p_ser);
+}
+
+/// Serializes @bytes field at p of the struct at p_struct as one JSON string
+static bool serializer_table_bytes_to_json(Serializer *p_ser, const SerializerField *p_field,
+                                           const char *p_struct, const char *p) {
+  size_t count = 0;
+  if (p_field->is_array) {
+    count = ser_table_read_size(p_struct + p_field->size_offset, p_field->size_kind);
+    p = *(const char* const*)p;
+  } else {
+    assert(1 == p_field->dims_count);
+    count = p_field->dims[0];
+  }
+
+  if (SER_FIELD_BYTES_HEX == p_field->kind) {
+    return serializer_bytes_hex_to_json(p_ser, p, count);
+  }
+  return serializer_bytes_base64_to_json(p_ser, p, count);
+}
+
+/// Serializes the field of the struct at p_struct as "key":value,
+static bool serializer_table_field_to_json(Serializer *p_ser, const SerializerField *p_field, const char *p_struct) {
+  const char *p = p_struct + p_field->offset;
+
+  SER_VALIDATE(serializer_append_bytes(p_ser, p_field->key, p_field->key_length));
+
+  if (SER_FIELD_CALLBACK == p_field->kind) {
+    for (uint8_t i = 0; i < p_field->indirections; ++i) {
+      p = *(const char* const*)p;
+    }
+    SER_VALIDATE(p_field->callback(p_ser, p));
+  } else if (SER_FIELD_BYTES_BASE64 == p_field->kind || SER_FIELD_BYTES_HEX == p_field->kind) {
+    SER_VALIDATE(serializer_table_bytes_to_json(p_ser, p_field, p_struct, p));
+  } else if (p_field->is_array) {
+    size_t count = ser_table_read_size(p_struct + p_field->size_offset, p_field->size_kind);
+    SER_VALIDATE(serializer_table_elements_to_json(p_ser, p_field, *(const char* const*)p, count));
+  } else if (p_field->dims_count > 0) {
+    SER_VALIDATE(serializer_table_dims_to_json(p_ser, p_field, p, 0));
+  } else {
+    SER_VALIDATE(serializer_table_value_to_json(p_ser, p_field, p));
+  }
+
+  return serializer_json_end_field(p_ser);
+}
+
+bool serializer_table_to_json(Serializer *p_ser, const SerializerType *p_type, const void *p_val) {
+  assert(NULL != p_ser);
+  assert(NULL != p_type);
+  assert(NULL != p_val);
+  assert(SER_KIND_JSON == p_ser->tag);
+
+  bool is_new = true;
+  SER_VALIDATE(serializer_json_start_shared_object(p_ser, p_val, p_type, &is_new));
+  if (!is_new) {
+    return true;
+  }
+
+  for (uint32_t i = 0; i < p_type->fields_count; ++i) {
+    SER_VALIDATE(serializer_table_field_to_json(p_ser, p_type->fields + i, (const char*)p_val));
+  }
+  return serializer_json_end_object(p_ser);
+}
+
+/// Returns index of the lowest set bit of non-zero mask
+static unsigned int ser_mask_lowest(uint64_t mask) {
+#if defined(__GNUC__)
+  return (unsigned int)__builtin_ctzll(mask);
+#else
+  unsigned int index = 0;
+  while (0 == (mask & 1)) {
+    mask >>= 1;
+    ++index;
+  }
+  return index;
+#endif
+}
+
+bool serializer_table_to_json_masked(Serializer *p_ser, const SerializerType *p_type, const void *p_val,
+                                     uint64_t mask) {
+  assert(NULL != p_ser);
+  assert(NULL != p_type);
+  assert(NULL != p_val);
+  assert(SER_KIND_JSON == p_ser->tag);
+  assert(p_type->fields_count <= 64);
+
+  if (p_type->fields_count < 64) {
+    mask &= ((uint64_t)1 << p_type->fields_count) - 1;
+  }
+
+  // only selected fields are visited, unselected ones cost nothing
+  SER_VALIDATE(serializer_json_start_object(p_ser));
+  for (; 0 != mask; mask &= mask - 1) {
+    SER_VALIDATE(serializer_table_field_to_json(p_ser, p_type->fields + ser_mask_lowest(mask), (const char*)p_val));
+  }
+  return serializer_json_end_object(p_ser);
+}
+
+
+
+// ----------------- | FRAGMENTS |
+bool serializer_fragments_init(SerializerFragments *p_fragments, uint32_t fields_count) {
+  assert(NULL != p_fragments);
+  assert(fields_count <= 64);
+
+  *p_fragments = (SerializerFragments){0};
+  if (fields_count > 0) {
+    p_fragments->fragments = (SerializerFragment*)calloc(fields_count, sizeof(SerializerFragment));
+    if (NULL == p_fragments->fragments) {
+      return false;
+    }
+  }
+
+  p_fragments->fields_count = fields_count;
+  p_fragments->dirty = 64 == fields_count ? ~(uint64_t)0 : ((uint64_t)1 << fields_count) - 1;
+  return serializer_start_serialization(&p_fragments->scratch, SER_KIND_JSON);
+}
+
+void serializer_fragments_free(SerializerFragments *p_fragments) {
+  assert(NULL != p_fragments);
+
+  for (uint32_t i = 0; i < p_fragments->fields_count; ++i) {
+    free(p_fragments->fragments[i].data);
+  }
+  free(p_fragments->fragments);
+  serializer_free(&p_fragments->scratch);
+  *p_fragments = (SerializerFragments){0};
+}
+
+Serializer *serializer_fragment_begin(SerializerFragments *p_fragments, uint32_t field) {
+  assert(NULL != p_fragments);
+  assert(field < p_fragments->fields_count);
+
+  if (0 == (p_fragments->dirty & ((uint64_t)1 << field))) {
+    return NULL;
+  }
+
+  // the buffer of the fragment is lent to the scratch serializer, so it is formatted in place;
+  // a buffer left by a formatting that has failed belongs to nobody
+  Serializer *p_scratch = &p_fragments->scratch;
+  free(p_scratch->data);
+
+  SerializerFragment *p_fragment = p_fragments->fragments + field;
+  p_scratch->data = p_fragment->data;
+  p_scratch->capacity = p_fragment->capacity;
+  p_scratch->count = 0;
+  *p_fragment = (SerializerFragment){0};
+  return p_scratch;
+}
+
+bool serializer_fragment_end(SerializerFragments *p_fragments, uint32_t field) {
+  assert(NULL != p_fragments);
+  assert(field < p_fragments->fields_count);
+
+  Serializer *p_scratch = &p_fragments->scratch;
+  p_fragments->fragments[field] = (SerializerFragment){
+    .data = p_scratch->data,
+    .count = p_scratch->count,
+    .capacity = p_scratch->capacity
+  };
+  p_scratch->data = NULL;
+  p_scratch->count = p_scratch->capacity = 0;
+
+  p_fragments->dirty &= ~((uint64_t)1 << field);
+  return true;
+}
+
+bool serializer_fragment_append(Serializer *p_ser, const SerializerFragments *p_fragments, uint32_t field) {
+  assert(NULL != p_ser);
+  assert(NULL != p_fragments);
+  assert(field < p_fragments->fields_count);
+
+  const SerializerFragment *p_fragment = p_fragments->fragments + field;
+  return serializer_append_bytes(p_ser, p_fragment->data, p_fragment->count);
+}
+
+bool serializer_table_to_json_incremental(Serializer *p_ser, const SerializerType *p_type, const void *p_val,
+                                          SerializerFragments *p_fragments) {
+  assert(NULL != p_ser);
+  assert(NULL != p_type);
+  assert(NULL != p_val);
+  assert(NULL != p_fragments);
+  assert(p_type->fields_count == p_fragments->fields_count);
+  assert(SER_KIND_JSON == p_ser->tag);
+
+  SER_VALIDATE(serializer_json_start_object(p_ser));
+  for (uint32_t i = 0; i < p_type->fields_count; ++i) {
+    Serializer *p_scratch = serializer_fragment_begin(p_fragments, i);
+    if (NULL != p_scratch) {
+      SER_VALIDATE(serializer_table_field_to_json(p_scratch, p_type->fields + i, (const char*)p_val));
+      SER_VALIDATE(serializer_fragment_end(p_fragments, i));
+    }
+    SER_VALIDATE(serializer_fragment_append(p_ser, p_fragments, i));
+  }
+  return serializer_json_end_object(p_ser);
+}
+
+
+
+// ----------------- | REFS |
+#define SER_REFS_MIN_SLOTS 64
+
+void serializer_refs_init(SerializerRefs *p_refs) {
+  assert(NULL != p_refs);
+  *p_refs = (SerializerRefs){0};
+}
+
+void serializer_refs_reset(SerializerRefs *p_refs) {
+  assert(NULL != p_refs);
+
+  if (p_refs->refs_count > 0) {
+    memset(p_refs->slots, 0, p_refs->slots_capacity * sizeof(uint32_t));
+  }
+  p_refs->refs_count = 0;
+}
+
+void serializer_refs_free(SerializerRefs *p_refs) {
+  assert(NULL != p_refs);
+
+  free(p_refs->refs);
+  free(p_refs->slots);
+  *p_refs = (SerializerRefs){0};
+}
+
+/// Fibonacci hashing of the address and the type, the high half is well mixed
+static uint32_t ser_refs_slot(const SerializerRefs *p_refs, const void *p_val, const void *p_type) {
+  uint64_t key = (uint64_t)(uintptr_t)p_val ^ ((uint64_t)(uintptr_t)p_type << 1);
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (p_refs->slots_capacity - 1);
+}
+
+/// Doubles the slots (or allocates the first ones) and inserts all refs again
+static bool ser_refs_grow(SerializerRefs *p_refs) {
+  uint32_t capacity = 0 == p_refs->slots_capacity ? SER_REFS_MIN_SLOTS : p_refs->slots_capacity * 2;
+  uint32_t *slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+  if (NULL == slots) {
+    return false;
+  }
+
+  free(p_refs->slots);
+  p_refs->slots = slots;
+  p_refs->slots_capacity = capacity;
+
+  for (uint32_t i = 0; i < p_refs->refs_count; ++i) {
+    uint32_t slot = ser_refs_slot(p_refs, p_refs->refs[i].p_val, p_refs->refs[i].p_type);
+    while (0 != slots[slot]) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = i + 1;
+  }
+  return true;
+}
+
+uint32_t serializer_refs_visit(SerializerRefs *p_refs, const void *p_val, const void *p_type, bool *p_is_new) {
+  assert(NULL != p_refs);
+  assert(NULL != p_is_new);
+
+  // at most half of the slots are used, so probe sequences stay short
+  if (2 * (p_refs->refs_count + 1) > p_refs->slots_capacity && !ser_refs_grow(p_refs)) {
+    return 0;
+  }
+
+  uint32_t mask = p_refs->slots_capacity - 1;
+  uint32_t slot = ser_refs_slot(p_refs, p_val, p_type);
+  for (; 0 != p_refs->slots[slot]; slot = (slot + 1) & mask) {
+    const SerializerRef *p_ref = p_refs->refs + p_refs->slots[slot] - 1;
+    if (p_ref->p_val == p_val && p_ref->p_type == p_type) {
+      *p_is_new = false;
+      return p_refs->slots[slot];
+    }
+  }
+
+  if (p_refs->refs_count == p_refs->refs_capacity) {
+    uint32_t capacity = 0 == p_refs->refs_capacity ? SER_REFS_MIN_SLOTS / 2 : p_refs->refs_capacity * 2;
+    SerializerRef *refs = (SerializerRef*)realloc(p_refs->refs, capacity * sizeof(SerializerRef));
+    if (NULL == refs) {
+      return 0;
+    }
+    p_refs->refs = refs;
+    p_refs->refs_capacity = capacity;
+  }
+
+  p_refs->refs[p_refs->refs_count++] = (SerializerRef){ .p_val = p_val, .p_type = p_type };
+  p_refs->slots[slot] = p_refs->refs_count;
+  *p_is_new = true;
+  return p_refs->refs_count;
+}
+
+const SerializerRef *serializer_refs_find(const SerializerRefs *p_refs, uint32_t id) {
+  assert(NULL != p_refs);
+  return 0 == id || id > p_refs->refs_count ? NULL : p_refs->refs + id - 1;
+}
+
+bool serializer_json_start_shared_object(Serializer *p_ser, const void *p_val, const void *p_type, bool *p_is_new) {
+  assert(NULL != p_ser);
+  assert(NULL != p_is_new);
+  assert(SER_KIND_JSON == p_ser->tag);
+
+  *p_is_new = true;
+  if (NULL == p_ser->p_refs) {
+    return serializer_json_start_object(p_ser);
+  }
+
+  uint32_t id = serializer_refs_visit(p_ser->p_refs, p_val, p_type, p_is_new);
+  if (0 == id) {
+    return false;
+  }
+
+  // {"$id":N, is followed by the fields, {"$ref":N} is the whole object
+  char buff[32];
+  size_t count = *p_is_new ? sizeof("{\"$id\":") - 1 : sizeof("{\"$ref\":") - 1;
+  memcpy(buff, *p_is_new ? "{\"$id\":" : "{\"$ref\":", count);
+  count += ser_format_u64(buff + count, id);
+  buff[count++] = *p_is_new ? ',' : '}';
+  return serializer_append_bytes(p_ser, buff, count);
+}
+
+
+
+// ----------------- | SINKS |
+static bool fd_sink_write(void *ctx, const char *data, size_t count) {
+  int fd = (int)(intptr_t)ctx;
+
+  while (count > 0) {
+    ssize_t n = write(fd, data, count);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      return false;
+    }
+    data += n;
+    count -= (size_t)n;
+  }
+
+  return true;
+}
+
+SerializerSink serializer_fd_sink(int fd) {
+  return (SerializerSink){
+    .write = fd_sink_write,
+    .ctx = (void*)(intptr_t)fd
+  };
+}
+
+
+typedef struct {
+  char *data;
+  size_t count;
+} AsyncBuffer;
+
+struct SerializerAsyncWriter {
+  pthread_t thread;
+  pthread_mutex_t lock;
+
+  /// signaled when a filled buffer is queued or the writer is closing
+  pthread_cond_t has_filled;
+
+  /// signaled when a buffer is written and can be filled again
+  pthread_cond_t has_empty;
+
+  int fd;
+  size_t buffer_capacity;
+  size_t buffers_count;
+
+  /// ring of filled buffers in the order they have to be written
+  AsyncBuffer *filled;
+  size_t filled_head;
+  size_t filled_count;
+
+  /// stack of buffers ready to be filled
+  char **empty;
+  size_t empty_count;
+
+  bool closing;
+  bool failed;
+};
+
+static void *async_writer_thread(void *arg) {
+  SerializerAsyncWriter *p_writer = (SerializerAsyncWriter*)arg;
+
+  pthread_mutex_lock(&p_writer->lock);
+  for (;;) {
+    while (0 == p_writer->filled_count && !p_writer->closing) {
+      pthread_cond_wait(&p_writer->has_filled, &p_writer->lock);
+    }
+
+    if (0 == p_writer->filled_count) {
+      break; // closing and everything is written
+    }
+
+    AsyncBuffer buffer = p_writer->filled[p_writer->filled_head];
+    p_writer->filled_head = (p_writer->filled_head + 1) % p_writer->buffers_count;
+    --p_writer->filled_count;
+    bool failed = p_writer->failed;
+    pthread_mutex_unlock(&p_writer->lock);
+
+    // write(2) happens without the lock, so the producer keeps filling the other buffer
+    if (!failed) {
+      failed = !fd_sink_write((void*)(intptr_t)p_writer->fd, buffer.data, buffer.count);
+    }
+
+    pthread_mutex_lock(&p_writer->lock);
+    p_writer->failed |= failed;
+    p_writer->empty[p_writer->empty_count++] = buffer.data;
+    pthread_cond_signal(&p_writer->has_empty);
+  }
+  pthread_mutex_unlock(&p_writer->lock);
+
+  return NULL;
+}
+
+static char *async_writer_exchange(void *ctx, char *data, size_t count, size_t *p_capacity) {
+  SerializerAsyncWriter *p_writer = (SerializerAsyncWriter*)ctx;
+
+  pthread_mutex_lock(&p_writer->lock);
+
+  if (NULL != data) {
+    if (0 == count || p_writer->failed) {
+      p_writer->empty[p_writer->empty_count++] = data;
+    } else {
+      size_t tail = (p_writer->filled_head + p_writer->filled_count) % p_writer->buffers_count;
+      p_writer->filled[tail] = (AsyncBuffer){ .data = data, .count = count };
+      ++p_writer->filled_count;
+      pthread_cond_signal(&p_writer->has_filled);
+    }
+  }
+
+  char *empty = NULL;
+  if (NULL != p_capacity) {
+    // backpressure: wait until the writer thread returns a buffer
+    while (0 == p_writer->empty_count && !p_writer->failed) {
+      pthread_cond_wait(&p_writer->has_empty, &p_writer->lock);
+    }
+
+    if (!p_writer->failed) {
+      empty = p_writer->empty[--p_writer->empty_count];
+      *p_capacity = p_writer->buffer_capacity;
+    }
+  }
+
+  pthread_mutex_unlock(&p_writer->lock);
+  return empty;
+}
+
+SerializerAsyncWriter *serializer_async_writer_create(int fd, size_t buffers_count, size_t buffer_capacity) {
+  assert(buffers_count >= 2);
+  assert(buffer_capacity >= 2);
+
+  SerializerAsyncWriter *p_writer = (SerializerAsyncWriter*)calloc(1, sizeof(SerializerAsyncWriter));
+  if (NULL == p_writer) {
+    return NULL;
+  }
+
+  p_writer->fd = fd;
+  p_writer->buffers_count = buffers_count;
+  p_writer->buffer_capacity = buffer_capacity;
+  p_writer->filled = (AsyncBuffer*)calloc(buffers_count, sizeof(AsyncBuffer));
+  p_writer->empty = (char**)calloc(buffers_count, sizeof(char*));
+  if (NULL == p_writer->filled || NULL == p_writer->empty) {
+    goto cleanup_error;
+  }
+
+  for (; p_writer->empty_count < buffers_count; ++p_writer->empty_count) {
+    char *buffer = (char*)malloc(buffer_capacity * sizeof(char));
+    if (NULL == buffer) {
+      goto cleanup_error;
+    }
+    p_writer->empty[p_writer->empty_count] = buffer;
+  }
+
+  pthread_mutex_init(&p_writer->lock, NULL);
+  pthread_cond_init(&p_writer->has_filled, NULL);
+  pthread_cond_init(&p_writer->has_empty, NULL);
+
+  if (0 != pthread_create(&p_writer->thread, NULL, async_writer_thread, p_writer)) {
+    pthread_cond_destroy(&p_writer->has_empty);
+    pthread_cond_destroy(&p_writer->has_filled);
+    pthread_mutex_destroy(&p_writer->lock);
+    goto cleanup_error;
+  }
+
+  return p_writer;
+
+cleanup_error:
+  for (size_t i = 0; NULL != p_writer->empty && i < p_writer->empty_count; ++i) {
+    free(p_writer->empty[i]);
+  }
+  free(p_writer->empty);
+  free(p_writer->filled);
+  free(p_writer);
+  return NULL;
+}
+
+bool serializer_async_writer_destroy(SerializerAsyncWriter *p_writer) {
+  assert(NULL != p_writer);
+
+  pthread_mutex_lock(&p_writer->lock);
+  p_writer->closing = true;
+  pthread_cond_signal(&p_writer->has_filled);
+  pthread_mutex_unlock(&p_writer->lock);
+
+  pthread_join(p_writer->thread, NULL);
+
+  assert(p_writer->empty_count == p_writer->buffers_count && "serializer using the writer was not freed");
+  bool ok = !p_writer->failed;
+
+  for (size_t i = 0; i < p_writer->empty_count; ++i) {
+    free(p_writer->empty[i]);
+  }
+  pthread_cond_destroy(&p_writer->has_empty);
+  pthread_cond_destroy(&p_writer->has_filled);
+  pthread_mutex_destroy(&p_writer->lock);
+  free(p_writer->empty);
+  free(p_writer->filled);
+  free(p_writer);
+
+  return ok;
+}
+
+SerializerSink serializer_async_writer_sink(SerializerAsyncWriter *p_writer) {
+  assert(NULL != p_writer);
+  return (SerializerSink){
+    .exchange = async_writer_exchange,
+    .ctx = p_writer
+  };
+}
+
+
+SerializerChunkPool *serializer_chunk_pool_create(size_t chunk_capacity) {
+  assert(chunk_capacity >= 2);
+
+  SerializerChunkPool *p_pool = (SerializerChunkPool*)calloc(1, sizeof(SerializerChunkPool));
+  if (NULL == p_pool) {
+    return NULL;
+  }
+
+  pthread_mutex_init(&p_pool->lock, NULL);
+  p_pool->chunk_capacity = chunk_capacity;
+  return p_pool;
+}
+
+void serializer_chunk_pool_destroy(SerializerChunkPool *p_pool) {
+  assert(NULL != p_pool);
+
+  SerializerChunk *p_chunk = p_pool->free_list;
+  while (NULL != p_chunk) {
+    SerializerChunk *next = p_chunk->next;
+    free(p_chunk);
+    p_chunk = next;
+  }
+
+  pthread_mutex_destroy(&p_pool->lock);
+  free(p_pool);
+}
+
+
+
+// ----------------- | ALLOCATORS |
+#define SER_BUMP_BLOCK_SIZE (1024 * 1024)
+#define SER_BUMP_ALIGNMENT 16
+
+typedef struct BumpBlock {
+  struct BumpBlock *prev;
+  size_t used;
+  size_t capacity;
+  _Alignas(SER_BUMP_ALIGNMENT) char data[];
+} BumpBlock;
+
+/// current block of the thread, previous blocks are only kept to be released
+static _Thread_local BumpBlock *bump_block = NULL;
+
+static size_t bump_align(size_t size) {
+  return (size + SER_BUMP_ALIGNMENT - 1) & ~(size_t)(SER_BUMP_ALIGNMENT - 1);
+}
+
+static bool bump_is_last(const BumpBlock *p_block, const void *ptr, size_t size) {
+  return NULL != p_block && (const char*)ptr + bump_align(size) == p_block->data + p_block->used;
+}
+
+static void *bump_allocate(void *ctx, size_t size) {
+  (void)ctx;
+  size = bump_align(size);
+
+  if (NULL == bump_block || bump_block->capacity - bump_block->used < size) {
+    size_t capacity = size > SER_BUMP_BLOCK_SIZE ? size : SER_BUMP_BLOCK_SIZE;
+    BumpBlock *p_block = (BumpBlock*)malloc(sizeof(BumpBlock) + capacity);
+    if (NULL == p_block) {
+      return NULL;
+    }
+    p_block->prev = bump_block;
+    p_block->used = 0;
+    p_block->capacity = capacity;
+    bump_block = p_block;
+  }
+
+  void *ptr = bump_block->data + bump_block->used;
+  bump_block->used += size;
+  return ptr;
+}
+
+static void *bump_reallocate(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  // the last allocation of the current block grows in place
+  if (bump_is_last(bump_block, ptr, old_size)
+    && bump_block->capacity - (bump_block->used - bump_align(old_size)) >= bump_align(new_size)) {
+    bump_block->used += bump_align(new_size) - bump_align(old_size);
+    return ptr;
+  }
+
+  void *tmp = bump_allocate(ctx, new_size);
+  if (NULL != tmp) {
+    memcpy(tmp, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return tmp;
+}
+
+static void bump_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  if (bump_is_last(bump_block, ptr, size)) {
+    bump_block->used -= bump_align(size);
+  }
+}
+
+SerializerAllocator serializer_bump_allocator(void) {
+  return (SerializerAllocator){
+    .allocate = bump_allocate,
+    .reallocate = bump_reallocate,
+    .free = bump_free
+  };
+}
+
+void serializer_bump_allocator_reset(void) {
+  if (NULL == bump_block) {
+    return;
+  }
+
+  BumpBlock *p_block = bump_block->prev;
+  while (NULL != p_block) {
+    BumpBlock *prev = p_block->prev;
+    free(p_block);
+    p_block = prev;
+  }
+
+  bump_block->prev = NULL;
+  bump_block->used = 0;
+}
+
+void serializer_bump_allocator_finalize(void) {
+  serializer_bump_allocator_reset();
+  free(bump_block);
+  bump_block = NULL;
+}
+
+
+#define SER_POOL_MIN_SHIFT 6   // 64 bytes
+#define SER_POOL_MAX_SHIFT 16  // 64 KiB
+#define SER_POOL_CLASSES_COUNT (SER_POOL_MAX_SHIFT - SER_POOL_MIN_SHIFT + 1)
+#define SER_POOL_MAX_CACHED 64
+
+typedef struct PoolBlock {
+  struct PoolBlock *next;
+} PoolBlock;
+
+typedef struct {
+  PoolBlock *free_list;
+  size_t count;
+} PoolClass;
+
+/// free lists of the thread, blocks are plain malloc memory,
+/// so a block may be freed by another thread than the one allocated it
+static _Thread_local PoolClass pool_classes[SER_POOL_CLASSES_COUNT];
+
+/// Returns the size class for size or SER_POOL_CLASSES_COUNT if it is too big for the pool
+static size_t pool_class_of(size_t size) {
+  size_t size_class = 0;
+  while (size_class < SER_POOL_CLASSES_COUNT && ((size_t)1 << (size_class + SER_POOL_MIN_SHIFT)) < size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+static void *pool_allocate(void *ctx, size_t size) {
+  (void)ctx;
+  size_t size_class = pool_class_of(size);
+  if (SER_POOL_CLASSES_COUNT == size_class) {
+    return malloc(size);
+  }
+
+  PoolClass *p_class = pool_classes + size_class;
+  if (NULL != p_class->free_list) {
+    PoolBlock *p_block = p_class->free_list;
+    p_class->free_list = p_block->next;
+    --p_class->count;
+    return p_block;
+  }
+
+  return malloc((size_t)1 << (size_class + SER_POOL_MIN_SHIFT));
+}
+
+static void pool_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  size_t size_class = pool_class_of(size);
+  if (SER_POOL_CLASSES_COUNT == size_class || SER_POOL_MAX_CACHED == pool_classes[size_class].count) {
+    free(ptr);
+    return;
+  }
+
+  PoolBlock *p_block = (PoolBlock*)ptr;
+  p_block->next = pool_classes[size_class].free_list;
+  pool_classes[size_class].free_list = p_block;
+  ++pool_classes[size_class].count;
+}
+
+static void *pool_reallocate(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  size_t old_class = pool_class_of(old_size);
+  size_t new_class = pool_class_of(new_size);
+  if (old_class == new_class && SER_POOL_CLASSES_COUNT != new_class) {
+    return ptr;
+  }
+  if (SER_POOL_CLASSES_COUNT == old_class && SER_POOL_CLASSES_COUNT == new_class) {
+    return realloc(ptr, new_size);
+  }
+
+  void *tmp = pool_allocate(ctx, new_size);
+  if (NULL == tmp) {
+    return NULL;
+  }
+  memcpy(tmp, ptr, old_size < new_size ? old_size : new_size);
+  pool_free(ctx, ptr, old_size);
+  return tmp;
+}
+
+SerializerAllocator serializer_pool_allocator(void) {
+  return (SerializerAllocator){
+    .allocate = pool_allocate,
+    .reallocate = pool_reallocate,
+    .free = pool_free
+  };
+}
+
+void serializer_pool_allocator_trim(void) {
+  for (size_t i = 0; i < SER_POOL_CLASSES_COUNT; ++i) {
+    PoolBlock *p_block = pool_classes[i].free_list;
+    while (NULL != p_block) {
+      PoolBlock *next = p_block->next;
+      free(p_block);
+      p_block = next;
+    }
+    pool_classes[i] = (PoolClass){0};
+  }
+}
@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 
 typedef enum {
   SER_KIND_UNINITIALIZED = 0,
@@ -14,10 +17,143 @@ typedef struct {
   size_t count;
 } SerializerData;
 
+/// Destination for serialized bytes.
+/// Either write or exchange has to be provided, exchange is preferred when both are set.
+typedef struct {
+  /// Writes all count bytes of data, returns false on failure
+  bool (*write)(void *ctx, const char *data, size_t count);
+
+  /// Takes ownership of the buffer data with count bytes to be written
+  /// and returns an empty buffer to fill next (its capacity is stored to p_capacity).
+  /// data is NULL when the first buffer is requested,
+  /// p_capacity is NULL when the buffer is handed back for good (nothing is returned then).
+  /// Returns NULL on failure
+  char *(*exchange)(void *ctx, char *data, size_t count, size_t *p_capacity);
+
+  void *ctx;
+} SerializerSink;
+
+/// Segment of the segmented serializer buffer
+typedef struct SerializerChunk {
+  struct SerializerChunk *next;
+  size_t count;
+  size_t capacity;
+
+  /// taken from the pool and returned to it, otherwise allocated by the serializer (flattened data)
+  bool is_pooled;
+  char data[];
+} SerializerChunk;
+
+/// Thread safe free list of equally sized chunks shared by segmented serializers
+typedef struct SerializerChunkPool SerializerChunkPool;
+
+/// @param chunk_capacity: capacity of each chunk in bytes, at least 2
+/// @return SerializerChunkPool*, NULL on failure
+SerializerChunkPool *serializer_chunk_pool_create(size_t chunk_capacity);
+
+/// Frees the pool and the chunks in it, every serializer using the pool has to be freed before
+void serializer_chunk_pool_destroy(SerializerChunkPool *p_pool);
+
+/// Memory hooks of the serializer buffer, all three functions should be provided.
+/// Sizes passed to reallocate and free are the ones requested before
+typedef struct {
+  void *(*allocate)(void *ctx, size_t size);
+  void *(*reallocate)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+  void (*free)(void *ctx, void *ptr, size_t size);
+  void *ctx;
+} SerializerAllocator;
+
+/// Thread local bump allocator: allocation is a pointer increment, only the last
+/// allocation is actually freed or grown in place, the rest is released by
+/// serializer_bump_allocator_reset of the thread that allocated it
+SerializerAllocator serializer_bump_allocator(void);
+
+/// Releases everything the calling thread has allocated with the bump allocator, keeps one block
+void serializer_bump_allocator_reset(void);
+
+/// Releases all memory of the calling thread bump allocator
+void serializer_bump_allocator_finalize(void);
+
+/// Thread local size class pool allocator: power of two classes from 64 bytes to 64 KiB
+/// are cached in per thread free lists, bigger sizes go to malloc
+SerializerAllocator serializer_pool_allocator(void);
+
+/// Frees the blocks cached by the calling thread pool allocator
+void serializer_pool_allocator_trim(void);
+
+/// Object visited by the graph mode serialization
+typedef struct {
+  const void *p_val;
+
+  /// identity of the type, objects of different types may share the address (e.g. the first member)
+  const void *p_type;
+} SerializerRef;
+
+/// Objects already serialized into the current document and their ids ("$id"),
+/// so shared objects are written once and cycles terminate.
+/// Open addressing set of addresses with linear probing
+typedef struct {
+  /// object with id i is refs[i - 1], in the order of the first visit
+  SerializerRef *refs;
+  uint32_t refs_count;
+  uint32_t refs_capacity;
+
+  /// index + 1 into refs, 0 for empty slot, the capacity is a power of 2
+  uint32_t *slots;
+  uint32_t slots_capacity;
+} SerializerRefs;
+
+void serializer_refs_init(SerializerRefs *p_refs);
+
+/// Forgets all objects but keeps the memory, call it between documents
+void serializer_refs_reset(SerializerRefs *p_refs);
+
+void serializer_refs_free(SerializerRefs *p_refs);
+
+/// Finds the id of the object or adds the object with the next id
+///
+/// @param p_is_new: set to true if the object has not been visited before
+/// @return uint32_t, id of the object starting from 1, 0 if out of memory
+uint32_t serializer_refs_visit(SerializerRefs *p_refs, const void *p_val, const void *p_type, bool *p_is_new);
+
+/// Returns the object with id, so readers of the output resolve "$ref" with the same table
+///
+/// @return const SerializerRef*, NULL if there is no object with id
+const SerializerRef *serializer_refs_find(const SerializerRefs *p_refs, uint32_t id);
+
+/// Flush thresholds of the NDJSON record stream, 0 disables the threshold
+typedef struct {
+  size_t max_bytes;
+  size_t max_records;
+} SerializerBatch;
+
 typedef struct {
   char *data;
   size_t count;
   size_t capacity;
+  SerializerSink sink;
+
+  /// number of bytes already passed to the sink
+  size_t flushed;
+
+  /// number of bytes in the chunks before the tail one
+  size_t retired;
+
+  SerializerBatch batch;
+  size_t batch_records;
+
+  /// segmented mode: full chunk is linked to the list instead of being reallocated,
+  /// data is the data of the tail chunk
+  SerializerChunkPool *p_pool;
+  SerializerChunk *head;
+  SerializerChunk *tail;
+  SerializerChunk *before_tail;
+
+  /// malloc is used when allocate is NULL
+  SerializerAllocator allocator;
+
+  /// graph mode: objects are written once, see serializer_set_refs
+  SerializerRefs *p_refs;
 #ifndef NDEBUG
   SerializationKind tag;
 #endif // !NDEBUG
@@ -27,6 +163,217 @@ bool serializer_start_serialization(Serializer *p_ser, SerializationKind kind);
 bool serializer_end_serialization(Serializer *p_ser, SerializationKind kind);
 void serializer_free(Serializer *p_ser);
 
+/// Attaches the sink to the serializer, should be called right after serializer_start_serialization.
+/// Once the buffer is full its content goes to the sink instead of growing the buffer
+/// (the last byte is kept, so the trailing separator can still be patched),
+/// serializer_end_serialization flushes the rest and does not append '\0'
+void serializer_set_sink(Serializer *p_ser, SerializerSink sink);
+
+/// Sets allocator of the serializer buffer (and of flattened chunks in segmented mode),
+/// should be called right after serializer_start_serialization
+void serializer_set_allocator(Serializer *p_ser, SerializerAllocator allocator);
+
+/// Switches the serializer to the segmented buffer with chunks taken from p_pool,
+/// should be called right after serializer_start_serialization, cannot be combined with a sink
+void serializer_use_chunks(Serializer *p_ser, SerializerChunkPool *p_pool);
+
+/// Enables graph mode: the first visit of an object writes {"$id":N,...}, later ones {"$ref":N}.
+/// Honored by table serializers and by generated ones when generated with --graph.
+/// Should be called right after serializer_start_serialization, p_refs outlives the serialization
+void serializer_set_refs(Serializer *p_ser, SerializerRefs *p_refs);
+
+/// Starts the object at p_val of type p_type. Without refs it is serializer_json_start_object
+///
+/// @param p_is_new: set to false if {"$ref":N} has been written instead, fields are not serialized then
+/// @return bool, false on failure
+bool serializer_json_start_shared_object(Serializer *p_ser, const void *p_val, const void *p_type, bool *p_is_new);
+
+/// Makes room for at least additional bytes, so they are appended without reallocation.
+/// Does nothing for sink and segmented buffers, they never reallocate
+bool serializer_reserve(Serializer *p_ser, size_t additional);
+
+/// Returns the number of bytes appended since serializer_start_serialization
+size_t serializer_bytes_written(const Serializer *p_ser);
+
+/// Exponentially decayed high-water mark of the output size of one type,
+/// generated serializers keep one per type when compiled with SERC_SIZE_HINTS.
+/// Updates are relaxed, concurrent serializations may lose a sample but never tear the value
+typedef struct {
+  atomic_size_t size;
+} SerializerSizeHint;
+
+/// Reserves the predicted size, returns the value to be passed to serializer_size_hint_end
+size_t serializer_size_hint_begin(Serializer *p_ser, SerializerSizeHint *p_hint);
+
+/// Records the size of the output produced since serializer_size_hint_begin
+void serializer_size_hint_end(const Serializer *p_ser, SerializerSizeHint *p_hint, size_t begin);
+
+/// Passes all buffered bytes to the sink
+bool serializer_flush(Serializer *p_ser);
+
+/// Sink that blocks on write(2) to fd
+SerializerSink serializer_fd_sink(int fd);
+
+/// Sink with a dedicated thread that writes filled buffers to fd,
+/// so the serializing thread only blocks when all buffers are waiting to be written
+typedef struct SerializerAsyncWriter SerializerAsyncWriter;
+
+/// Creates the writer and starts its thread
+///
+/// @param fd: file descriptor to write to, is not closed by the writer
+/// @param buffers_count: number of buffers, at least 2
+/// @param buffer_capacity: capacity of each buffer in bytes, at least 2
+/// @return SerializerAsyncWriter*, NULL on failure
+SerializerAsyncWriter *serializer_async_writer_create(int fd, size_t buffers_count, size_t buffer_capacity);
+
+/// Waits until all queued buffers are written, stops the thread and frees the writer.
+/// Every serializer using the writer has to be freed before
+///
+/// @return bool, false if any write has failed
+bool serializer_async_writer_destroy(SerializerAsyncWriter *p_writer);
+
+SerializerSink serializer_async_writer_sink(SerializerAsyncWriter *p_writer);
+
+/// Signature of generated serializer_<T>_to_json functions
+typedef bool (*SerializeFunc)(Serializer *p_ser, const void *p_val);
+
+/// Kind of the value of a field described by SerializerField
+typedef enum {
+  SER_FIELD_CHAR,
+  SER_FIELD_SHORT,
+  SER_FIELD_INT,
+  SER_FIELD_LONG_INT,
+  SER_FIELD_LONG_LONG_INT,
+  SER_FIELD_U_SHORT,
+  SER_FIELD_U_INT,
+  SER_FIELD_U_LONG_INT,
+  SER_FIELD_U_LONG_LONG_INT,
+  SER_FIELD_FLOAT,
+  SER_FIELD_DOUBLE,
+  SER_FIELD_LONG_DOUBLE,
+  SER_FIELD_STRUCT,
+  SER_FIELD_CALLBACK,
+  SER_FIELD_BYTES_BASE64,
+  SER_FIELD_BYTES_HEX,
+} SerializerFieldKind;
+
+typedef struct SerializerType SerializerType;
+
+/// Describes one field of a struct for serializer_table_to_json, tables are generated
+typedef struct {
+  /// "name": as it is written to the output
+  const char *key;
+  uint32_t key_length;
+
+  /// SerializerFieldKind of the value (of elements of arrays)
+  uint8_t kind;
+
+  /// pointers to follow from the field (from an element of arrays) to the value
+  uint8_t indirections;
+
+  /// @array (@bytes with @size): the field points to elements (bytes),
+  /// their count is the integer field at size_offset
+  bool is_array;
+  uint8_t size_kind;
+  uint32_t size_offset;
+
+  /// offset of the field in the struct
+  uint32_t offset;
+
+  /// size of one element of arrays
+  uint32_t stride;
+
+  /// dimensions of fixed-size array, outermost first, 0 if the field is not one.
+  /// @bytes arrays have one, its size is the number of bytes
+  uint32_t dims_count;
+  const uint32_t *dims;
+
+  /// SER_FIELD_STRUCT: fields of the struct
+  const SerializerType *p_type;
+
+  /// SER_FIELD_CALLBACK: gets the address of the field followed indirections times
+  SerializeFunc callback;
+} SerializerField;
+
+/// Fields of a struct in declaration order, omitted ones are left out
+struct SerializerType {
+  const char *name;
+  const SerializerField *fields;
+  uint32_t fields_count;
+};
+
+/// Serializes struct at p_val as JSON object by walking its field table,
+/// the output is the same as of the generated per-field code
+bool serializer_table_to_json(Serializer *p_ser, const SerializerType *p_type, const void *p_val);
+
+/// Serializes only fields of struct at p_val selected by mask, bit i selects p_type->fields[i].
+/// Fields are written in table order, bits past the last field are ignored
+///
+/// @param p_type: type with at most 64 fields
+/// @param mask: selected fields
+bool serializer_table_to_json_masked(Serializer *p_ser, const SerializerType *p_type, const void *p_val,
+                                     uint64_t mask);
+
+/// Serialized "key":value, of one field kept between serializations
+typedef struct {
+  char *data;
+  size_t count;
+  size_t capacity;
+} SerializerFragment;
+
+/// Serialized fields of one long-lived object, see generated serializer_<T>_to_json_incremental.
+/// Fields marked dirty are formatted again, the others are copied from the previous serialization
+typedef struct {
+  SerializerFragment *fragments;
+  uint32_t fields_count;
+
+  /// bit i is set if field i has to be formatted again (SER_MASK_<T>_<field>)
+  uint64_t dirty;
+
+  /// formats the dirty field into its fragment
+  Serializer scratch;
+} SerializerFragments;
+
+/// Initializes fragments of an object with fields_count (at most 64) serialized fields,
+/// all of them dirty. Generated serializer_<T>_fragments_init passes the right count
+///
+/// @return bool, false if out of memory
+bool serializer_fragments_init(SerializerFragments *p_fragments, uint32_t fields_count);
+
+void serializer_fragments_free(SerializerFragments *p_fragments);
+
+/// Invalidates fragments of fields selected by mask, call it when the fields change
+static inline void serializer_fragments_mark_dirty(SerializerFragments *p_fragments, uint64_t mask) {
+  p_fragments->dirty |= mask;
+}
+
+/// Starts formatting of the field if it is dirty, called by generated code
+///
+/// @return Serializer*, serializer to format the field into, NULL if the fragment is up to date
+Serializer *serializer_fragment_begin(SerializerFragments *p_fragments, uint32_t field);
+
+/// Keeps what has been formatted since serializer_fragment_begin as the fragment of the field
+bool serializer_fragment_end(SerializerFragments *p_fragments, uint32_t field);
+
+/// Appends the fragment of the field to the output
+bool serializer_fragment_append(Serializer *p_ser, const SerializerFragments *p_fragments, uint32_t field);
+
+/// serializer_table_to_json that formats only dirty fields, see SerializerFragments
+bool serializer_table_to_json_incremental(Serializer *p_ser, const SerializerType *p_type, const void *p_val,
+                                          SerializerFragments *p_fragments);
+
+/// Starts a stream of newline delimited JSON documents.
+/// With a sink attached (serializer_set_sink) buffered records are flushed
+/// once any threshold of batch is reached, without a sink records accumulate in the buffer
+bool serializer_ndjson_start(Serializer *p_ser, SerializerBatch batch);
+
+/// Appends one record produced by func followed by '\n'.
+/// Failed record is removed from the buffer unless part of it was already flushed
+bool serializer_ndjson_append(Serializer *p_ser, SerializeFunc func, const void *p_val);
+
+/// Flushes the last batch, see serializer_end_serialization
+bool serializer_ndjson_end(Serializer *p_ser);
+
 bool serializer_json_start_object(Serializer *p_ser);
 bool serializer_json_end_object(Serializer *p_ser);
 
@@ -39,6 +386,8 @@ bool serializer_json_end_field(Serializer *p_ser);
 bool serializer_json_append_separator(Serializer *p_ser);
 void serializer_json_remove_separator_at_end(Serializer *p_ser);
 
+/// Writes null, graph mode writes it for NULL pointers
+bool serializer_null_to_json(Serializer *p_ser);
 bool serializer_char_to_json(Serializer *p_ser, char val);
 bool serializer_short_to_json(Serializer *p_ser, short val);
 bool serializer_int_to_json(Serializer *p_ser, int val);
@@ -49,6 +398,10 @@ bool serializer_double_to_json(Serializer *p_ser, double val);
 bool serializer_long_double_to_json(Serializer *p_ser, long double val);
 bool serializer_cstr_to_json(Serializer *p_ser, const char *val);
 
+/// Writes chars of the fixed-size buffer (char name[N]) up to the first '\0', at most capacity,
+/// as one escaped JSON string. Raw bytes are written with @bytes instead
+bool serializer_fixed_cstr_to_json(Serializer *p_ser, const char *p_chars, size_t capacity);
+
 // TODO:
 bool serializer_u_char_to_json(Serializer *p_ser, char val);
 bool serializer_u_short_to_json(Serializer *p_ser, short val);
@@ -56,6 +409,51 @@ bool serializer_u_int_to_json(Serializer *p_ser, int val);
 bool serializer_u_long_int_to_json(Serializer *p_ser, long int val);
 bool serializer_u_long_long_int_to_json(Serializer *p_ser, long long int val);
 
+/// Array kernels: write count elements of p_vals as one JSON array ([v0,v1,...]),
+/// the same text as serializing the elements one by one, reserving the output once
+bool serializer_char_array_to_json(Serializer *p_ser, const char *p_vals, size_t count);
+bool serializer_short_array_to_json(Serializer *p_ser, const short *p_vals, size_t count);
+bool serializer_int_array_to_json(Serializer *p_ser, const int *p_vals, size_t count);
+bool serializer_long_int_array_to_json(Serializer *p_ser, const long int *p_vals, size_t count);
+bool serializer_long_long_int_array_to_json(Serializer *p_ser, const long long int *p_vals, size_t count);
+bool serializer_u_short_array_to_json(Serializer *p_ser, const unsigned short *p_vals, size_t count);
+bool serializer_u_int_array_to_json(Serializer *p_ser, const unsigned int *p_vals, size_t count);
+bool serializer_u_long_int_array_to_json(Serializer *p_ser, const unsigned long int *p_vals, size_t count);
+bool serializer_u_long_long_int_array_to_json(Serializer *p_ser, const unsigned long long int *p_vals, size_t count);
+bool serializer_float_array_to_json(Serializer *p_ser, const float *p_vals, size_t count);
+bool serializer_double_array_to_json(Serializer *p_ser, const double *p_vals, size_t count);
+bool serializer_long_double_array_to_json(Serializer *p_ser, const long double *p_vals, size_t count);
+
+/// Number of characters of padded base64 text of count bytes
+#define SER_BASE64_ENCODED_SIZE(count) (((count) + 2) / 3 * 4)
+
+/// Encodes count bytes of p_src as padded base64 (RFC 4648) into dst,
+/// which holds SER_BASE64_ENCODED_SIZE(count) characters, no terminating zero is written
+///
+/// @return size_t, number of characters written
+size_t serializer_base64_encode(char *dst, const void *p_src, size_t count);
+
+/// Decodes padded base64 text of length characters into p_dst, which holds length / 4 * 3 bytes
+///
+/// @param p_count: number of bytes decoded
+/// @return bool, false if the text is not padded base64
+bool serializer_base64_decode(void *p_dst, size_t *p_count, const char *src, size_t length);
+
+/// Encodes count bytes of p_src as lowercase hex into dst, which holds 2 * count characters,
+/// no terminating zero is written
+///
+/// @return size_t, number of characters written
+size_t serializer_hex_encode(char *dst, const void *p_src, size_t count);
+
+/// Decodes hex text (of either case) of length characters into p_dst, which holds length / 2 bytes
+///
+/// @return bool, false if the length is odd or the text is not hex
+bool serializer_hex_decode(void *p_dst, const char *src, size_t length);
+
+/// @bytes fields: write count bytes of p_bytes as one JSON string
+bool serializer_bytes_base64_to_json(Serializer *p_ser, const void *p_bytes, size_t count);
+bool serializer_bytes_hex_to_json(Serializer *p_ser, const void *p_bytes, size_t count);
+
 
 
 bool serializer_json_field_from_char(Serializer *p_ser, const char *name, char val);
@@ -69,7 +467,14 @@ bool serializer_json_field_from_long_double(Serializer *p_ser, const char *name,
 bool serializer_json_field_from_cstr(Serializer *p_ser, const char *name, const char *val);
 
 
-SerializerData serializer_get_data(const Serializer *p_ser);
+/// Returns serialized data, segmented buffer is flattened into one chunk first
+SerializerData serializer_get_data(Serializer *p_ser);
+
+/// Fills up to iov_count entries of iov with the buffered segments, so they can be
+/// passed to writev(2) without flattening
+///
+/// @return size_t, total number of segments (may be greater than iov_count)
+size_t serializer_get_iovec(const Serializer *p_ser, struct iovec *iov, size_t iov_count);
 
 
 #endif // !__SERC_SERIALIZATION_PRIMITIVES_H__
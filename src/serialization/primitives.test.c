@@ -1,7 +1,548 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "primitives.h"
 
+static int failures = 0;
+
+#define CHECK(cond)\
+  do {\
+    if (!(cond)) {\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+      ++failures;\
+    }\
+  } while (0)
+
+/// Writes an array of count objects, separators are patched by the end of every object and array,
+/// so they land on every offset of the buffer
+static bool write_document(Serializer *p_ser, int count) {
+  if (!serializer_json_start_array(p_ser)) return false;
+  for (int i = 0; i < count; ++i) {
+    bool ok = serializer_json_start_object(p_ser)
+      && serializer_json_field_from_int(p_ser, "id", i)
+      && serializer_json_field_from_cstr(p_ser, "name", "item")
+      && serializer_json_start_field(p_ser, "values")
+      && serializer_json_start_array(p_ser);
+    for (int j = 0; ok && j < i % 5; ++j) {
+      ok = serializer_int_to_json(p_ser, j) && serializer_json_append_separator(p_ser);
+    }
+    ok = ok && serializer_json_end_array(p_ser)
+      && serializer_json_end_field(p_ser)
+      && serializer_json_end_object(p_ser)
+      && serializer_json_append_separator(p_ser);
+    if (!ok) return false;
+  }
+  return serializer_json_end_array(p_ser);
+}
+
+/// Serializes the document into a growable buffer, the reference for other buffer modes
+static char *expected_document(int count, size_t *p_count) {
+  Serializer ser;
+  serializer_start_serialization(&ser, SER_KIND_JSON);
+  if (!write_document(&ser, count)) {
+    serializer_free(&ser);
+    return NULL;
+  }
+
+  char *copy = (char*)malloc(ser.count);
+  if (NULL != copy) memcpy(copy, ser.data, ser.count);
+  *p_count = ser.count;
+  serializer_free(&ser);
+  return copy;
+}
+
+/// Reads everything written to the temporary file
+static char *read_file(FILE *p_file, size_t *p_count) {
+  long size = ftell(p_file);
+  char *data = (char*)malloc(size > 0 ? (size_t)size : 1);
+  rewind(p_file);
+  *p_count = NULL == data ? 0 : fread(data, 1, (size_t)size, p_file);
+  return data;
+}
+
+/// Exchange sink collecting everything in memory, hands out buffers of buffer_capacity bytes
+typedef struct {
+  char *data;
+  size_t count;
+  size_t buffer_capacity;
+} MemorySink;
+
+static char *memory_sink_exchange(void *ctx, char *data, size_t count, size_t *p_capacity) {
+  MemorySink *p_sink = (MemorySink*)ctx;
+  if (NULL != data) {
+    char *tmp = (char*)realloc(p_sink->data, p_sink->count + count + 1);
+    if (NULL != tmp) {
+      memcpy(tmp + p_sink->count, data, count);
+      p_sink->data = tmp;
+      p_sink->count += count;
+    }
+    free(data);
+    if (NULL == tmp) return NULL;
+  }
+  if (NULL == p_capacity) return NULL;
+
+  *p_capacity = p_sink->buffer_capacity;
+  return (char*)malloc(0 == p_sink->buffer_capacity ? 1 : p_sink->buffer_capacity);
+}
+
+/// Bytes written before the sink is attached may exceed its buffer
+static void test_exchange_sink_pending(void) {
+  size_t expected_count = 0;
+  char *expected = expected_document(50, &expected_count);
+  CHECK(NULL != expected && expected_count > 1024);
+
+  // buffers of 16 bytes, the pending document spans many of them
+  {
+    MemorySink sink = { .buffer_capacity = 16 };
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    CHECK(write_document(&ser, 50));
+    serializer_set_sink(&ser, (SerializerSink){ .exchange = memory_sink_exchange, .ctx = &sink });
+    CHECK(serializer_bytes_written(&ser) == expected_count);
+    CHECK(write_document(&ser, 50));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    serializer_free(&ser);
+
+    CHECK(sink.count == 2 * expected_count);
+    CHECK(sink.count == 2 * expected_count && 0 == memcmp(sink.data, expected, expected_count)
+          && 0 == memcmp(sink.data + expected_count, expected, expected_count));
+    free(sink.data);
+  }
+
+  // a buffer too small to keep the last byte is handed back, writes fail instead of overflowing it
+  for (size_t capacity = 0; capacity < 2; ++capacity) {
+    MemorySink sink = { .buffer_capacity = capacity };
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    CHECK(write_document(&ser, 1));
+    serializer_set_sink(&ser, (SerializerSink){ .exchange = memory_sink_exchange, .ctx = &sink });
+    CHECK(NULL == ser.data && 0 == ser.count);
+    CHECK(!write_document(&ser, 1));
+    serializer_free(&ser);
+    free(sink.data);
+  }
+
+  free(expected);
+}
+
+// about 200 KiB, more than several sink buffers
+#define SINK_DOCUMENT_OBJECTS 6000
+
+static void test_sinks(void) {
+  size_t expected_count = 0;
+  char *expected = expected_document(SINK_DOCUMENT_OBJECTS, &expected_count);
+  CHECK(NULL != expected && expected_count > 2 * 64 * 1024);
+
+  // fd sink: the document spans several 64 KiB buffers
+  {
+    FILE *p_file = tmpfile();
+    CHECK(NULL != p_file);
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_set_sink(&ser, serializer_fd_sink(fileno(p_file)));
+    CHECK(write_document(&ser, SINK_DOCUMENT_OBJECTS));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    CHECK(serializer_bytes_written(&ser) == expected_count);
+    serializer_free(&ser);
+
+    fseek(p_file, 0, SEEK_END);
+    size_t count = 0;
+    char *data = read_file(p_file, &count);
+    CHECK(count == expected_count && 0 == memcmp(data, expected, count));
+    free(data);
+    fclose(p_file);
+  }
+
+  // async writer with tiny buffers: separators are patched right after the buffer is exchanged
+  {
+    FILE *p_file = tmpfile();
+    CHECK(NULL != p_file);
+    SerializerAsyncWriter *p_writer = serializer_async_writer_create(fileno(p_file), 3, 7);
+    CHECK(NULL != p_writer);
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_set_sink(&ser, serializer_async_writer_sink(p_writer));
+    CHECK(write_document(&ser, SINK_DOCUMENT_OBJECTS));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    serializer_free(&ser);
+    CHECK(serializer_async_writer_destroy(p_writer));
+
+    fseek(p_file, 0, SEEK_END);
+    size_t count = 0;
+    char *data = read_file(p_file, &count);
+    CHECK(count == expected_count && 0 == memcmp(data, expected, count));
+    free(data);
+    fclose(p_file);
+  }
+
+  free(expected);
+
+  test_exchange_sink_pending();
+}
+
+/// Concatenates the segments reported by serializer_get_iovec
+static char *join_iovec(const Serializer *p_ser, size_t *p_count) {
+  size_t segments = serializer_get_iovec(p_ser, NULL, 0);
+  struct iovec *iov = (struct iovec*)calloc(segments + 1, sizeof(struct iovec));
+  size_t total = 0;
+  serializer_get_iovec(p_ser, iov, segments);
+  for (size_t i = 0; i < segments; ++i) total += iov[i].iov_len;
+
+  char *data = (char*)malloc(total + 1);
+  size_t count = 0;
+  for (size_t i = 0; i < segments; ++i) {
+    memcpy(data + count, iov[i].iov_base, iov[i].iov_len);
+    count += iov[i].iov_len;
+  }
+  free(iov);
+  *p_count = count;
+  return data;
+}
+
+static bool write_int_record(Serializer *p_ser, const void *p_val) {
+  return serializer_int_to_json(p_ser, *(const int*)p_val);
+}
+
+/// Writes a long array and fails, so the record has to be rolled back
+static bool write_failing_record(Serializer *p_ser, const void *p_val) {
+  (void)p_val;
+  if (!serializer_json_start_array(p_ser)) return false;
+  for (int i = 0; i < 2000; ++i) {
+    if (!serializer_int_to_json(p_ser, i) || !serializer_json_append_separator(p_ser)) return false;
+  }
+  return false;
+}
+
+static void test_ndjson_rollback(SerializerChunkPool *p_pool) {
+  Serializer ser;
+  serializer_ndjson_start(&ser, (SerializerBatch){0});
+  if (NULL != p_pool) {
+    serializer_use_chunks(&ser, p_pool);
+  }
+
+  int one = 1;
+  CHECK(serializer_ndjson_append(&ser, write_int_record, &one));
+  CHECK(!serializer_ndjson_append(&ser, write_failing_record, NULL));
+  CHECK(serializer_ndjson_append(&ser, write_int_record, &one));
+  CHECK(serializer_ndjson_end(&ser));
+
+  SerializerData sd = serializer_get_data(&ser);
+  CHECK(5 == sd.count && 0 == strcmp(sd.data, "1\n1\n"));
+  serializer_free(&ser);
+}
+
+// chunks of 64 bytes, documents below end at every offset of a chunk
+#define TEST_CHUNK_CAPACITY 64
+
+static void test_chunks(void) {
+  SerializerChunkPool *p_pool = serializer_chunk_pool_create(TEST_CHUNK_CAPACITY);
+  CHECK(NULL != p_pool);
+
+  for (int objects = 0; objects < 40; ++objects) {
+    size_t expected_count = 0;
+    char *expected = expected_document(objects, &expected_count);
+
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_use_chunks(&ser, p_pool);
+    CHECK(write_document(&ser, objects));
+    CHECK(serializer_bytes_written(&ser) == expected_count);
+
+    size_t count = 0;
+    char *joined = join_iovec(&ser, &count);
+    CHECK(count == expected_count && 0 == memcmp(joined, expected, count));
+    free(joined);
+
+    SerializerData sd = serializer_get_data(&ser);
+    CHECK(sd.count == expected_count && 0 == memcmp(sd.data, expected, sd.count));
+
+    // appends after flattening go to new chunks again
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    sd = serializer_get_data(&ser);
+    CHECK(sd.count == expected_count + 1 && 0 == strncmp(sd.data, expected, expected_count));
+
+    serializer_free(&ser);
+    free(expected);
+  }
+
+  // the separator to patch is the last byte of the previous chunk (before_tail)
+  {
+    char name[TEST_CHUNK_CAPACITY - 3] = {0};
+    memset(name, 'x', sizeof(name) - 1);
+
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_use_chunks(&ser, p_pool);
+    CHECK(serializer_json_start_array(&ser));
+    CHECK(serializer_cstr_to_json(&ser, name));
+    CHECK(serializer_json_append_separator(&ser));
+    CHECK(TEST_CHUNK_CAPACITY == ser.count);
+
+    CHECK(serializer_json_append_separator(&ser));
+    serializer_json_remove_separator_at_end(&ser);
+    CHECK(0 == ser.count && NULL != ser.before_tail);
+    CHECK(serializer_json_end_array(&ser));
+    CHECK(serializer_bytes_written(&ser) == TEST_CHUNK_CAPACITY);
+
+    CHECK(serializer_json_start_object(&ser));
+    CHECK(serializer_json_end_object(&ser));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+
+    SerializerData sd = serializer_get_data(&ser);
+    CHECK(TEST_CHUNK_CAPACITY + 3 == sd.count);
+    CHECK('[' == sd.data[0] && ']' == sd.data[TEST_CHUNK_CAPACITY - 1]);
+    CHECK(0 == strcmp(sd.data + TEST_CHUNK_CAPACITY, "{}"));
+    serializer_free(&ser);
+  }
+
+  test_ndjson_rollback(NULL);
+  test_ndjson_rollback(p_pool);
+
+  serializer_chunk_pool_destroy(p_pool);
+}
+
+/// Flattens a chunk list of exactly one chunk capacity and appends after it,
+/// the flattened chunk belongs to the allocator and must not go to the pool
+static void test_allocator_with_chunks(SerializerAllocator allocator) {
+  SerializerChunkPool *p_pool = serializer_chunk_pool_create(TEST_CHUNK_CAPACITY);
+  CHECK(NULL != p_pool);
+
+  char name[TEST_CHUNK_CAPACITY - 1] = {0};
+  memset(name, 'x', sizeof(name) - 1);
+
+  for (int round = 0; round < 2; ++round) {
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_set_allocator(&ser, allocator);
+    serializer_use_chunks(&ser, p_pool);
+    CHECK(serializer_cstr_to_json(&ser, name));
+    CHECK(serializer_json_append_separator(&ser));
+    serializer_json_remove_separator_at_end(&ser);
+
+    SerializerData sd = serializer_get_data(&ser);
+    CHECK(TEST_CHUNK_CAPACITY == sd.count && '"' == sd.data[sd.count - 1]);
+    CHECK(serializer_json_append_separator(&ser));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    sd = serializer_get_data(&ser);
+    CHECK(TEST_CHUNK_CAPACITY + 2 == sd.count && ',' == sd.data[TEST_CHUNK_CAPACITY]);
+    serializer_free(&ser);
+  }
+
+  serializer_chunk_pool_destroy(p_pool);
+}
+
+/// Grows the buffer by serializer_reserve and by appends, output matches the malloc'ed one
+static void test_allocator_growth(SerializerAllocator allocator) {
+  size_t expected_count = 0;
+  char *expected = expected_document(500, &expected_count);
+
+  for (int round = 0; round < 3; ++round) {
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_set_allocator(&ser, allocator);
+    CHECK(serializer_reserve(&ser, 100 + round * 1000));
+    CHECK(ser.capacity >= (size_t)(100 + round * 1000));
+    CHECK(write_document(&ser, 500));
+    CHECK(serializer_reserve(&ser, 256 * 1024));
+    CHECK(ser.capacity - ser.count >= 256 * 1024);
+    CHECK(ser.count == expected_count && 0 == memcmp(ser.data, expected, ser.count));
+    serializer_free(&ser);
+  }
+
+  free(expected);
+}
+
+static void test_allocators(void) {
+  test_allocator_with_chunks(serializer_bump_allocator());
+  test_allocator_growth(serializer_bump_allocator());
+  serializer_bump_allocator_reset();
+  serializer_bump_allocator_finalize();
+
+  test_allocator_with_chunks(serializer_pool_allocator());
+  test_allocator_growth(serializer_pool_allocator());
+  serializer_pool_allocator_trim();
+}
+
+static void test_fixed_cstr(void) {
+  static const char name[8] = { 'a', '"', '\\', '\n', 0x01, 'z', '\0', 'x' };
+  static const char full[4] = { 'f', 'u', 'l', 'l' };
+
+  Serializer ser;
+  serializer_start_serialization(&ser, SER_KIND_JSON);
+  CHECK(serializer_fixed_cstr_to_json(&ser, name, sizeof(name)));
+  CHECK(serializer_fixed_cstr_to_json(&ser, full, sizeof(full)));
+  CHECK(serializer_fixed_cstr_to_json(&ser, name, 0));
+  CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+  CHECK(0 == strcmp(ser.data, "\"a\\\"\\\\\\n\\u0001z\"\"full\"\"\""));
+  serializer_free(&ser);
+}
+
+/// Straightforward base64 of the RFC, the reference for the block encoders
+static void reference_base64(char *dst, const unsigned char *src, size_t count) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < count; i += 3) {
+    unsigned int v = (unsigned int)src[i] << 16;
+    if (i + 1 < count) v |= (unsigned int)src[i + 1] << 8;
+    if (i + 2 < count) v |= src[i + 2];
+    *dst++ = alphabet[v >> 18];
+    *dst++ = alphabet[(v >> 12) & 63];
+    *dst++ = i + 1 < count ? alphabet[(v >> 6) & 63] : '=';
+    *dst++ = i + 2 < count ? alphabet[v & 63] : '=';
+  }
+}
+
+static void reference_hex(char *dst, const unsigned char *src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    sprintf(dst + 2 * i, "%02x", src[i]);
+  }
+}
+
+// longer than several SIMD blocks (12 and 16 bytes) and the 4 KiB stage of serializer_bytes_to_json
+#define BYTES_MAX_COUNT 5000
+
+/// Round trip of every length up to 300 and a few longer ones, from odd addresses too.
+/// x86-64 builds take the SSE2 hex blocks, build with -mssse3 so the SSSE3 base64 blocks run as well,
+/// the scalar tails are taken either way
+static void test_bytes_round_trip(void) {
+  static unsigned char bytes[BYTES_MAX_COUNT + 1];
+  static unsigned char decoded[BYTES_MAX_COUNT + 1];
+  static char expected[2 * BYTES_MAX_COUNT + 8];
+  static char encoded[2 * BYTES_MAX_COUNT + 8];
+
+  unsigned int seed = 12345;
+  for (size_t i = 0; i < sizeof(bytes); ++i) {
+    seed = seed * 1103515245u + 12345u;
+    bytes[i] = (unsigned char)(seed >> 16);
+  }
+
+  static const size_t long_counts[] = { 1000, 3000, 4095, 4096, 4097, BYTES_MAX_COUNT };
+  for (size_t k = 0; k < 301 + sizeof(long_counts) / sizeof(long_counts[0]); ++k) {
+    size_t count = k < 301 ? k : long_counts[k - 301];
+    for (size_t offset = 0; offset < 2 && offset + count <= sizeof(bytes); ++offset) {
+      const unsigned char *src = bytes + offset;
+
+      // base64, the byte after the text is not touched
+      size_t length = SER_BASE64_ENCODED_SIZE(count);
+      reference_base64(expected, src, count);
+      memset(encoded, '#', sizeof(encoded));
+      CHECK(length == serializer_base64_encode(encoded, src, count));
+      CHECK(0 == memcmp(encoded, expected, length) && '#' == encoded[length]);
+
+      size_t decoded_count = 0;
+      CHECK(serializer_base64_decode(decoded, &decoded_count, encoded, length));
+      CHECK(count == decoded_count && 0 == memcmp(decoded, src, count));
+
+      // hex
+      reference_hex(expected, src, count);
+      memset(encoded, '#', sizeof(encoded));
+      CHECK(2 * count == serializer_hex_encode(encoded, src, count));
+      CHECK(0 == memcmp(encoded, expected, 2 * count) && '#' == encoded[2 * count]);
+      CHECK(serializer_hex_decode(decoded, encoded, 2 * count));
+      CHECK(0 == memcmp(decoded, src, count));
+    }
+  }
+}
+
+static void test_bytes_decode(void) {
+  unsigned char decoded[8];
+  size_t count = 0;
+
+  // padding
+  CHECK(serializer_base64_decode(decoded, &count, "", 0) && 0 == count);
+  CHECK(serializer_base64_decode(decoded, &count, "YQ==", 4) && 1 == count && 'a' == decoded[0]);
+  CHECK(serializer_base64_decode(decoded, &count, "YWI=", 4) && 2 == count && 0 == memcmp(decoded, "ab", 2));
+  CHECK(serializer_base64_decode(decoded, &count, "YWJj+/8=", 8) && 5 == count);
+  CHECK(0 == memcmp(decoded, "abc\xfb\xff", 5));
+
+  // not padded base64
+  CHECK(!serializer_base64_decode(decoded, &count, "YWI", 3));
+  CHECK(!serializer_base64_decode(decoded, &count, "ab=c", 4));
+  CHECK(!serializer_base64_decode(decoded, &count, "a===", 4));
+  CHECK(!serializer_base64_decode(decoded, &count, "YQ==YWI=", 8));
+  CHECK(!serializer_base64_decode(decoded, &count, "YW-j", 4));
+  CHECK(!serializer_base64_decode(decoded, &count, "YW\x80j", 4));
+
+  // hex of either case
+  CHECK(serializer_hex_decode(decoded, "", 0));
+  CHECK(serializer_hex_decode(decoded, "0A1bFf", 6) && 0 == memcmp(decoded, "\x0a\x1b\xff", 3));
+  CHECK(!serializer_hex_decode(decoded, "abc", 3));
+  CHECK(!serializer_hex_decode(decoded, "0g", 2));
+  CHECK(!serializer_hex_decode(decoded, "g0", 2));
+  CHECK(!serializer_hex_decode(decoded, " 1", 2));
+}
+
+// the encoded text is longer than the 64 KiB buffer of the fd sink, so it goes through the stage
+#define SINK_BYTES_COUNT (100 * 1000)
+
+static void test_bytes_to_json(void) {
+  unsigned char *bytes = (unsigned char*)malloc(SINK_BYTES_COUNT);
+  char *expected = (char*)malloc(2 * SINK_BYTES_COUNT + 8);
+  CHECK(NULL != bytes && NULL != expected);
+  if (NULL == bytes || NULL == expected) {
+    free(bytes);
+    free(expected);
+    return;
+  }
+  for (size_t i = 0; i < SINK_BYTES_COUNT; ++i) {
+    bytes[i] = (unsigned char)(i * 7 + (i >> 8));
+  }
+
+  // encoded in place
+  {
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    CHECK(serializer_bytes_base64_to_json(&ser, "abcd", 4));
+    CHECK(serializer_bytes_hex_to_json(&ser, "\x01\xab", 2));
+    CHECK(serializer_bytes_base64_to_json(&ser, NULL, 0));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    CHECK(0 == strcmp(ser.data, "\"YWJjZA==\"\"01ab\"\"\""));
+    serializer_free(&ser);
+  }
+
+  // through the stage into the sink
+  for (int is_hex = 0; is_hex < 2; ++is_hex) {
+    size_t length = is_hex ? 2 * SINK_BYTES_COUNT : SER_BASE64_ENCODED_SIZE(SINK_BYTES_COUNT);
+    expected[0] = '"';
+    if (is_hex) {
+      reference_hex(expected + 1, bytes, SINK_BYTES_COUNT);
+    } else {
+      reference_base64(expected + 1, bytes, SINK_BYTES_COUNT);
+    }
+    expected[length + 1] = '"';
+
+    FILE *p_file = tmpfile();
+    CHECK(NULL != p_file);
+    if (NULL == p_file) {
+      break;
+    }
+    Serializer ser;
+    serializer_start_serialization(&ser, SER_KIND_JSON);
+    serializer_set_sink(&ser, serializer_fd_sink(fileno(p_file)));
+    CHECK(is_hex ? serializer_bytes_hex_to_json(&ser, bytes, SINK_BYTES_COUNT)
+                 : serializer_bytes_base64_to_json(&ser, bytes, SINK_BYTES_COUNT));
+    CHECK(serializer_end_serialization(&ser, SER_KIND_JSON));
+    serializer_free(&ser);
+
+    fseek(p_file, 0, SEEK_END);
+    size_t count = 0;
+    char *data = read_file(p_file, &count);
+    CHECK(count == length + 2 && 0 == memcmp(data, expected, count));
+    free(data);
+    fclose(p_file);
+  }
+
+  free(expected);
+  free(bytes);
+}
+
+static void test_bytes(void) {
+  test_bytes_round_trip();
+  test_bytes_decode();
+  test_bytes_to_json();
+}
+
 int main() {
   Serializer ser;
   serializer_start_serialization(&ser, SER_KIND_JSON);
@@ -39,6 +580,12 @@ int main() {
     serializer_json_end_array(&ser);
     serializer_json_append_separator(&ser);
 
+    int ints[] = { -2147483647 - 1, 0, 123456789 };
+    serializer_json_start_field(&ser, "ints");
+    ok = serializer_int_array_to_json(&ser, ints, sizeof(ints) / sizeof(ints[0]));
+    if (!ok) printf("Could not serialize int array\n");
+    serializer_json_end_field(&ser);
+
 
 
     serializer_json_start_field(&ser, "users");
@@ -91,5 +638,11 @@ int main() {
 
   serializer_free(&ser);
 
-  return 0;
+  test_sinks();
+  test_chunks();
+  test_allocators();
+  test_fixed_cstr();
+  test_bytes();
+
+  return 0 == failures ? 0 : 1;
 }
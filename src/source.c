@@ -0,0 +1,168 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+#define SOURCE_READ_CHUNK 4096
+
+/// Reads everything from fd into malloc'ed buffer
+///
+/// @return bool, false on failure, errno is set
+static bool source_file_read(int fd, SourceFile *p_out) {
+  char *data = NULL;
+  usize length = 0;
+  usize capacity = 0;
+
+  for (;;) {
+    if (length == capacity) {
+      capacity = 0 == capacity ? SOURCE_READ_CHUNK : capacity * 2;
+      char *tmp = (char*)realloc(data, capacity);
+      if (NULL == tmp) {
+        free(data);
+        return false;
+      }
+      data = tmp;
+    }
+
+    isize n = read(fd, data + length, capacity - length);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      free(data);
+      return false;
+    }
+    if (0 == n) break;
+    length += (usize)n;
+  }
+
+  if (0 == length) {
+    free(data);
+    data = (char*)"";
+  }
+
+  *p_out = (SourceFile){ .data = data, .length = length, .is_mapped = false };
+  return true;
+}
+
+bool source_file_open(const char *path, SourceFile *p_out) {
+  assert(NULL != path);
+  assert(NULL != p_out);
+
+  int fd = open(path, O_RDONLY);
+  if (-1 == fd) {
+    return false;
+  }
+
+  bool ok = true;
+  struct stat st;
+  if (-1 == fstat(fd, &st)) {
+    ok = false;
+  } else if (!S_ISREG(st.st_mode)) {
+    ok = source_file_read(fd, p_out);
+  } else if (0 == st.st_size) {
+    // mmap of an empty file fails
+    *p_out = (SourceFile){ .data = "", .length = 0, .is_mapped = false };
+  } else {
+    void *data = mmap(NULL, (usize)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data) {
+      ok = false;
+    } else {
+      (void)madvise(data, (usize)st.st_size, MADV_SEQUENTIAL);
+      *p_out = (SourceFile){ .data = data, .length = (usize)st.st_size, .is_mapped = true };
+    }
+  }
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return ok;
+}
+
+void source_file_close(SourceFile *p_source) {
+  assert(NULL != p_source);
+
+  if (p_source->is_mapped) {
+    munmap((void*)p_source->data, p_source->length);
+  } else if (0 != p_source->length) {
+    free((void*)p_source->data);
+  }
+
+  *p_source = (SourceFile){0};
+}
+
+/// Writes all size bytes of data to fd
+///
+/// @return bool, false on failure, errno is set
+static bool file_write_all(int fd, const u8 *data, usize size) {
+  while (size > 0) {
+    isize n = write(fd, data, size);
+    if (n < 0) {
+      if (EINTR == errno) continue;
+      return false;
+    }
+    data += n;
+    size -= (usize)n;
+  }
+
+  return true;
+}
+
+bool file_write_if_changed(const char *path, const void *data, usize size, bool *p_written) {
+  assert(NULL != path);
+  assert(NULL != data || 0 == size);
+
+  if (NULL != p_written) *p_written = false;
+
+  SourceFile existing;
+  if (source_file_open(path, &existing)) {
+    bool is_same = existing.length == size && 0 == memcmp(existing.data, data, size);
+    source_file_close(&existing);
+    if (is_same) {
+      return true;
+    }
+  } else if (ENOENT != errno) {
+    return false;
+  }
+
+  // temporary file in the same directory, so rename does not cross file systems
+  usize path_length = strlen(path);
+  char *tmp_path = (char*)malloc(path_length + 32);
+  if (NULL == tmp_path) {
+    return false;
+  }
+  snprintf(tmp_path, path_length + 32, "%s.tmp.%ld", path, (long)getpid());
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (-1 == fd) {
+    free(tmp_path);
+    return false;
+  }
+
+  bool ok = file_write_all(fd, (const u8*)data, size);
+  int saved_errno = errno;
+  if (0 != close(fd) && ok) {
+    saved_errno = errno;
+    ok = false;
+  }
+
+  if (ok && 0 != rename(tmp_path, path)) {
+    saved_errno = errno;
+    ok = false;
+  }
+
+  if (!ok) {
+    unlink(tmp_path);
+  } else if (NULL != p_written) {
+    *p_written = true;
+  }
+
+  free(tmp_path);
+  errno = saved_errno;
+  return ok;
+}
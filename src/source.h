@@ -0,0 +1,42 @@
+#ifndef __SERC_SOURCE_H__
+#define __SERC_SOURCE_H__
+
+#include "common.h"
+
+/// Read-only content of the source file.
+/// Content is not NUL-terminated and has to stay open
+/// while StringViews produced by parsing it are in use
+typedef struct {
+  const char *data;
+  usize length;
+
+  /// true if data is mapped with mmap, otherwise it is malloc'ed (or a static empty string)
+  bool is_mapped;
+} SourceFile;
+
+/// Maps the regular file at path into memory,
+/// files that cannot be mapped (pipes, character devices) are read instead
+///
+/// @param path: path to the file
+/// @param p_out: source file to open
+/// @return bool, false on failure, errno is set
+bool source_file_open(const char *path, SourceFile *p_out);
+
+/// Unmaps or frees the content
+///
+/// @param p_source: source file to close
+/// @return void
+void source_file_close(SourceFile *p_source);
+
+/// Replaces the file at path with size bytes of data unless it already holds exactly them.
+/// New content is written to a temporary file next to path and renamed over it,
+/// so readers never see a partially written file and unchanged files keep their mtime
+///
+/// @param path: path to the file
+/// @param data: new content
+/// @param size: number of bytes in data
+/// @param p_written: optional, set to true if the file was replaced
+/// @return bool, false on failure, errno is set
+bool file_write_if_changed(const char *path, const void *data, usize size, bool *p_written);
+
+#endif // !__SERC_SOURCE_H__
@@ -0,0 +1,261 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "source_graph.h"
+#include "hash.h"
+#include "scanner.h"
+#include "./lib/ds/logger.h"
+
+enum {
+  VISIT_NONE = 0,
+  VISIT_ACTIVE,
+  VISIT_DONE,
+};
+
+typedef struct {
+  SourceGraph *p_graph;
+  SourceNode **nodes;
+  bool ok;
+} LoadContext;
+
+void source_graph_init(SourceGraph *p_graph, const char *const *include_dirs, usize include_dirs_count) {
+  assert(NULL != p_graph);
+
+  *p_graph = (SourceGraph){
+    .include_dirs = include_dirs,
+    .include_dirs_count = include_dirs_count,
+  };
+  pthread_mutex_init(&p_graph->lock, NULL);
+  symbol_table_init(&p_graph->paths);
+  arena_init(&p_graph->arena, 0);
+}
+
+/// Returns the node of the file, creating it if the file is new.
+/// Takes the lock of the graph
+static SourceNode* source_graph_add(SourceGraph *p_graph, const char *path, const char *real_path, bool is_input) {
+  pthread_mutex_lock(&p_graph->lock);
+
+  Symbol *p_symbol = symbol_intern(&p_graph->paths, &p_graph->arena, string_view_from_cstr(real_path));
+  SourceNode *p_node = (SourceNode*)p_symbol->p_data;
+
+  if (NULL == p_node) {
+    if (p_graph->count == p_graph->capacity) {
+      usize capacity = 0 == p_graph->capacity ? 64 : p_graph->capacity * 2;
+      SourceNode **nodes = (SourceNode**)realloc(p_graph->nodes, capacity * sizeof(SourceNode*));
+      if (NULL == nodes) {
+        logf_fatal("SOURCE", 1, "out of memory\n");
+      }
+      p_graph->nodes = nodes;
+      p_graph->capacity = capacity;
+    }
+
+    p_node = (SourceNode*)arena_alloc(&p_graph->arena, sizeof(SourceNode));
+    char *path_copy = arena_strndup(&p_graph->arena, path, strlen(path));
+    char *real_path_copy = arena_strndup(&p_graph->arena, real_path, strlen(real_path));
+    if (NULL == p_node || NULL == path_copy || NULL == real_path_copy) {
+      logf_fatal("SOURCE", 1, "out of memory\n");
+    }
+
+    *p_node = (SourceNode){ .path = path_copy, .real_path = real_path_copy };
+    // the key has to outlive real_path of the caller
+    p_symbol->name = string_view_from_cstr(real_path_copy);
+    p_symbol->p_data = p_node;
+    p_graph->nodes[p_graph->count++] = p_node;
+  }
+
+  p_node->is_input |= is_input;
+
+  pthread_mutex_unlock(&p_graph->lock);
+  return p_node;
+}
+
+SourceNode* source_graph_add_input(SourceGraph *p_graph, const char *path) {
+  assert(NULL != p_graph);
+  assert(NULL != path);
+
+  char *real_path = realpath(path, NULL);
+  if (NULL == real_path) {
+    return NULL;
+  }
+
+  SourceNode *p_node = source_graph_add(p_graph, path, real_path, true);
+  free(real_path);
+  return p_node;
+}
+
+/// Adds the file included as include_path from p_node, looking next to p_node first
+/// and in include directories then
+///
+/// @return SourceNode*, NULL if the file is not found
+static SourceNode* source_graph_add_include(SourceGraph *p_graph, const SourceNode *p_node, StringView include_path) {
+  char path[PATH_MAX];
+
+  for (usize i = 0; i <= p_graph->include_dirs_count; ++i) {
+    int length = 0;
+    if ('/' == *include_path.p_begin) {
+      length = snprintf(path, sizeof(path), string_view_farg, string_view_expand(include_path));
+    } else if (0 == i) {
+      const char *slash = strrchr(p_node->path, '/');
+      int dir_length = NULL == slash ? 1 : (int)(slash - p_node->path);
+      length = snprintf(path, sizeof(path), "%.*s/" string_view_farg,
+                        dir_length, NULL == slash ? "." : p_node->path, string_view_expand(include_path));
+    } else {
+      length = snprintf(path, sizeof(path), "%s/" string_view_farg,
+                        p_graph->include_dirs[i - 1], string_view_expand(include_path));
+    }
+
+    if (length < 0 || (usize)length >= sizeof(path)) continue;
+
+    char *real_path = realpath(path, NULL);
+    if (NULL != real_path) {
+      SourceNode *p_included = source_graph_add(p_graph, path, real_path, false);
+      free(real_path);
+      return p_included;
+    }
+
+    if ('/' == *include_path.p_begin) break;
+  }
+
+  return NULL;
+}
+
+/// Opens the file of the node and adds files it includes
+static void source_graph_load_task(void *ctx, usize index) {
+  LoadContext *p_ctx = (LoadContext*)ctx;
+  SourceNode *p_node = p_ctx->nodes[index];
+
+  if (!source_file_open(p_node->real_path, &p_node->source)) {
+    if (p_node->is_input) {
+      logf_error("SOURCE", "error reading file %s: %s\n", p_node->path, strerror(errno));
+      pthread_mutex_lock(&p_ctx->p_graph->lock);
+      p_ctx->ok = false;
+      pthread_mutex_unlock(&p_ctx->p_graph->lock);
+    }
+    return;
+  }
+  p_node->is_open = true;
+  p_node->content_hash = hash_bytes(p_node->source.data, p_node->source.length, 0);
+
+  Scanner scanner;
+  scanner_init(&scanner, p_node->source.data, p_node->source.length);
+
+  StringView include_path;
+  while (scanner_next_include(&scanner, &include_path)) {
+    if (0 == include_path.length) continue;
+
+    SourceNode *p_included = source_graph_add_include(p_ctx->p_graph, p_node, include_path);
+    if (NULL == p_included) {
+      logf_trace("SOURCE", "%s: include \"" string_view_farg "\" is not found\n",
+                 p_node->path, string_view_expand(include_path));
+      continue;
+    }
+
+    bool is_known = false;
+    for (usize i = 0; i < p_node->includes_count && !is_known; ++i) {
+      is_known = p_included == p_node->includes[i];
+    }
+    if (is_known) continue;
+
+    if (p_node->includes_count == p_node->includes_capacity) {
+      usize capacity = 0 == p_node->includes_capacity ? 8 : p_node->includes_capacity * 2;
+      SourceNode **includes = (SourceNode**)realloc(p_node->includes, capacity * sizeof(SourceNode*));
+      if (NULL == includes) {
+        logf_fatal("SOURCE", 1, "out of memory\n");
+      }
+      p_node->includes = includes;
+      p_node->includes_capacity = capacity;
+    }
+    p_node->includes[p_node->includes_count++] = p_included;
+  }
+}
+
+/// Computes level and key_hash of the node after the nodes it includes,
+/// includes closing a cycle are ignored
+static void source_graph_visit(SourceNode *p_node) {
+  p_node->visit_state = VISIT_ACTIVE;
+  p_node->level = 0;
+  u64 key_hash = hash_bytes(&p_node->content_hash, sizeof(p_node->content_hash), 0);
+
+  for (usize i = 0; i < p_node->includes_count; ++i) {
+    SourceNode *p_included = p_node->includes[i];
+    if (VISIT_NONE == p_included->visit_state) {
+      source_graph_visit(p_included);
+    }
+    if (VISIT_DONE != p_included->visit_state) continue;
+
+    if (p_included->level + 1 > p_node->level) p_node->level = p_included->level + 1;
+    key_hash = hash_bytes(&p_included->key_hash, sizeof(p_included->key_hash), key_hash);
+  }
+
+  p_node->key_hash = key_hash;
+  p_node->visit_state = VISIT_DONE;
+}
+
+static int source_node_path_cmp(const void *lhs, const void *rhs) {
+  return strcmp((*(SourceNode* const*)lhs)->real_path, (*(SourceNode* const*)rhs)->real_path);
+}
+
+static int source_node_level_cmp(const void *lhs, const void *rhs) {
+  const SourceNode *p_lhs = *(SourceNode* const*)lhs;
+  const SourceNode *p_rhs = *(SourceNode* const*)rhs;
+  if (p_lhs->level != p_rhs->level) {
+    return p_lhs->level < p_rhs->level ? -1 : 1;
+  }
+  return strcmp(p_lhs->real_path, p_rhs->real_path);
+}
+
+bool source_graph_load(SourceGraph *p_graph, ThreadPool *p_pool) {
+  assert(NULL != p_graph);
+  assert(NULL != p_pool);
+
+  LoadContext ctx = { .p_graph = p_graph, .ok = true };
+
+  // every wave opens files found by the previous one
+  for (usize begin = 0; begin < p_graph->count;) {
+    usize end = p_graph->count;
+
+    // nodes may be reallocated while the wave adds new ones
+    ctx.nodes = (SourceNode**)malloc((end - begin) * sizeof(SourceNode*));
+    if (NULL == ctx.nodes) {
+      logf_fatal("SOURCE", 1, "out of memory\n");
+    }
+    memcpy(ctx.nodes, p_graph->nodes + begin, (end - begin) * sizeof(SourceNode*));
+
+    thread_pool_run(p_pool, end - begin, source_graph_load_task, &ctx);
+
+    free(ctx.nodes);
+    begin = end;
+  }
+
+  // levels do not depend on the order files were found in
+  qsort(p_graph->nodes, p_graph->count, sizeof(SourceNode*), source_node_path_cmp);
+  for (usize i = 0; i < p_graph->count; ++i) {
+    if (VISIT_NONE == p_graph->nodes[i]->visit_state) {
+      source_graph_visit(p_graph->nodes[i]);
+    }
+  }
+
+  qsort(p_graph->nodes, p_graph->count, sizeof(SourceNode*), source_node_level_cmp);
+  for (usize i = 0; i < p_graph->count; ++i) {
+    p_graph->nodes[i]->index = i;
+  }
+
+  return ctx.ok;
+}
+
+void source_graph_free(SourceGraph *p_graph) {
+  assert(NULL != p_graph);
+
+  for (usize i = 0; i < p_graph->count; ++i) {
+    SourceNode *p_node = p_graph->nodes[i];
+    if (p_node->is_open) source_file_close(&p_node->source);
+    free(p_node->includes);
+  }
+
+  free(p_graph->nodes);
+  symbol_table_free(&p_graph->paths);
+  arena_free(&p_graph->arena);
+  pthread_mutex_destroy(&p_graph->lock);
+}
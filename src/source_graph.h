@@ -0,0 +1,91 @@
+#ifndef __SERC_SOURCE_GRAPH_H__
+#define __SERC_SOURCE_GRAPH_H__
+
+#include <pthread.h>
+
+#include "common.h"
+#include "arena.h"
+#include "source.h"
+#include "symbol.h"
+#include "thread_pool.h"
+
+/// Source file and the files it includes with #include "..."
+typedef struct SourceNode {
+  /// path the file was found by, used in messages
+  const char *path;
+
+  /// canonical path, there is one node per real_path
+  const char *real_path;
+
+  SourceFile source;
+  bool is_open;
+
+  u64 content_hash;
+
+  /// content_hash combined with key_hash of included files,
+  /// changes whenever the file or anything it includes changes
+  u64 key_hash;
+
+  struct SourceNode **includes;
+  usize includes_count;
+  usize includes_capacity;
+
+  /// files of a level include only files of lower levels (include cycles aside),
+  /// so every level can be parsed in parallel once the previous ones are done
+  usize level;
+
+  /// position in SourceGraph.nodes after source_graph_load
+  usize index;
+
+  /// file was passed to the generator, not just included
+  bool is_input;
+
+  /// state of the depth-first walk computing levels
+  u8 visit_state;
+} SourceNode;
+
+/// Input files and everything they include, every file is opened once per run
+typedef struct {
+  SourceNode **nodes;
+  usize count;
+  usize capacity;
+
+  /// directories searched for includes not found next to the including file
+  const char *const *include_dirs;
+  usize include_dirs_count;
+
+  /// guards everything above while includes are followed in parallel
+  pthread_mutex_t lock;
+
+  /// real_path -> SourceNode* (Symbol.p_data)
+  SymbolTable paths;
+
+  /// owns nodes and paths
+  Arena arena;
+} SourceGraph;
+
+/// Initializes an empty graph
+///
+/// @param p_graph: graph to initialize
+/// @param include_dirs: directories searched for includes, have to outlive the graph
+/// @param include_dirs_count: number of include_dirs
+/// @return void
+void source_graph_init(SourceGraph *p_graph, const char *const *include_dirs, usize include_dirs_count);
+
+/// Adds an input file, files added more than once (e.g. through a symlink) share the node
+///
+/// @return SourceNode*, NULL if the file does not exist, errno is set
+SourceNode* source_graph_add_input(SourceGraph *p_graph, const char *path);
+
+/// Opens all input files, follows their includes and sorts nodes by level.
+/// Includes that cannot be found are skipped
+///
+/// @param p_graph: graph with inputs added
+/// @param p_pool: pool to open files on
+/// @return bool, false if an input file could not be read
+bool source_graph_load(SourceGraph *p_graph, ThreadPool *p_pool);
+
+/// Closes all files and frees the graph
+void source_graph_free(SourceGraph *p_graph);
+
+#endif // !__SERC_SOURCE_GRAPH_H__
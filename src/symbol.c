@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbol.h"
+#include "hash.h"
+#include "./lib/ds/logger.h"
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+
+void symbol_table_init(SymbolTable *p_table) {
+  assert(NULL != p_table);
+  *p_table = (SymbolTable){0};
+}
+
+void symbol_table_free(SymbolTable *p_table) {
+  assert(NULL != p_table);
+  free(p_table->slots);
+  *p_table = (SymbolTable){0};
+}
+
+u64 symbol_hash(StringView name) {
+  return hash_bytes(name.p_begin, name.length, 0);
+}
+
+/// Returns the slot holding the name or the empty slot where it belongs
+static Symbol** symbol_table_slot(const SymbolTable *p_table, StringView name, u64 hash) {
+  usize mask = p_table->capacity - 1;
+  for (usize i = hash & mask;; i = (i + 1) & mask) {
+    Symbol **p_slot = p_table->slots + i;
+    if (NULL == *p_slot) return p_slot;
+
+    const Symbol *p_symbol = *p_slot;
+    if (p_symbol->hash == hash && p_symbol->name.length == name.length
+      && 0 == memcmp(p_symbol->name.p_begin, name.p_begin, name.length)) {
+      return p_slot;
+    }
+  }
+}
+
+/// Doubles the number of slots, stored hashes are reused
+static void symbol_table_grow(SymbolTable *p_table) {
+  usize capacity = 0 == p_table->capacity ? SYMBOL_TABLE_INITIAL_CAPACITY : p_table->capacity * 2;
+  Symbol **slots = (Symbol**)calloc(capacity, sizeof(Symbol*));
+  if (NULL == slots) {
+    logf_fatal("SYMBOL", 1, "out of memory\n");
+  }
+
+  usize mask = capacity - 1;
+  for (usize i = 0; i < p_table->capacity; ++i) {
+    Symbol *p_symbol = p_table->slots[i];
+    if (NULL == p_symbol) continue;
+
+    usize j = p_symbol->hash & mask;
+    while (NULL != slots[j]) j = (j + 1) & mask;
+    slots[j] = p_symbol;
+  }
+
+  free(p_table->slots);
+  p_table->slots = slots;
+  p_table->capacity = capacity;
+}
+
+Symbol* symbol_intern(SymbolTable *p_table, Arena *p_arena, StringView name) {
+  assert(NULL != p_table);
+  assert(NULL != p_arena);
+
+  // keep load factor under 1/2
+  if (2 * (p_table->count + 1) > p_table->capacity) {
+    symbol_table_grow(p_table);
+  }
+
+  u64 hash = symbol_hash(name);
+  Symbol **p_slot = symbol_table_slot(p_table, name, hash);
+  if (NULL != *p_slot) {
+    return *p_slot;
+  }
+
+  Symbol *p_symbol = (Symbol*)arena_alloc(p_arena, sizeof(Symbol));
+  if (NULL == p_symbol) {
+    logf_fatal("SYMBOL", 1, "out of memory\n");
+  }
+  *p_symbol = (Symbol){ .name = name, .hash = hash };
+
+  *p_slot = p_symbol;
+  ++p_table->count;
+  return p_symbol;
+}
+
+Symbol* symbol_find(const SymbolTable *p_table, StringView name) {
+  assert(NULL != p_table);
+
+  if (0 == p_table->count) {
+    return NULL;
+  }
+
+  return *symbol_table_slot(p_table, name, symbol_hash(name));
+}
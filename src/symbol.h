@@ -0,0 +1,55 @@
+#ifndef __SERC_SYMBOL_H__
+#define __SERC_SYMBOL_H__
+
+#include "common.h"
+#include "arena.h"
+#include "./lib/ds/string_view.h"
+
+/// Interned name, there is one Symbol per distinct name in a SymbolTable,
+/// so symbols (and their names) are compared by pointer
+typedef struct {
+  /// points to the first interned occurrence of the name, it is not copied
+  StringView name;
+  u64 hash;
+
+  /// TypeInfo of the typedef with this name, NULL if there is none
+  void *p_typedef;
+
+  /// index + 1 of the struct with this name, 0 if there is none
+  usize struct_index;
+
+  /// data of the table owner that does not fit the slots above
+  void *p_data;
+} Symbol;
+
+/// Open addressing hash set of symbols
+typedef struct {
+  Symbol **slots;
+
+  /// number of slots, power of two
+  usize capacity;
+  usize count;
+} SymbolTable;
+
+/// Initializes an empty table
+void symbol_table_init(SymbolTable *p_table);
+
+/// Frees slots of the table, symbols are owned by the arena they were interned into
+void symbol_table_free(SymbolTable *p_table);
+
+/// Hashes the name the way the table does
+u64 symbol_hash(StringView name);
+
+/// Returns the symbol of the name, creating it in p_arena if the name is new.
+/// The bytes of the name have to outlive the table
+///
+/// @param p_table: table to intern into
+/// @param p_arena: arena new symbol is allocated from
+/// @param name: name to intern
+/// @return Symbol*, symbol of the name
+Symbol* symbol_intern(SymbolTable *p_table, Arena *p_arena, StringView name);
+
+/// Returns the symbol of the name or NULL if it was not interned
+Symbol* symbol_find(const SymbolTable *p_table, StringView name);
+
+#endif // !__SERC_SYMBOL_H__
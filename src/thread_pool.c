@@ -0,0 +1,132 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+static pthread_mutex_t g_arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void arena_lock(void) {
+  pthread_mutex_lock(&g_arena_lock);
+}
+
+void arena_unlock(void) {
+  pthread_mutex_unlock(&g_arena_lock);
+}
+
+/// Takes indices of the current loop until there are none left,
+/// returns with the lock held
+///
+/// @param p_pool: pool to take indices from, its lock should be held
+/// @return void
+static void thread_pool_work(ThreadPool *p_pool) {
+  while (p_pool->next < p_pool->count) {
+    usize index = p_pool->next++;
+    ThreadPoolTask task = p_pool->task;
+    void *ctx = p_pool->ctx;
+    pthread_mutex_unlock(&p_pool->lock);
+
+    task(ctx, index);
+
+    pthread_mutex_lock(&p_pool->lock);
+    if (++p_pool->finished == p_pool->count) {
+      pthread_cond_broadcast(&p_pool->work_done);
+    }
+  }
+}
+
+static void *thread_pool_worker(void *arg) {
+  ThreadPool *p_pool = (ThreadPool*)arg;
+
+  pthread_mutex_lock(&p_pool->lock);
+  for (;;) {
+    while (!p_pool->stopping && p_pool->next >= p_pool->count) {
+      pthread_cond_wait(&p_pool->has_work, &p_pool->lock);
+    }
+
+    if (p_pool->stopping) {
+      break;
+    }
+
+    thread_pool_work(p_pool);
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+
+  return NULL;
+}
+
+bool thread_pool_init(ThreadPool *p_pool, usize threads_count) {
+  assert(NULL != p_pool);
+
+  *p_pool = (ThreadPool){0};
+  pthread_mutex_init(&p_pool->lock, NULL);
+  pthread_cond_init(&p_pool->has_work, NULL);
+  pthread_cond_init(&p_pool->work_done, NULL);
+
+  if (0 == threads_count) {
+    return true;
+  }
+
+  p_pool->threads = (pthread_t*)malloc(threads_count * sizeof(pthread_t));
+  if (NULL == p_pool->threads) {
+    thread_pool_free(p_pool);
+    return false;
+  }
+
+  for (; p_pool->threads_count < threads_count; ++p_pool->threads_count) {
+    if (0 != pthread_create(p_pool->threads + p_pool->threads_count, NULL, thread_pool_worker, p_pool)) {
+      thread_pool_free(p_pool);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void thread_pool_run(ThreadPool *p_pool, usize count, ThreadPoolTask task, void *ctx) {
+  assert(NULL != p_pool);
+  assert(NULL != task);
+
+  if (0 == count) {
+    return;
+  }
+
+  pthread_mutex_lock(&p_pool->lock);
+  p_pool->task = task;
+  p_pool->ctx = ctx;
+  p_pool->count = count;
+  p_pool->next = 0;
+  p_pool->finished = 0;
+  pthread_cond_broadcast(&p_pool->has_work);
+
+  thread_pool_work(p_pool);
+
+  while (p_pool->finished < p_pool->count) {
+    pthread_cond_wait(&p_pool->work_done, &p_pool->lock);
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+}
+
+void thread_pool_free(ThreadPool *p_pool) {
+  assert(NULL != p_pool);
+
+  pthread_mutex_lock(&p_pool->lock);
+  p_pool->stopping = true;
+  pthread_cond_broadcast(&p_pool->has_work);
+  pthread_mutex_unlock(&p_pool->lock);
+
+  for (usize i = 0; i < p_pool->threads_count; ++i) {
+    pthread_join(p_pool->threads[i], NULL);
+  }
+
+  free(p_pool->threads);
+  pthread_cond_destroy(&p_pool->work_done);
+  pthread_cond_destroy(&p_pool->has_work);
+  pthread_mutex_destroy(&p_pool->lock);
+  *p_pool = (ThreadPool){0};
+}
+
+usize thread_pool_cpu_count(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count < 1 ? 1 : (usize)count;
+}
@@ -0,0 +1,66 @@
+#ifndef __SERC_THREAD_POOL_H__
+#define __SERC_THREAD_POOL_H__
+
+#include <pthread.h>
+
+#include "common.h"
+
+/// Task of the parallel loop, called once for every index
+typedef void (*ThreadPoolTask)(void *ctx, usize index);
+
+/// Fixed set of worker threads running parallel loops
+typedef struct {
+  pthread_t *threads;
+  usize threads_count;
+
+  pthread_mutex_t lock;
+
+  /// signaled when a new loop is started or the pool is stopping
+  pthread_cond_t has_work;
+
+  /// signaled when the last index of the loop is finished
+  pthread_cond_t work_done;
+
+  ThreadPoolTask task;
+  void *ctx;
+  usize count;
+  usize next;
+  usize finished;
+  bool stopping;
+} ThreadPool;
+
+/// Starts worker threads
+///
+/// @param p_pool: pool to initialize
+/// @param threads_count: number of workers, the thread calling thread_pool_run
+///   takes part in the loop as well, so 0 runs everything on it
+/// @return bool, false if threads could not be started
+bool thread_pool_init(ThreadPool *p_pool, usize threads_count);
+
+/// Calls task(ctx, i) for every i in [0, count) on the pool threads
+/// and returns when all calls are finished
+///
+/// @param p_pool: pool to run the loop on
+/// @param count: number of indices
+/// @param task: function to be called for each index
+/// @param ctx: first argument of the task
+/// @return void
+void thread_pool_run(ThreadPool *p_pool, usize count, ThreadPoolTask task, void *ctx);
+
+/// Stops and joins worker threads
+///
+/// @param p_pool: pool to free
+/// @return void
+void thread_pool_free(ThreadPool *p_pool);
+
+/// Returns number of online CPUs, at least 1
+usize thread_pool_cpu_count(void);
+
+/// ds allocator is not thread safe, so every allocation (and free)
+/// made from a pool task has to be done under this lock
+void arena_lock(void);
+void arena_unlock(void);
+
+#define ARENA_LOCKED(stmt) do { arena_lock(); stmt; arena_unlock(); } while (0)
+
+#endif // !__SERC_THREAD_POOL_H__
@@ -12,6 +12,7 @@ const char *token_kind_to_cstr(TokenKind kind) {
     case TOK_SEMICOLON: return "TOK_SEMICOLON";
     case TOK_STAR: return "TOK_STAR";
     case TOK_IDENTIFIER: return "TOK_IDENTIFIER";
+    case TOK_NUMBER: return "TOK_NUMBER";
     case TOK_CHAR: return "TOK_CHAR";
     case TOK_CONST: return "TOK_CONST";
     case TOK_DOUBLE: return "TOK_DOUBLE";
@@ -12,7 +12,7 @@ typedef enum {
   TOK_COMMA, TOK_SEMICOLON, TOK_STAR,
 
   // Literals.
-  TOK_IDENTIFIER,
+  TOK_IDENTIFIER, TOK_NUMBER,
 
   // Keywords.
   TOK_CHAR, TOK_CONST, TOK_DOUBLE, TOK_FLOAT,
@@ -0,0 +1,251 @@
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "watch.h"
+#include "./lib/ds/logger.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/// Grows the array at *p_items to hold one more item of item_size
+///
+/// @return bool, false if out of memory
+static bool watcher_reserve(void **p_items, usize count, usize *p_capacity, usize item_size) {
+  if (count < *p_capacity) {
+    return true;
+  }
+
+  usize capacity = 0 == *p_capacity ? 16 : *p_capacity * 2;
+  void *tmp = realloc(*p_items, capacity * item_size);
+  if (NULL == tmp) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  *p_items = tmp;
+  *p_capacity = capacity;
+  return true;
+}
+
+static const WatchedDir* watcher_find_dir(const Watcher *p_watcher, int wd) {
+  for (usize i = 0; i < p_watcher->dirs_count; ++i) {
+    if (wd == p_watcher->dirs[i].wd) return p_watcher->dirs + i;
+  }
+  return NULL;
+}
+
+static bool watcher_is_ignored(const Watcher *p_watcher, const char *dir, const char *name) {
+  usize dir_length = strlen(dir);
+  for (usize i = 0; i < p_watcher->ignored_count; ++i) {
+    const char *ignored = p_watcher->ignored[i];
+    if (0 == strncmp(ignored, dir, dir_length) && '/' == ignored[dir_length]
+      && 0 == strcmp(ignored + dir_length + 1, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool is_source_name(const char *name) {
+  usize length = strlen(name);
+  return length > 2 && '.' == name[length - 2] && ('c' == name[length - 1] || 'h' == name[length - 1]);
+}
+
+bool watcher_init(Watcher *p_watcher) {
+  assert(NULL != p_watcher);
+
+  *p_watcher = (Watcher){0};
+  p_watcher->fd = inotify_init1(IN_CLOEXEC);
+  return -1 != p_watcher->fd;
+}
+
+bool watcher_add_dir(Watcher *p_watcher, const char *path, bool is_recursive) {
+  assert(NULL != p_watcher);
+  assert(NULL != path);
+
+  char real_path[PATH_MAX];
+  if (NULL == realpath(path, real_path)) {
+    return false;
+  }
+
+  int wd = inotify_add_watch(p_watcher->fd, real_path, WATCH_EVENTS | IN_ONLYDIR);
+  if (-1 == wd) {
+    return false;
+  }
+
+  // the same directory (maybe through a symlink) is watched already, so is everything inside
+  if (NULL != watcher_find_dir(p_watcher, wd)) {
+    return true;
+  }
+
+  char *copy = strdup(real_path);
+  if (NULL == copy
+    || !watcher_reserve((void**)&p_watcher->dirs, p_watcher->dirs_count,
+                        &p_watcher->dirs_capacity, sizeof(WatchedDir))) {
+    free(copy);
+    errno = ENOMEM;
+    return false;
+  }
+  p_watcher->dirs[p_watcher->dirs_count++] = (WatchedDir){ .wd = wd, .path = copy };
+
+  if (!is_recursive) {
+    return true;
+  }
+
+  DIR *dir = opendir(real_path);
+  if (NULL == dir) {
+    return false;
+  }
+
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && NULL != (entry = readdir(dir))) {
+    if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+      continue;
+    }
+
+    char child[PATH_MAX];
+    if ((usize)snprintf(child, sizeof(child), "%s/%s", real_path, entry->d_name) >= sizeof(child)) {
+      continue;
+    }
+
+    struct stat st;
+    if (DT_DIR == entry->d_type || (DT_LNK == entry->d_type && 0 == stat(child, &st) && S_ISDIR(st.st_mode))) {
+      ok = watcher_add_dir(p_watcher, child, true);
+    }
+  }
+
+  closedir(dir);
+  return ok;
+}
+
+bool watcher_ignore(Watcher *p_watcher, const char *path) {
+  assert(NULL != p_watcher);
+  assert(NULL != path);
+
+  const char *name = strrchr(path, '/');
+  char dir[PATH_MAX];
+  if (NULL == name) {
+    strcpy(dir, ".");
+    name = path;
+  } else if ((usize)(name - path) >= sizeof(dir)) {
+    errno = ENAMETOOLONG;
+    return false;
+  } else {
+    memcpy(dir, path, name - path);
+    dir[name - path] = '\0';
+    if ('\0' == dir[0]) strcpy(dir, "/");
+    ++name;
+  }
+
+  char real_dir[PATH_MAX];
+  if (NULL == realpath(dir, real_dir)) {
+    return false;
+  }
+
+  usize length = strlen(real_dir) + 1 + strlen(name) + 1;
+  char *ignored = (char*)malloc(length);
+  if (NULL == ignored
+    || !watcher_reserve((void**)&p_watcher->ignored, p_watcher->ignored_count,
+                        &p_watcher->ignored_capacity, sizeof(char*))) {
+    free(ignored);
+    errno = ENOMEM;
+    return false;
+  }
+
+  snprintf(ignored, length, "%s/%s", real_dir, name);
+  p_watcher->ignored[p_watcher->ignored_count++] = ignored;
+  return true;
+}
+
+/// Reads pending events
+///
+/// @return bool, false on failure, errno is set
+static bool watcher_read(Watcher *p_watcher, bool *p_changed) {
+  char buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  isize length = read(p_watcher->fd, buffer, sizeof(buffer));
+  if (length < 0) {
+    return EINTR == errno;
+  }
+
+  for (char *p = buffer; p < buffer + length;) {
+    const struct inotify_event *p_event = (const struct inotify_event*)p;
+    p += sizeof(struct inotify_event) + p_event->len;
+
+    if (p_event->mask & IN_Q_OVERFLOW) {
+      *p_changed = true;
+      continue;
+    }
+
+    const WatchedDir *p_dir = watcher_find_dir(p_watcher, p_event->wd);
+    if (NULL == p_dir || 0 == p_event->len) {
+      continue;
+    }
+
+    char path[PATH_MAX];
+    if ((usize)snprintf(path, sizeof(path), "%s/%s", p_dir->path, p_event->name) >= sizeof(path)) {
+      continue;
+    }
+
+    if (p_event->mask & IN_ISDIR) {
+      if (p_event->mask & (IN_CREATE | IN_MOVED_TO) && !watcher_add_dir(p_watcher, path, true)) {
+        logf_trace("WATCH", "could not watch %s: %s\n", path, strerror(errno));
+      }
+      *p_changed = true;
+    } else if (is_source_name(p_event->name) && !watcher_is_ignored(p_watcher, p_dir->path, p_event->name)) {
+      logf_trace("WATCH", "%s changed\n", path);
+      *p_changed = true;
+    }
+  }
+
+  return true;
+}
+
+bool watcher_wait(Watcher *p_watcher, int settle_ms) {
+  assert(NULL != p_watcher);
+
+  bool changed = false;
+  while (!changed) {
+    if (!watcher_read(p_watcher, &changed)) {
+      return false;
+    }
+  }
+
+  struct pollfd pfd = { .fd = p_watcher->fd, .events = POLLIN };
+  for (;;) {
+    int n = poll(&pfd, 1, settle_ms);
+    if (n < 0 && EINTR != errno) {
+      return false;
+    }
+    if (0 == n) {
+      return true;
+    }
+    if (n > 0 && !watcher_read(p_watcher, &changed)) {
+      return false;
+    }
+  }
+}
+
+void watcher_free(Watcher *p_watcher) {
+  assert(NULL != p_watcher);
+
+  close(p_watcher->fd);
+  for (usize i = 0; i < p_watcher->dirs_count; ++i) {
+    free(p_watcher->dirs[i].path);
+  }
+  for (usize i = 0; i < p_watcher->ignored_count; ++i) {
+    free(p_watcher->ignored[i]);
+  }
+  free(p_watcher->dirs);
+  free(p_watcher->ignored);
+
+  *p_watcher = (Watcher){0};
+}
@@ -0,0 +1,59 @@
+#ifndef __SERC_WATCH_H__
+#define __SERC_WATCH_H__
+
+#include "common.h"
+
+/// Directory watched for changes
+typedef struct {
+  int wd;
+
+  /// canonical path, malloc'ed
+  char *path;
+} WatchedDir;
+
+/// Reports changes of *.c and *.h files in watched directories (inotify)
+typedef struct {
+  int fd;
+
+  WatchedDir *dirs;
+  usize dirs_count;
+  usize dirs_capacity;
+
+  /// canonical paths of files changes of which are not reported, malloc'ed
+  char **ignored;
+  usize ignored_count;
+  usize ignored_capacity;
+} Watcher;
+
+/// Initializes a watcher with nothing to watch
+///
+/// @return bool, false on failure, errno is set
+bool watcher_init(Watcher *p_watcher);
+
+/// Starts watching the directory, watching it again is a no-op.
+/// Directories created inside watched ones later are watched as well
+///
+/// @param p_watcher: initialized watcher
+/// @param path: path to the directory
+/// @param is_recursive: also watch all directories inside
+/// @return bool, false on failure, errno is set
+bool watcher_add_dir(Watcher *p_watcher, const char *path, bool is_recursive);
+
+/// Stops reporting changes of the file at path (e.g. files written by the generator itself).
+/// The file itself does not have to exist, its directory does
+///
+/// @return bool, false on failure, errno is set
+bool watcher_ignore(Watcher *p_watcher, const char *path);
+
+/// Blocks until a source file changes, then waits until no more changes come
+/// for settle_ms, so a burst of writes (e.g. checkout, editor saves) is reported once
+///
+/// @param p_watcher: watcher with directories added
+/// @param settle_ms: quiet period in milliseconds
+/// @return bool, false on failure, errno is set
+bool watcher_wait(Watcher *p_watcher, int settle_ms);
+
+/// Stops watching and frees the watcher
+void watcher_free(Watcher *p_watcher);
+
+#endif // !__SERC_WATCH_H__
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph.h"
+#include "json.h"
+
+static int failures = 0;
+
+#define CHECK(cond)\
+  do {\
+    if (!(cond)) {\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+      ++failures;\
+    }\
+  } while (0)
+
+/// Serializes the value with refs into a new string, NULL on failure
+static char *graph_json(SerializeFunc func, const void *p_val, SerializerRefs *p_refs) {
+  Serializer ser;
+  serializer_start_serialization(&ser, SER_KIND_JSON);
+  serializer_set_refs(&ser, p_refs);
+  char *p_json = NULL;
+  if (func(&ser, p_val) && serializer_end_serialization(&ser, SER_KIND_JSON)) {
+    p_json = strdup(ser.data);
+  }
+  serializer_free(&ser);
+  return p_json;
+}
+
+/// Checks the exact output, the refs are reset first, so ids start from 1
+static void check_graph_json(SerializeFunc func, const void *p_val, SerializerRefs *p_refs,
+                             const char *expected, int line) {
+  serializer_refs_reset(p_refs);
+  char *p_json = graph_json(func, p_val, p_refs);
+  if (NULL == p_json || 0 != strcmp(p_json, expected)) {
+    printf("%s:%d: got\n  %s\nexpected\n  %s\n", __FILE__, line, p_json ? p_json : "(failed)", expected);
+    ++failures;
+  }
+  free(p_json);
+}
+
+#define CHECK_GRAPH_JSON(func, p_val, p_refs, expected) check_graph_json(func, p_val, p_refs, expected, __LINE__)
+
+static void test_cycle(SerializerRefs *p_refs) {
+  Node a = {.id = 1}, b = {.id = 2};
+  a.next = &b;
+  b.next = &a;
+  CHECK_GRAPH_JSON(serializer_Node_to_json, &a, p_refs,
+                   "{\"$id\":1,\"id\":1,\"next\":{\"$id\":2,\"id\":2,\"next\":{\"$ref\":1}}}");
+  CHECK(2 == p_refs->refs_count);
+
+  // ids are assigned in the order of the first visit
+  const SerializerRef *p_ref = serializer_refs_find(p_refs, 1);
+  CHECK(NULL != p_ref && &a == p_ref->p_val);
+  p_ref = serializer_refs_find(p_refs, 2);
+  CHECK(NULL != p_ref && &b == p_ref->p_val);
+  CHECK(NULL == serializer_refs_find(p_refs, 0));
+  CHECK(NULL == serializer_refs_find(p_refs, 3));
+
+  // a node pointing to itself
+  a.next = &a;
+  CHECK_GRAPH_JSON(serializer_Node_to_json, &a, p_refs, "{\"$id\":1,\"id\":1,\"next\":{\"$ref\":1}}");
+
+  // without reset the objects of the previous document are references only
+  char *p_json = graph_json(serializer_Node_to_json, &a, p_refs);
+  CHECK(NULL != p_json && 0 == strcmp(p_json, "{\"$ref\":1}"));
+  free(p_json);
+}
+
+static void test_shared(SerializerRefs *p_refs) {
+  Tag tag = {.code = 7}, other = {.code = 8};
+  Pair pair = {.first = &tag, .second = &tag};
+  CHECK_GRAPH_JSON(serializer_Pair_to_json, &pair, p_refs,
+                   "{\"$id\":1,\"first\":{\"$id\":2,\"code\":7},\"second\":{\"$ref\":2}}");
+
+  pair.second = &other;
+  CHECK_GRAPH_JSON(serializer_Pair_to_json, &pair, p_refs,
+                   "{\"$id\":1,\"first\":{\"$id\":2,\"code\":7},\"second\":{\"$id\":3,\"code\":8}}");
+
+  // the first member has the address of its holder, yet it is another object
+  Holder holder = {.head = {.id = 5}};
+  holder.head.next = &holder.head;
+  holder.p_head = &holder.head;
+  CHECK_GRAPH_JSON(serializer_Holder_to_json, &holder, p_refs,
+                   "{\"$id\":1,\"head\":{\"$id\":2,\"id\":5,\"next\":{\"$ref\":2}},\"p_head\":{\"$ref\":2}}");
+}
+
+/// Real graphs end in NULL pointers, they are written as null
+static void test_null(SerializerRefs *p_refs) {
+  Node c = {.id = 3, .next = NULL}, b = {.id = 2, .next = &c}, a = {.id = 1, .next = &b};
+  CHECK_GRAPH_JSON(serializer_Node_to_json, &a, p_refs,
+                   "{\"$id\":1,\"id\":1,\"next\":{\"$id\":2,\"id\":2,\"next\":{\"$id\":3,\"id\":3,\"next\":null}}}");
+
+  Pair pair = {.first = NULL, .second = NULL};
+  CHECK_GRAPH_JSON(serializer_Pair_to_json, &pair, p_refs, "{\"$id\":1,\"first\":null,\"second\":null}");
+
+  // NULL elements of arrays and NULL at any level of indirection
+  Tag tag = {.code = 7};
+  Tag *p_tag = NULL;
+  Node *nodes[3] = {&c, NULL, &c};
+  Registry registry = {.slots = {&tag, NULL, &tag}, .nodes = nodes, .nodes_count = 3, .p_code = NULL, .pp_tag = &p_tag};
+  CHECK_GRAPH_JSON(serializer_Registry_to_json, &registry, p_refs,
+                   "{\"$id\":1,\"slots\":[{\"$id\":2,\"code\":7},null,{\"$ref\":2}],"
+                   "\"nodes\":[{\"$id\":3,\"id\":3,\"next\":null},null,{\"$ref\":3}],"
+                   "\"nodes_count\":3,\"p_code\":null,\"pp_tag\":null}");
+
+  int code = 5;
+  registry.p_code = &code;
+  p_tag = &tag;
+  registry.pp_tag = &p_tag;
+  registry.nodes_count = 0;
+  CHECK_GRAPH_JSON(serializer_Registry_to_json, &registry, p_refs,
+                   "{\"$id\":1,\"slots\":[{\"$id\":2,\"code\":7},null,{\"$ref\":2}],"
+                   "\"nodes\":[],\"nodes_count\":0,\"p_code\":5,\"pp_tag\":{\"$ref\":2}}");
+
+  registry.pp_tag = NULL;
+  CHECK_GRAPH_JSON(serializer_Registry_to_json, &registry, p_refs,
+                   "{\"$id\":1,\"slots\":[{\"$id\":2,\"code\":7},null,{\"$ref\":2}],"
+                   "\"nodes\":[],\"nodes_count\":0,\"p_code\":5,\"pp_tag\":null}");
+}
+
+/// A ring longer than the initial table, so the refs grow while they are referenced
+static void test_long_ring(SerializerRefs *p_refs) {
+  enum { NODES_COUNT = 1000 };
+  Node *nodes = malloc(NODES_COUNT * sizeof(Node));
+  CHECK(NULL != nodes);
+  if (NULL == nodes) {
+    return;
+  }
+  for (int i = 0; i < NODES_COUNT; ++i) {
+    nodes[i] = (Node){.id = i + 1, .next = nodes + (i + 1) % NODES_COUNT};
+  }
+
+  serializer_refs_reset(p_refs);
+  char *p_json = graph_json(serializer_Node_to_json, nodes, p_refs);
+  CHECK(NULL != p_json);
+  CHECK(NODES_COUNT == p_refs->refs_count);
+  for (uint32_t id = 1; id <= NODES_COUNT; ++id) {
+    const SerializerRef *p_ref = serializer_refs_find(p_refs, id);
+    CHECK(NULL != p_ref && nodes + id - 1 == p_ref->p_val);
+  }
+
+  if (NULL != p_json) {
+    char last[64];
+    snprintf(last, sizeof(last), "{\"$id\":%d,\"id\":%d,\"next\":{\"$ref\":1}}", NODES_COUNT, NODES_COUNT);
+    // the last node refers to the first one, then all the nodes are closed
+    size_t length = strlen(p_json);
+    size_t last_length = strlen(last);
+    CHECK(0 == strncmp(p_json, "{\"$id\":1,\"id\":1,\"next\":{\"$id\":2,\"id\":2,", 39));
+    CHECK(length > last_length + NODES_COUNT - 1);
+    if (length > last_length + NODES_COUNT - 1) {
+      const char *p_tail = p_json + length - (NODES_COUNT - 1);
+      CHECK(0 == strncmp(p_tail - last_length, last, last_length));
+      CHECK(strspn(p_tail, "}") == NODES_COUNT - 1);
+    }
+  }
+  free(p_json);
+  free(nodes);
+}
+
+int main(void) {
+  SerializerRefs refs;
+  serializer_refs_init(&refs);
+
+  test_cycle(&refs);
+  test_shared(&refs);
+  test_null(&refs);
+  test_long_ring(&refs);
+
+  serializer_refs_free(&refs);
+  return 0 == failures ? 0 : 1;
+}
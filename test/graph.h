@@ -0,0 +1,31 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+typedef struct Node {
+  int id;
+  struct Node *next;
+} Node;
+
+typedef struct Tag {
+  int code;
+} Tag;
+
+typedef struct Pair {
+  Tag *first;
+  Tag *second;
+} Pair;
+
+typedef struct Holder {
+  Node head;
+  Node *p_head;
+} Holder;
+
+typedef struct Registry {
+  Tag *slots[3];
+  Node **nodes; // `@array @size nodes_count`
+  int nodes_count;
+  int *p_code;
+  Tag **pp_tag;
+} Registry;
+
+#endif
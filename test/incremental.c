@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "json.h"
+
+static int failures = 0;
+
+#define CHECK(cond)\
+  do {\
+    if (!(cond)) {\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+      ++failures;\
+    }\
+  } while (0)
+
+/// A broken sensor fails after a part of its object is written, like a failing format does
+bool sensor_to_json(Serializer *p_ser, const void *value) {
+  const Sensor *p_sensor = value;
+  if (!serializer_json_start_object(p_ser)) {
+    return false;
+  }
+  if (p_sensor->is_broken) {
+    serializer_json_start_field(p_ser, "value");
+    return false;
+  }
+  return serializer_json_field_from_int(p_ser, "value", p_sensor->value)
+    && serializer_json_end_object(p_ser);
+}
+
+bool sensor_from_json(Serializer *p_ser, void *value) {
+  (void)p_ser;
+  (void)value;
+  return false;
+}
+
+/// Serializes the unit with the full serializer, NULL on failure
+static char *full_json(const Unit *p_unit) {
+  Serializer ser;
+  serializer_start_serialization(&ser, SER_KIND_JSON);
+  char *p_json = NULL;
+  if (serializer_Unit_to_json(&ser, p_unit) && serializer_end_serialization(&ser, SER_KIND_JSON)) {
+    p_json = strdup(ser.data);
+  }
+  serializer_free(&ser);
+  return p_json;
+}
+
+/// Serializes the unit from its fragments, NULL on failure
+static char *incremental_json(const Unit *p_unit, SerializerFragments *p_fragments) {
+  Serializer ser;
+  serializer_start_serialization(&ser, SER_KIND_JSON);
+  char *p_json = NULL;
+  if (serializer_Unit_to_json_incremental(&ser, p_unit, p_fragments) && serializer_end_serialization(&ser, SER_KIND_JSON)) {
+    p_json = strdup(ser.data);
+  }
+  serializer_free(&ser);
+  return p_json;
+}
+
+/// Checks that the fragments give the same JSON as the full serializer
+static void check_same_as_full(const Unit *p_unit, SerializerFragments *p_fragments, int line) {
+  char *p_full = full_json(p_unit);
+  char *p_incremental = incremental_json(p_unit, p_fragments);
+  if (NULL == p_full || NULL == p_incremental || 0 != strcmp(p_full, p_incremental)) {
+    printf("%s:%d: incremental\n  %s\ndiffers from full\n  %s\n", __FILE__, line,
+           p_incremental ? p_incremental : "(failed)", p_full ? p_full : "(failed)");
+    ++failures;
+  }
+  free(p_incremental);
+  free(p_full);
+}
+
+#define CHECK_SAME_AS_FULL(p_unit, p_fragments) check_same_as_full(p_unit, p_fragments, __LINE__)
+
+static void test_incremental(void) {
+  double samples[4] = {1.5, 2, 3, 4};
+  Unit unit = {
+    .tick = 1,
+    .secret = 42,
+    .pos = {1.5f, 2},
+    .samples_count = 2,
+    .samples = samples,
+    .name = "alpha",
+    .sensor = {.value = 7}
+  };
+
+  SerializerFragments fragments;
+  CHECK(serializer_Unit_fragments_init(&fragments));
+
+  // all fields are dirty at first, both modes have to give exactly this
+  char *p_json = incremental_json(&unit, &fragments);
+  CHECK(NULL != p_json && 0 == strcmp(p_json,
+    "{\"tick\":1,\"pos\":{\"x\":1.5,\"y\":2},\"samples_count\":2,\"samples\":[1.5,2],\"name\":\"alpha\",\"sensor\":{\"value\":7}}"));
+  free(p_json);
+  CHECK(0 == fragments.dirty);
+
+  // marked fields are formatted again
+  unit.tick = 2;
+  memcpy(unit.name, "beta", 5);
+  serializer_fragments_mark_dirty(&fragments, SER_MASK_Unit_tick | SER_MASK_Unit_name);
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+
+  // unmarked fields keep their fragments, the omitted one has no mask at all
+  char *p_before = incremental_json(&unit, &fragments);
+  unit.pos.x = 9;
+  unit.secret = 0;
+  char *p_stale = incremental_json(&unit, &fragments);
+  CHECK(NULL != p_before && NULL != p_stale && 0 == strcmp(p_before, p_stale));
+  free(p_stale);
+  free(p_before);
+  serializer_fragments_mark_dirty(&fragments, SER_MASK_Unit_pos);
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+
+  // a longer array outgrows the buffer of its fragment
+  unit.samples_count = 4;
+  serializer_fragments_mark_dirty(&fragments, SER_MASK_Unit_samples_count | SER_MASK_Unit_samples);
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+
+  // a failed format leaves the field dirty, the fields before it are kept
+  unit.tick = 3;
+  unit.sensor.is_broken = 1;
+  serializer_fragments_mark_dirty(&fragments, SER_MASK_Unit_tick | SER_MASK_Unit_sensor);
+  CHECK(NULL == incremental_json(&unit, &fragments));
+  CHECK(SER_MASK_Unit_sensor == fragments.dirty);
+  CHECK(NULL == incremental_json(&unit, &fragments));
+
+  unit.sensor.is_broken = 0;
+  unit.sensor.value = 8;
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+  CHECK(0 == fragments.dirty);
+
+  // nothing dirty, nothing changed
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+
+  // marking everything is the same as starting over
+  unit.pos.y = -1;
+  serializer_fragments_mark_dirty(&fragments, SER_MASK_Unit_tick | SER_MASK_Unit_pos | SER_MASK_Unit_samples_count
+                                  | SER_MASK_Unit_samples | SER_MASK_Unit_name | SER_MASK_Unit_sensor);
+  CHECK_SAME_AS_FULL(&unit, &fragments);
+
+  serializer_fragments_free(&fragments);
+}
+
+int main(void) {
+  test_incremental();
+  return 0 == failures ? 0 : 1;
+}
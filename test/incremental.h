@@ -0,0 +1,26 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+
+typedef struct Position {
+  float x;
+  float y;
+} Position;
+
+typedef struct Sensor {
+  int is_broken;
+  int value;
+} Sensor;
+
+typedef struct Unit {
+  // `@incremental`
+  int tick;
+  int secret; // `@omit`
+  Position pos;
+  int samples_count;
+  double *samples; // `@array @size samples_count`
+  char name[8];
+  Sensor sensor; // `@callback @s sensor_to_json @d sensor_from_json`
+} Unit;
+
+#endif
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Generates serializers of every test in both modes (functions and --tables) and runs it against them,
+# once more with a relative output directory,
+# a test <name> is test/<name>.h with the types and test/<name>.c with main, it fails with a nonzero exit.
+#
+# usage: test/modes.sh <path to serc> [name]...
+set -e
+
+SERC=$(realpath "$1")
+shift
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-g -fsanitize=address,undefined"}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+[ $# -eq 0 ] && set -- incremental graph
+
+for name in "$@"; do
+  for mode in functions tables relative; do
+    rel="$name/$mode"
+    dir="$WORK/$rel"
+    mkdir -p "$dir"
+    cp "$ROOT/src/serialization/primitives.h" "$ROOT/src/serialization/primitives.c" "$dir/"
+    case "$mode" in
+      functions) "$SERC" --no-cache --graph -o "$dir/" "$ROOT/test/$name.h" >/dev/null ;;
+      tables) "$SERC" --no-cache --tables -o "$dir/" "$ROOT/test/$name.h" >/dev/null ;;
+      # relative output directory without the trailing '/', the generated files do not depend on it
+      relative)
+        (cd "$WORK" && "$SERC" --graph -o "$rel" "$ROOT/test/$name.h") >/dev/null
+        [ -f "$dir/.serc-cache" ] || { echo "$rel/.serc-cache is missing"; exit 1; }
+        ;;
+    esac
+    # shellcheck disable=SC2086
+    (cd "$WORK" && $CC -std=gnu11 -Wall -Wextra $CFLAGS -I"$ROOT/test" -I"$rel" \
+      "$ROOT/test/$name.c" "$rel/json.c" "$rel/primitives.c" -pthread -o "$rel/test")
+    if "$dir/test"; then
+      printf "%-12s %-10s ok\n" "$name" "$mode"
+    else
+      printf "%-12s %-10s FAILED\n" "$name" "$mode"
+      exit 1
+    fi
+  done
+done